@@ -18,6 +18,13 @@
 #define DEBUG false
 //!	\endignore
 
+#if TASKMGR_MAX_EXECUTORS>1
+//!	\ignore
+// s_taskExecutor[] value for a task ID that was added on more than one executor
+#define TASKMGR_TASK_ON_MANY 0xFF
+//!	\endignore
+#endif
+
 
 
 /*! \file TaskManager.cpp
@@ -141,6 +148,7 @@ bool _TaskManagerTask::isRunnable()  {
 _TaskManagerTask& _TaskManagerTask::operator=(_TaskManagerTask& rhs){
     // makes a complete copy of all of the values
     m_stateFlags = rhs.m_stateFlags;
+    m_dispatchFlags = rhs.m_dispatchFlags;
 
     m_restartTime = rhs.m_restartTime;
     memcpy(m_message, rhs.m_message, TASKMGR_MESSAGE_SIZE+1);
@@ -149,6 +157,12 @@ _TaskManagerTask& _TaskManagerTask::operator=(_TaskManagerTask& rhs){
 
     m_id = rhs.m_id;
     m_fn = rhs.m_fn;
+    m_ctxFn = rhs.m_ctxFn;
+    m_context = rhs.m_context;
+    m_yieldType = rhs.m_yieldType;
+    m_budgetUs = rhs.m_budgetUs;
+    m_overruns = rhs.m_overruns;
+    m_mailbox = rhs.m_mailbox;
 	return *this;
 }
 
@@ -157,7 +171,7 @@ _TaskManagerTask& _TaskManagerTask::operator=(_TaskManagerTask& rhs){
     Returns true if and only if all of the data values (id, function, etc.) are the same.
 */
 bool _TaskManagerTask::operator==(_TaskManagerTask& rhs) const {
-    return m_id==rhs.m_id && m_fn==rhs.m_fn;
+    return m_id==rhs.m_id && m_fn==rhs.m_fn && m_ctxFn==rhs.m_ctxFn && m_context==rhs.m_context;
 }
 
 /*! \brief Print out information about the task
@@ -199,8 +213,30 @@ size_t _TaskManagerTask::printTo(Print& p) const {
 /*! \brief Create a new TaskManager task control object.
 
 	Creates an empty TaskManager control object
+	\param primary -- true for TaskMgr only, which is always executor 0.  Other instances are
+	numbered from 1 in the order they are constructed.  Instances past TASKMGR_MAX_EXECUTORS get
+	the ID TASKMGR_MAX_EXECUTORS and are disabled:  beginCore() refuses them, and no messages pass
+	between them and the other executors.
 */
-TaskManager::TaskManager() {
+TaskManager::TaskManager(bool primary/*=false*/) {
+    m_jmpArmed = false;
+    m_returnDispatch = false;
+    m_strayYields = 0;
+    m_callSeq = 0;
+    m_budgetActive = false;
+    m_overrunHook = NULL;
+#if TASKMGR_MAX_EXECUTORS>1
+    // TaskMgr is executor 0 whatever order the globals are constructed in; the others follow it.
+    if(primary) {
+        m_executorId = 0;
+    } else {
+        m_executorId = (s_executorCount<TASKMGR_MAX_EXECUTORS-1) ? ++s_executorCount : TASKMGR_MAX_EXECUTORS;
+    }
+    if(m_executorId<TASKMGR_MAX_EXECUTORS) s_executors[m_executorId] = this;
+    m_offloadPool = NULL;
+#else
+    (void)primary;
+#endif
     add(TASKMGR_NULL_TASK, nullTask);
     m_startTime = millis();
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
@@ -215,7 +251,21 @@ TaskManager::TaskManager() {
 #elif defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
 	m_myNodeId = 0;
 	m_radioReceiverRunning = false;
-	m_TaskManagerMessageQueueSemaphore = xSemaphoreCreateBinary();
+	m_radioAggWindow = 0;
+	m_radioReliable = false;
+	m_radioRouteInterval = 0;
+	m_radioRouteAdvertised = 0;
+	m_radioCompress = false;
+	m_radioNodeRate = 0;
+	m_radioTaskRate = 0;
+	m_radioRateBurst = TASKMGR_RATE_BURST;
+	m_radioRateShed = true;
+	m_radioBackoffMax = 0;
+	m_radioRxBudget = 0;
+	m_radioRxScale = 0;
+	m_radioSendHook = NULL;
+	m_transport = NULL;
+	m_rxPacket = NULL;
 #endif	// which architecture
 #endif // TM_USING_RADIO
 
@@ -231,12 +281,28 @@ TaskManager::~TaskManager() {
 #if TM_USING_RADIO
 #if (defined(ARDUINO_ARCH_AVR) && defined(TASKMGR_AVR_RF24)) 
 	if(m_rf24!=NULL) delete m_rf24;
-#elif defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
-	vSemaphoreDelete(m_TaskManagerMessageQueueSemaphore);
 #endif // architecture selection
 #endif // TM_USING_RADIO
 }
 
+/*!	\brief Put a new task on the task ring.  Internal routine.
+
+	With multiple executors, this also records that the task runs on this executor, so messages
+	sent to it from other executors are routed here.  If the task ID is already on another executor,
+	it is marked as on several, and messages to it are then delivered on the sender's executor.
+	\param newTask -- the fully set-up task.  It is copied onto the ring.
+*/
+void TaskManager::addTask(_TaskManagerTask& newTask) {
+    m_theTasks.push_back(newTask);
+#if TASKMGR_MAX_EXECUTORS>1
+    // every executor has a null task, and it is never sent messages
+    if(m_executorId<TASKMGR_MAX_EXECUTORS && newTask.m_id!=TASKMGR_NULL_TASK) {
+        uint8_t was = s_taskExecutor[newTask.m_id];
+        s_taskExecutor[newTask.m_id] = (was==0 || was==m_executorId+1) ? m_executorId+1 : TASKMGR_TASK_ON_MANY;
+    }
+#endif
+}
+
 /*!  \brief Add a simple task.
 
 	The task will execute once each cycle through the task list.  Unless the task itself forces itself into a different scheduling
@@ -249,7 +315,7 @@ TaskManager::~TaskManager() {
 */
 void TaskManager::add(tm_taskId_t taskId, void (*fn)()) {
     _TaskManagerTask newTask(taskId, fn);
-    m_theTasks.push_back(newTask);
+    addTask(newTask);
 }
 
 /*! \brief Add a task that will be delayed before its first invocation
@@ -283,7 +349,7 @@ void TaskManager::addWaitDelay(tm_taskId_t taskId, void(*fn)(), unsigned long ms
 void TaskManager::addWaitUntil(tm_taskId_t taskId, void(*fn)(), unsigned long msWhen) {
     _TaskManagerTask newTask(taskId, fn);
     newTask.setWaitUntil(msWhen);
-    m_theTasks.push_back(newTask);
+    addTask(newTask);
 }
 
 /*! \brief Add a task that will automatically reschedule itself with a delay
@@ -307,7 +373,7 @@ void TaskManager::addAutoWaitDelay(tm_taskId_t taskId, void(*fn)(), unsigned lon
     _TaskManagerTask newTask(taskId, fn);
     if(startWaiting) newTask.setWaitDelay(period); else newTask.m_restartTime = millis();
     newTask.setAutoDelay(period);
-    m_theTasks.push_back(newTask);
+    addTask(newTask);
 }
 
 /*! \brief Add a task that is waiting for a message
@@ -322,7 +388,7 @@ void TaskManager::addAutoWaitDelay(tm_taskId_t taskId, void(*fn)(), unsigned lon
 void TaskManager::addWaitMessage(tm_taskId_t taskId, void (*fn)(), unsigned long timeout/*=0*/) {
     _TaskManagerTask newTask(taskId, fn);
     newTask.setWaitMessage(timeout);
-    m_theTasks.push_back(newTask);
+    addTask(newTask);
 }
 
 /*! \brief Add a task that is waiting for a message or until a timeout occurs
@@ -347,7 +413,139 @@ void TaskManager::addAutoWaitMessage(tm_taskId_t taskId, void (*fn)(), unsigned
         if(timeout>0) newTask.setWaitUntil(millis()+timeout);
     }
     newTask.setAutoMessage(timeout);
-    m_theTasks.push_back(newTask);
+    addTask(newTask);
+}
+
+/*!  \brief Add a simple task that carries a context.
+
+	The same as add(taskId, fn), except the procedure is passed a context pointer on every invocation.
+	This allows one procedure to serve many tasks, each with its own state block.  The task can also
+	retrieve its context with myContext().
+	\param taskId - the task's ID.  For normal user tasks, this should be a byte value in the range [1 239].
+	System tasks have taskId values in the range [240 255].
+	\param fn -- this is a void function taking a void* argument.  This is the procedure that is called every time
+	the task is invoked.
+	\param context -- the context passed to fn.  Normally a pointer to a task-specific struct.
+	\sa add, myContext, TMR_BEGIN_CONTEXT
+*/
+void TaskManager::add(tm_taskId_t taskId, void (*fn)(void*), void* context) {
+    _TaskManagerTask newTask(taskId, fn, context);
+    addTask(newTask);
+}
+
+/*! \brief Add a task that carries a context and will be delayed before its first invocation
+	\param taskId - the task's ID.
+	\param fn -- the procedure that is called every time the task is invoked.  It is passed the context.
+	\param context -- the context passed to fn.
+	\param msDelay -- the initial delay, in milliseconds
+	\sa addWaitDelay
+*/
+void TaskManager::addWaitDelay(tm_taskId_t taskId, void(*fn)(void*), void* context, unsigned long msDelay) {
+    addWaitUntil(taskId, fn, context, millis() + msDelay);
+}
+
+/*! \brief Add a task that carries a context and will be delayed until a set system clock time before its first invocation
+	\param taskId - the task's ID.
+	\param fn -- the procedure that is called every time the task is invoked.  It is passed the context.
+	\param context -- the context passed to fn.
+	\param msWhen -- the system clock time of the first invocation, in milliseconds
+	\sa addWaitUntil
+*/
+void TaskManager::addWaitUntil(tm_taskId_t taskId, void(*fn)(void*), void* context, unsigned long msWhen) {
+    _TaskManagerTask newTask(taskId, fn, context);
+    newTask.setWaitUntil(msWhen);
+    addTask(newTask);
+}
+
+/*! \brief Add a task that carries a context and will automatically reschedule itself with a delay
+	\param taskId - the task's ID.
+	\param fn -- the procedure that is called every time the task is invoked.  It is passed the context.
+	\param context -- the context passed to fn.
+	\param period -- the schedule, in milliseconds
+	\param startWaiting -- for the first execution, start immediately (false), or delay its start for one period (true)
+	\sa addAutoWaitDelay
+*/
+void TaskManager::addAutoWaitDelay(tm_taskId_t taskId, void(*fn)(void*), void* context, unsigned long period, bool startWaiting /*=false*/) {
+    _TaskManagerTask newTask(taskId, fn, context);
+    if(startWaiting) newTask.setWaitDelay(period); else newTask.m_restartTime = millis();
+    newTask.setAutoDelay(period);
+    addTask(newTask);
+}
+
+/*! \brief Add a task that carries a context and is waiting for a message
+	\param taskId - the task's ID.
+	\param fn -- the procedure that is called every time the task is invoked.  It is passed the context.
+	\param context -- the context passed to fn.
+	\param timeout -- the maximum time to wait (in ms) before timing out.
+	\sa addWaitMessage
+*/
+void TaskManager::addWaitMessage(tm_taskId_t taskId, void (*fn)(void*), void* context, unsigned long timeout/*=0*/) {
+    _TaskManagerTask newTask(taskId, fn, context);
+    newTask.setWaitMessage(timeout);
+    addTask(newTask);
+}
+
+/*! \brief Add a task that carries a context and is waiting for a message or until a timeout occurs
+	\param taskId - the task's ID.
+	\param fn -- the procedure that is called every time the task is invoked.  It is passed the context.
+	\param context -- the context passed to fn.
+	\param timeout -- the maximum time to wait (in ms) before timing out.
+	\param startWaiting -- tells whether the routine will start waiting for a message (true) or will execute
+	immediately (false).
+	\sa addAutoWaitMessage
+*/
+void TaskManager::addAutoWaitMessage(tm_taskId_t taskId, void (*fn)(void*), void* context, unsigned long timeout/*=0*/, bool startWaiting/*=true*/) {
+    _TaskManagerTask newTask(taskId, fn, context);
+    if(startWaiting) {
+        newTask.setWaitMessage(timeout);
+        if(timeout>0) newTask.setWaitUntil(millis()+timeout);
+    }
+    newTask.setAutoMessage(timeout);
+    addTask(newTask);
+}
+
+/*!  \brief Add a simple task that yields only through the TM_* macros.
+
+	The same as add(taskId, fn), except the task is invoked without a setjmp(), which saves time on
+	every dispatch.  The task must yield only through the TM_* (or TMR_*) macros or by returning.  A bare
+	yield*() call cannot unwind the task; it is counted in strayYields() and the task keeps running
+	until it returns.
+	\param taskId - the task's ID.  For normal user tasks, this should be a byte value in the range [1 239].
+	System tasks have taskId values in the range [240 255].
+	\param fn -- this is a void function with no arguments.  Normally it starts with TM_BEGIN().
+	\sa add, strayYields, TM_BEGIN
+*/
+void TaskManager::addReturnYield(tm_taskId_t taskId, void (*fn)()) {
+    _TaskManagerTask newTask(taskId, fn);
+    newTask.m_dispatchFlags |= _TaskManagerTask::ReturnYield;
+    addTask(newTask);
+}
+
+/*!  \brief Add a task that carries a context and yields only through the TMR_* macros.
+
+	The same as add(taskId, fn, context), except the task is invoked without a setjmp().  See
+	addReturnYield(taskId, fn).
+	\param taskId - the task's ID.
+	\param fn -- the procedure that is called every time the task is invoked.  Normally it starts with
+	TMR_BEGIN_CONTEXT().
+	\param context -- the context passed to fn.
+	\sa add, strayYields, TMR_BEGIN_CONTEXT
+*/
+void TaskManager::addReturnYield(tm_taskId_t taskId, void (*fn)(void*), void* context) {
+    _TaskManagerTask newTask(taskId, fn, context);
+    newTask.m_dispatchFlags |= _TaskManagerTask::ReturnYield;
+    addTask(newTask);
+}
+
+/*!	\brief Return the number of bare yield*() calls made by tasks added with addReturnYield()
+
+	Such tasks are invoked without a jump buffer, so a bare yield*() is recorded but cannot return
+	control to the task manager.  A non-zero count means one of them should use the TM_* macros
+	or be added with add() instead.
+	\return The number of stray yields since the TaskManager was created.
+*/
+unsigned int TaskManager::strayYields() const {
+	return m_strayYields;
 }
 
 /*! \brief Exit from this task and return control to the task manager
@@ -358,7 +556,8 @@ void TaskManager::addAutoWaitMessage(tm_taskId_t taskId, void (*fn)(), unsigned
 	\sa yieldDelay(), yieldUntil(), yieldMessage(), addAutoWaitDelay(), addAutoWaitMessage()
 */
 void TaskManager::yield() {
-    longjmp(taskJmpBuf, YtYield);
+    markYield();
+    legacyYieldJump(YtYield);
 }
 
 /*! \brief Exit from the task manager and do not restart this task until after a specified period.
@@ -387,8 +586,8 @@ void TaskManager::yieldDelay(unsigned long ms) {
 */
 void TaskManager::yieldUntil(unsigned long when) {
     // mark it as waiting
-    m_theTasks.front().setWaitUntil(when);
-    longjmp(taskJmpBuf, YtYieldUntil);
+    markYieldUntil(when);
+    legacyYieldJump(YtYieldUntil);
 }
 
 /*! \brief Exit from the task manager and do not restart this task until a message has been received or a stated time period has passed.
@@ -405,8 +604,27 @@ void TaskManager::yieldUntil(unsigned long when) {
 	\sa yield(), yieldDelay(), addAutoWaitDelay(), addAutoWaitMessage(), timeOut()
 */
 void TaskManager::yieldForMessage(unsigned long timeout/*=0*/) {
-    m_theTasks.front().setWaitMessage(timeout);
-    longjmp(taskJmpBuf, YtYieldMessageTimeout);
+    markYieldForMessage(timeout);
+    legacyYieldJump(YtYieldMessageTimeout);
+}
+
+/*! \brief Unwind a bare yield*() call back to TaskManager::loop().  Internal routine.
+
+	The yield itself has already been recorded in the task's control block.  This longjmp()s
+	back to loop(), which arms the jump buffer for tasks added with add*().  A task added with
+	addReturnYield() runs without one, so the call is counted in strayYields() and returns into
+	the task.  Called outside a task, there is nothing to jump to and this returns.
+	\param yieldType -- the YieldTypes value passed to longjmp().
+*/
+void TaskManager::legacyYieldJump(int yieldType) {
+    if(m_jmpArmed) longjmp(taskJmpBuf, yieldType);
+    if(m_returnDispatch) {
+        m_strayYields++;
+#if defined(TASKMANAGER_DEBUG)
+        Serial.print(F("TaskManager: bare yield from return-path task "));
+        Serial.println(myId());
+#endif
+    }
 }
 
 //
@@ -416,29 +634,75 @@ void TaskManager::yieldForMessage(unsigned long timeout/*=0*/) {
 //
 
 void TaskManager::internalSendMessage(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, tm_taskId_t taskId, char* message) {
-    _TaskManagerTask* tsk;
     if(strlen(message)>TASKMGR_MESSAGE_SIZE-1) return;
-    tsk = findTaskById(taskId);
-    if(tsk==NULL) return;
-    tsk->m_fromNodeId = fromNodeId;
-    tsk->m_fromTaskId = fromTaskId;
-    tsk->putMessage((void*)message, strlen(message)+1);
+    internalSendMessage(fromNodeId, fromTaskId, taskId, (void*)message, strlen(message)+1);
 }
 
 void TaskManager::internalSendMessage(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, tm_taskId_t taskId, void* buf, int len) {
-    _TaskManagerTask* tsk;
 	//Serial.printf("ism: from n/t %d/%d to task %d, msg len %d\n", fromNodeId, fromTaskId, taskId, len);
     if(len>TASKMGR_MESSAGE_SIZE) return;
-	//Serial.printf("len is okay");
+#if TASKMGR_MAX_EXECUTORS>1
+    if(postCrossMessage(fromNodeId, fromTaskId, taskId, buf, len)) return;
+#endif
+    localSendMessage(fromNodeId, fromTaskId, taskId, buf, len);
+}
+
+/*!	\brief Deliver a message to a task on this executor.  Internal routine.
+	\param fromNodeId - the source node of the message.  0 means "this node".
+	\param fromTaskId - the source task of the message.
+	\param taskId - which task is to receive the message.
+	\param buf - the buffer with the message.
+	\param len - the size of the buf (in bytes).
+*/
+void TaskManager::localSendMessage(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, tm_taskId_t taskId, void* buf, int len) {
+    _TaskManagerTask* tsk;
     tsk = findTaskById(taskId);
 	//Serial.printf("back from findTaskById, %s\n",tsk==NULL?"did not find":"found");
     if(tsk==NULL) return;
-	//Serial.printf(" task was found\n");
+    // With a mailbox, only a task waiting for a message with nothing queued takes the message
+    // directly.  Otherwise it is queued, rather than overwriting a message the task has not read.
+    if(tsk->m_mailbox!=NULL
+    		&& !(tsk->stateTestBit(_TaskManagerTask::WaitMessage) && tsk->m_mailbox->size()==0)) {
+        tsk->m_mailbox->put(fromNodeId, fromTaskId, buf, len);
+        return;
+    }
     tsk->m_fromNodeId = fromNodeId;
     tsk->m_fromTaskId = fromTaskId;
     tsk->putMessage(buf, len);
 }
 
+/*!	\brief Give a task a mailbox
+
+	A task normally holds a single message, and a new message overwrites one the task has not
+	read yet.  A task with a mailbox queues up to depth messages instead.  The oldest is delivered
+	as usual (waking a task waiting for a message), and the task can read the rest in the same
+	dispatch with nextMessage().  A task that returns with messages still queued stays runnable.
+	Normally called right after the task is added.
+	\param taskId The task to be given the mailbox
+	\param depth The number of messages the mailbox holds.  0 removes the mailbox.
+	\returns true if the task exists, false otherwise
+	\sa nextMessage(), pendingMessages(), getMailboxDrops()
+*/
+bool TaskManager::setMailbox(tm_taskId_t taskId, uint8_t depth) {
+    _TaskManagerTask* tsk;
+    tsk = findTaskById(taskId);
+    if(tsk==NULL) return false;
+    if(tsk->m_mailbox!=NULL) delete tsk->m_mailbox;
+    tsk->m_mailbox = depth==0 ? NULL : new _TaskManagerMailbox(depth);
+	return true;
+}
+
+/*!	\brief Return the number of messages dropped because a task's mailbox was full
+	\param taskId The task
+	\returns The number of dropped messages, or 0 if the task does not exist or has no mailbox
+*/
+unsigned int TaskManager::getMailboxDrops(tm_taskId_t taskId) {
+    _TaskManagerTask* tsk;
+    tsk = findTaskById(taskId);
+    if(tsk==NULL || tsk->m_mailbox==NULL) return 0;
+	return tsk->m_mailbox->drops();
+}
+
 // FindNextRunnable
 // Relies on the null task being present and always runnable.
 /*! \brief Find tne next runnable task.  Internal routine.
@@ -533,24 +797,53 @@ _TaskManagerTask* TaskManager::findTaskById(tm_taskId_t id) {
     runnable task and runs it.  It processes any yield*() operations that the user routine
     may have executed.
 
+    Tasks added with add*() are invoked under setjmp(), since they may call a bare yield*().
+    Tasks added with addReturnYield() yield only through the TM_* macros, which record the
+    yield in the task's control block and return, so they are invoked without setjmp().
+
     This routine is for internal use only.
 */
 void TaskManager::loop() {
-    int jmpVal; // return value from setjmp, indicates longjmp type
+    int jmpVal; // yield type, either recorded in the task or returned from setjmp
     _TaskManagerTask* nextTask;
+#if TASKMGR_MAX_EXECUTORS>1
+    s_running[xPortGetCoreID()] = this;
+    drainInboxes();
+    if(m_offloadPool!=NULL) drainOffload();
+#endif
     nextTask = /*TaskMgr.*/FindNextRunnable();
     // pre-stage the next startup time based on the current time.  This'll be overwritten if a Yield*(time)
     // is encountered.  It'll be ignored anyway unless we are auto-yielddelay, which is the only one
     // that focuses on the start-start measurement of the period.  (All others are end-start.)
     nextTask->m_restartTime = millis() + nextTask->m_period;
+    nextTask->m_yieldType = YtNone;
+    m_budgetActive = nextTask->m_budgetUs!=0;
+    if(m_budgetActive) m_dispatchDeadline = micros()+nextTask->m_budgetUs;
 	//Serial << "About to run task " << nextTask->m_id << endl;
-    if((jmpVal=setjmp(/*TaskMgr.*/taskJmpBuf))==0) {
-        // this is the normal path we use to invoke and process "normal" returns
-    	//??delete??if(DEBUG && (nextTask->m_id==T1 || nextTask->m_id==T2)) Serial << "about to run task " << nextTask->m_id
-    	//??delete??  << " at " << millis() << " status is " << _HEX(nextTask->m_stateFlags) << endl;
-        (nextTask->m_fn)();
-        //??delete??if(DEBUG && (nextTask->m_id==T1 || nextTask->m_id==T2))
-        //??delete??	Serial << "normal return at " << millis() << " pre-set status is " << _HEX(nextTask->m_stateFlags) << endl;
+    if(nextTask->m_dispatchFlags&_TaskManagerTask::ReturnYield) {
+        m_returnDispatch = true;
+        nextTask->invoke();
+        m_returnDispatch = false;
+        jmpVal = nextTask->m_yieldType;
+    } else if((jmpVal=setjmp(/*TaskMgr.*/taskJmpBuf))==0) {
+        // A bare yield*() will longjmp back here with a non-zero YieldTypes value.
+        m_jmpArmed = true;
+        nextTask->invoke();
+        m_jmpArmed = false;
+        // TM_* macro tasks record their yield in m_yieldType and return normally.
+        jmpVal = nextTask->m_yieldType;
+    } else {
+        m_jmpArmed = false;
+    }
+    if(m_budgetActive) {
+        unsigned long late = micros()-m_dispatchDeadline;
+        m_budgetActive = false;
+        if((long)late>0) {
+            if(nextTask->m_overruns<0xFFFF) nextTask->m_overruns++;
+            if(m_overrunHook!=NULL) (m_overrunHook)(nextTask->m_id, nextTask->m_budgetUs+late);
+        }
+    }
+    if(jmpVal==YtNone) {
 		// If we've gotten here, we got here through a normal "fall out the bottom or 'return'" return.
 		// As such, we reset according to the auto bits.
         // Process auto bits
@@ -562,8 +855,6 @@ void TaskManager::loop() {
 			nextTask->setWaitUntil(millis()+nextTask->m_period);
 		}
 		nextTask->resetCurrentStateBits();
-		//??delete??if(DEBUG && (nextTask->m_id==T1 || nextTask->m_id==T2))
-		//??delete??	Serial << "post-set status is " << _HEX(nextTask->m_stateFlags) << endl;
     } else {
         // this is the path executed if a yield was called
         // Yield types (jmpVal values) are from YtYield
@@ -573,7 +864,6 @@ void TaskManager::loop() {
         //
         // In each case, the yield*(...) routine will have set the appropriate flag bit(s)
         // and if needed, stuffed a m_restartTime value if a delay/timeout was specified.
-        //??delete??if(DEBUG && (nextTask->m_id==T1 || nextTask->m_id==T2)) Serial << "exited with yield type " << jmpVal << endl;
         switch(jmpVal) {
             case YtYield:
                 // normal yield, just exit cleanly
@@ -599,6 +889,11 @@ void TaskManager::loop() {
                 // kill: we need to remove the current task from the task ring.  It is gone.
                 // AutoRestart:  The task is being killed.  It will never AutoRestart
                 //**** MEMORY LEAK:  NEED TO DISPOSE OF THE TASK *****
+                // The ring copies tasks without owning their mailboxes, so the mailbox goes here.
+                if(nextTask->m_mailbox!=NULL) {
+                    delete nextTask->m_mailbox;
+                    nextTask->m_mailbox = NULL;
+                }
                 /*TaskMgr.*/m_theTasks.pop_front();
                 break;
             default:
@@ -607,7 +902,12 @@ void TaskManager::loop() {
                 break;
         }
      }
-     //??delete??if(DEBUG && (nextTask->m_id==T1 || nextTask->m_id==T2)) Serial << "<--TaskManager::loop\n";
+    // A task that is waiting for a message again but still has messages queued takes the next one,
+    // which keeps it runnable.
+    if(jmpVal!=YtYieldKill && nextTask->m_mailbox!=NULL
+    		&& nextTask->stateTestBit(_TaskManagerTask::WaitMessage)) {
+        nextTask->pullMessage();
+    }
 }
 
 // Status tasks
@@ -643,6 +943,89 @@ bool TaskManager::resume(tm_taskId_t taskId) {
 	return true;
 }
 
+/*!	\brief Return how long this executor has nothing to do
+
+	Tasks waiting for a time are due when it comes; tasks waiting for a message, and suspended
+	tasks, are not due at all.  On ESP, the radio tasks are due when the radio layer has frames
+	queued or one of its timers (resends, acks, aggregation, route advertisements) comes due.  A
+	program can sleep for this long, and a simulator can move its clock on by this much, without
+	a task running late.
+	\note Frames from a transport that has to be polled (see TaskManagerTransport::poll()) and
+	messages from other executors are not foreseen.
+	\returns the ms until a task is due; 0 if one is ready to run now, or TASKMGR_IDLE_FOREVER if
+	no task will run until a message arrives
+*/
+unsigned long TaskManager::idleTime() {
+	ring<_TaskManagerTask> tmpTasks;
+	_TaskManagerTask* last = &(m_theTasks.back());
+	unsigned long ret = TASKMGR_IDLE_FOREVER;
+	unsigned long now = TmMillis();
+	tmpTasks = m_theTasks;
+	while(true) {
+		_TaskManagerTask* tsk = &(tmpTasks.front());
+		unsigned long wait = TASKMGR_IDLE_FOREVER;
+#if TM_USING_RADIO && (defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32))
+		if(tsk->m_id==TASKMGR_RF_MONITOR_TASK && m_radioReceiverRunning) {
+			wait = radioIdleTime();
+		} else if(tsk->m_id==TASKMGR_RF_TX_TASK && m_radioReceiverRunning) {
+			// covered by radioIdleTime()
+		} else
+#endif
+		if(tsk->m_id==TASKMGR_NULL_TASK || tsk->stateTestBit(_TaskManagerTask::Suspended)) {
+			// never due
+		} else if(tsk->stateTestBit(_TaskManagerTask::WaitUntil)) {
+			// isRunnable() wants the time to have passed
+			wait = (long)(tsk->m_restartTime-now)<0 ? 0 : tsk->m_restartTime-now+1;
+		} else if(!tsk->stateTestBit(_TaskManagerTask::WaitMessage)) {
+			return 0;
+		}
+		if(wait<ret) ret = wait;
+		if(ret==0 || tsk==last) break;
+		tmpTasks.move_next();
+	}
+	return ret;
+}
+
+// Time budgets
+/*!	\brief Set the time budget for a task
+
+	The budget is the time the task may run in a single dispatch.  TM_CHECKPOINT() in the task
+	yields once it has been used up, and a dispatch that runs past it is counted as an overrun.
+	Normally called right after the task is added.
+	\param taskId The task to be given the budget
+	\param budgetUs The budget, in microseconds.  0 removes the budget.
+	\returns true if the task exists, false otherwise
+	\sa setOverrunHook(), getOverruns(), TM_CHECKPOINT()
+*/
+bool TaskManager::setBudget(tm_taskId_t taskId, unsigned long budgetUs) {
+    _TaskManagerTask* tsk;
+    tsk = findTaskById(taskId);
+    if(tsk==NULL) return false;
+    tsk->m_budgetUs = budgetUs;
+	return true;
+}
+
+/*!	\brief Set the routine called when a task overruns its time budget
+
+	The hook is called from loop() after the offending task returns.  It must not yield.
+	\param hook The routine.  It is passed the task and the time that dispatch took, in microseconds.
+	NULL removes the hook.
+*/
+void TaskManager::setOverrunHook(void (*hook)(tm_taskId_t taskId, unsigned long elapsedUs)) {
+	m_overrunHook = hook;
+}
+
+/*!	\brief Return the number of times a task has overrun its time budget
+	\param taskId The task
+	\returns The number of overruns (saturating at 65535), or 0 if the task does not exist
+*/
+unsigned int TaskManager::getOverruns(tm_taskId_t taskId) {
+    _TaskManagerTask* tsk;
+    tsk = findTaskById(taskId);
+    if(tsk==NULL) return 0;
+	return tsk->m_overruns;
+}
+
 //
 // Network/Mesh tasks
 //
@@ -672,13 +1055,12 @@ bool TaskManager::sendMessage(tm_nodeId_t nodeId, tm_taskId_t taskId, char* mess
 	radioBuf.m_fromNodeId = myNodeId();
 	radioBuf.m_fromTaskId = myId();
 	radioBuf.m_data[0] = taskId;	// who we are sending it to
-	if(strlen(message)>TASKMGR_MESSAGE_SIZE-2) {
-		memcpy(&radioBuf.m_data[1], message, TASKMGR_MESSAGE_SIZE-2);
-		radioBuf.m_data[TASKMGR_MESSAGE_SIZE-2]='\0';
-	} else {
-		strcpy((char*)&radioBuf.m_data[1], message);
-	}
-	return radioSender(nodeId);
+	int len = strlen(message)+1;
+	if(len>(int)TASKMGR_MESSAGE_SIZE-1) len = TASKMGR_MESSAGE_SIZE-1;	// truncate; the last byte is sent as '\0'
+	if(1+len>radioFrameRoom(nodeId)) return radioSendFragments(nodeId, taskId, (byte*)message, len, true);
+	memcpy(&radioBuf.m_data[1], message, len-1);
+	radioBuf.m_data[len]='\0';
+	return radioSender(nodeId, TASKMGR_RADIO_HEADER_SIZE+1+len);
 }
 
 /*! \brief Send a binary message to a task on a different node
@@ -695,6 +1077,9 @@ bool TaskManager::sendMessage(tm_nodeId_t nodeId, tm_taskId_t taskId, char* mess
 	\param buf -- A pointer to the structure that is to be passed to the task
 	\param len -- The length of the buffer.  Buffers can be at most TASKMGR_MESSAGE_LENGTH
 	bytes long.
+	\note If TASKMGR_MESSAGE_SIZE is defined larger than one radio packet holds, larger messages
+	are sent in fragments (ESP only).  The message is lost if any fragment is.  With reliable delivery on
+	(see setRadioReliable()), at most TASKMGR_RELIABLE_WINDOW fragments can be outstanding to a node.
 	\sa yieldForMessage()
 */
 bool TaskManager::sendMessage(tm_nodeId_t nodeId, tm_taskId_t taskId, void* buf, int len) {
@@ -702,15 +1087,16 @@ bool TaskManager::sendMessage(tm_nodeId_t nodeId, tm_taskId_t taskId, void* buf,
 		TaskManager::sendMessage(taskId, buf, len);
 		return true;
 	}
-	if(len>TASKMGR_MESSAGE_SIZE) {
+	if(len<0 || len>(int)TASKMGR_MESSAGE_SIZE) {
 		return false;	// reject too-long messages
 	}
+	if(1+len>radioFrameRoom(nodeId)) return radioSendFragments(nodeId, taskId, (byte*)buf, len, false);
 	radioBuf.m_cmd = tmrMessage;
 	radioBuf.m_fromNodeId = myNodeId();
 	radioBuf.m_fromTaskId = myId();
 	radioBuf.m_data[0] = taskId;	// who we are sending it to
 	memcpy(&radioBuf.m_data[1], buf, len);
-	bool ret = radioSender(nodeId);
+	bool ret = radioSender(nodeId, TASKMGR_RADIO_HEADER_SIZE+1+len);
 	return ret;
 }
 
@@ -733,7 +1119,7 @@ bool TaskManager::suspend(tm_nodeId_t nodeId, tm_taskId_t taskId) {
 	radioBuf.m_fromNodeId = myNodeId();
 	radioBuf.m_fromTaskId = myId();
 	radioBuf.m_data[0] = taskId;
-	return radioSender(nodeId);
+	return radioSender(nodeId, TASKMGR_RADIO_HEADER_SIZE+1);
 }
 
 /*!	\brief Resume the given task on the given node
@@ -753,7 +1139,7 @@ bool TaskManager::resume(tm_nodeId_t nodeId, tm_taskId_t taskId) {
 	radioBuf.m_fromNodeId = myNodeId();
 	radioBuf.m_fromTaskId = myId();
 	radioBuf.m_data[0] = taskId;
-	return radioSender(nodeId);
+	return radioSender(nodeId, TASKMGR_RADIO_HEADER_SIZE+1);
 }
 
 /*!	\brief Get source node/task ID of last message
@@ -773,6 +1159,92 @@ void TaskManager::getSource(tm_nodeId_t& fromNodeId, tm_taskId_t& fromTaskId) {
 }
 #endif // USING_RADIO && architecture
 
+//
+// Multi-core executors
+//
+
+#if TASKMGR_MAX_EXECUTORS>1
+TaskManager* TaskManager::s_executors[TASKMGR_MAX_EXECUTORS];
+TaskManager* TaskManager::s_running[TASKMGR_MAX_EXECUTORS];
+uint8_t TaskManager::s_executorCount = 0;
+uint8_t TaskManager::s_taskExecutor[TASKMGR_MAX_TASK+1];
+
+/*!	\brief Start this executor on its own core
+
+	Creates a FreeRTOS task pinned to the given core that runs this executor's loop() forever.
+	Tasks should be added to the executor (with its add*() routines) before or after it is started;
+	the executor a task is added to is the core it runs on.  TaskMgr itself is run by the Arduino
+	loop() and must not be started with beginCore().
+
+	\param core -- the core to run on.  On ESP-32 the Arduino loop() normally runs on core 1, so
+	a secondary executor normally uses core 0.
+	\param stackSize -- the stack size of the executor task, in bytes.
+	\param priority -- the FreeRTOS priority of the executor task.
+	\returns true if the executor task was created, false otherwise.
+*/
+bool TaskManager::beginCore(BaseType_t core, uint32_t stackSize/*=TASKMGR_EXECUTOR_STACK*/, UBaseType_t priority/*=1*/) {
+	if(m_executorId==0 || m_executorId>=TASKMGR_MAX_EXECUTORS) return false;
+	return xTaskCreatePinnedToCore(executorThread, "TaskMgr", stackSize, this, priority, NULL, core)==pdPASS;
+}
+
+/*!	\brief The FreeRTOS task body for a secondary executor.  Internal routine.
+	\param arg -- the TaskManager to run.
+*/
+void TaskManager::executorThread(void* arg) {
+	TaskManager* tm = (TaskManager*)arg;
+	unsigned long lastPause = ::millis();
+	for(;;) {
+		tm->loop();
+		if(::millis()-lastPause >= TASKMGR_EXECUTOR_PAUSE) {
+			vTaskDelay(1);
+			lastPause = ::millis();
+		}
+	}
+}
+
+/*!	\brief Send a message to a task on another executor, if the task is not on this one.  Internal routine.
+
+	Uses the task-to-executor map built by add*().  Tasks that were never added to any executor, or
+	were added to more than one, are treated as local.  So is everything sent by an executor past
+	TASKMGR_MAX_EXECUTORS, which has no queue to the others.
+	\returns true if the task is on another executor (the message has been queued or, if the queue
+	was full, dropped); false if the task is on this executor.
+*/
+bool TaskManager::postCrossMessage(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, tm_taskId_t taskId, const void* buf, int len) {
+	uint8_t target = s_taskExecutor[taskId];
+	if(target==0 || target==TASKMGR_TASK_ON_MANY || target-1==m_executorId || m_executorId>=TASKMGR_MAX_EXECUTORS) return false;
+	_TaskManagerCrossMessage* msg = s_executors[target-1]->m_inbox[m_executorId].reserve();
+	if(msg==NULL) return true;	// full; counted as a drop
+	msg->m_fromNodeId = fromNodeId;
+	msg->m_fromTaskId = fromTaskId;
+	msg->m_toTaskId = taskId;
+	msg->m_len = len;
+	if(len>0) memcpy(msg->m_data, buf, len);
+	s_executors[target-1]->m_inbox[m_executorId].commit();
+	return true;
+}
+
+/*!	\brief Deliver all messages other executors have queued for this one.  Internal routine.
+*/
+void TaskManager::drainInboxes() {
+	_TaskManagerCrossMessage* msg;
+	for(uint8_t from=0; from<=s_executorCount; from++) {
+		while((msg=m_inbox[from].peek())!=NULL) {
+			localSendMessage(msg->m_fromNodeId, msg->m_fromTaskId, msg->m_toTaskId, msg->m_data, msg->m_len);
+			m_inbox[from].release();
+		}
+	}
+}
+
+/*!	\brief Return the number of messages to this executor that were dropped because a queue was full.
+*/
+unsigned long TaskManager::crossDrops() const {
+	unsigned long ret = 0;
+	for(uint8_t from=0; from<TASKMGR_MAX_EXECUTORS; from++) ret += m_inbox[from].drops();
+	return ret;
+}
+#endif // multiple executors
+
 // Internals for network clock resyncing
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
 void TaskManager::resync(unsigned long int remoteMillis) {
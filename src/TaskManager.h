@@ -11,7 +11,7 @@
 // Note that each main-file include in the TaskManager family has one of these.
 // This ensures that the correct TaskMgr is used.
 //#if false
-TaskManager TaskMgr;
+TaskManager TaskMgr(true);
 void loop() {
     TaskMgr.loop();
 }
@@ -24,9 +24,7 @@ void TmClockSyncServerTask() {
 	TaskMgr.getSource(fromNode, fromTask);
 	memcpy(&myInfo, TaskMgr.getMessage(), sizeof(_TaskManagerClockSyncInfo));
 	myInfo.m_serverTime = ::millis();
-	TaskMgr.registerPeer(fromNode);
 	TaskMgr.sendMessage(fromNode, fromTask, &myInfo, sizeof(_TaskManagerClockSyncInfo));
-	TaskMgr.unRegisterPeer(fromNode);
 	//Serial.printf("Replying to node/task %d/%d, sending local time %ld seq %lu\n", fromNode, fromTask, myInfo.m_serverTime, myInfo.m_id);
 }
 
@@ -38,17 +36,21 @@ void TmClockSyncServerTask() {
 	to have it run every minute.
 	
 	Note this task may consume up to 50ms or so -- if the reply ID doesn't sync or if the server times out, the client will pause
-	and repeat.
+	and repeat.  If reliable radio delivery is on (see TaskManager::setRadioReliable()), lost packets are resent by the radio
+	layer instead, so there is a single try that waits long enough for the resends.  The time a reply is waited for follows
+	the measured round trip time to the server (see TaskManager::radioLinkTimeout()), and each reply is reported to
+	TaskManager::radioLinkRtt().
 */
 void TmClockSyncClientTask() {
 	static _TaskManagerClockSyncInfo myInfo, theReply;
 	static unsigned long int seq = 0;		// sequencer, to keep our request/replies straight if things get lost
+	static unsigned long sentAt;
 	static int i;
 	TM_BEGIN();
 	// Flush the incoming message queue
 
-	// Then five tries at a good transmit-receive
-	for(i=0; i<5; i++) {
+	// Then five tries at a good transmit-receive (one if the radio layer resends for us)
+	for(i=0; i<(TaskMgr.radioReliable() ? 1 : 5); i++) {
 		while(true) {
 			TM_YIELDMESSAGETIMEOUT(3, 5);
 			if(TaskMgr.timedOut()) break;
@@ -57,18 +59,18 @@ void TmClockSyncClientTask() {
 		}
 		seq++;
 		myInfo.m_id = seq;
-		TaskMgr.registerPeer(TASKMGR_CLOCK_SYNC_SERVER_NODE);
+		sentAt = ::millis();
 		TaskMgr.sendMessage(TASKMGR_CLOCK_SYNC_SERVER_NODE, TASKMGR_CLOCK_SYNC_SERVER_TASK, &myInfo, sizeof(_TaskManagerClockSyncInfo));
-		TaskMgr.unRegisterPeer(TASKMGR_CLOCK_SYNC_SERVER_NODE);
 		// new code: keep eating messages until a timeout (msg queue exhausted) or until we get a matching message
 		while(true) {
-			TM_YIELDMESSAGETIMEOUT(1, 20);
+			TM_YIELDMESSAGETIMEOUT(1, TaskMgr.radioLinkTimeout(TASKMGR_CLOCK_SYNC_SERVER_NODE, true));
 			if(TaskMgr.timedOut()) {
 				break;
 			} else {
 				memcpy(&theReply, TaskMgr.getMessage(), sizeof(_TaskManagerClockSyncInfo));
 				if(theReply.m_id==seq) {
 					// good response, process and exit the loop
+					TaskMgr.radioLinkRtt(TASKMGR_CLOCK_SYNC_SERVER_NODE, ::millis()-sentAt);
 					TaskMgr.resync(theReply.m_serverTime+3);
 					break;
 				} else {
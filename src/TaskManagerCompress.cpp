@@ -0,0 +1,86 @@
+//
+// TaskManagerCompress implementation
+
+#include <arduino.h>
+#include <TaskManagerCompress.h>
+
+/*!	\ingroup Compress
+	@{
+*/
+/*! \file TaskManagerCompress.cpp
+    Implementation file for TmCompress() and TmDecompress()
+*/
+
+// the i'th byte to code:  in[i], XORed with ref[i] if there is one
+static inline byte compressByte(const byte* in, const byte* ref, int refLen, int i) {
+	return (i<refLen) ? in[i]^ref[i] : in[i];
+}
+
+int TmCompress(const byte* in, int len, const byte* ref, int refLen, byte* out, int outMax) {
+	int at = 0;		// next byte of in to code
+	int n = 0;		// bytes of out used
+	int lit = -1;	// the token byte of the literal run being built, or -1
+	if(ref==NULL) refLen = 0;
+	while(at<len) {
+		byte b = compressByte(in, ref, refLen, at);
+		int run = 1;
+		while(at+run<len && run<66 && compressByte(in, ref, refLen, at+run)==b) run++;
+		if(b==0 && run>=2) {
+			if(run>65) run = 65;
+			if(n+1>outMax) return -1;
+			out[n++] = 0x80|(run-2);
+			lit = -1;
+		} else if(run>=3) {
+			if(n+2>outMax) return -1;
+			out[n++] = 0xc0|(run-3);
+			out[n++] = b;
+			lit = -1;
+		} else {
+			// add the byte to a literal run, starting one if need be
+			if(lit<0 || out[lit]==0x7f) {
+				if(n+1>outMax) return -1;
+				lit = n;
+				out[n++] = 0xff;	// becomes 0 when the byte is added
+			}
+			if(n+1>outMax) return -1;
+			out[lit]++;
+			out[n++] = b;
+			run = 1;
+		}
+		at += run;
+	}
+	return n;
+}
+
+int TmDecompress(const byte* in, int len, const byte* ref, int refLen, byte* out, int outMax) {
+	int at = 0;		// next byte of in
+	int n = 0;		// bytes of out produced
+	if(ref==NULL) refLen = 0;
+	while(at<len) {
+		byte c = in[at++];
+		int run;
+		if(c<0x80) {
+			run = c+1;
+			if(at+run>len || n+run>outMax) return -1;
+			memcpy(&out[n], &in[at], run);
+			at += run;
+		} else {
+			byte b = 0;
+			if(c<0xc0) {
+				run = (c&0x3f)+2;
+			} else {
+				if(at>=len) return -1;
+				run = (c&0x3f)+3;
+				b = in[at++];
+			}
+			if(n+run>outMax) return -1;
+			memset(&out[n], b, run);
+		}
+		for(int i=n; i<n+run && i<refLen; i++) out[i] ^= ref[i];
+		n += run;
+	}
+	return n;
+}
+
+/*! @}
+*/
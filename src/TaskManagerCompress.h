@@ -0,0 +1,46 @@
+// TaskManagerCompress standard header
+//
+
+//!	\file TaskManagerCompress.h
+
+#if !defined(__TASKMANAGERCOMPRESS_H__)
+#define __TASKMANAGERCOMPRESS_H__
+
+/*!	\defgroup Compress Message Compression
+	@{
+*/
+/*!	\brief Compress a buffer, optionally as a delta against an earlier one
+
+	This is the coder used for radio messages when TaskManager::setRadioCompression() is on.  It
+	is a byte-oriented run-length coder, small and fast enough to run on every frame.  If ref is
+	given, each byte is first XORed with the byte at the same place in ref, so the bytes of a
+	slowly changing struct that have not changed become runs of zeros.
+
+	The output is a series of tokens:  0x00-0x7f is followed by that many plus one literal bytes,
+	0x80-0xbf stands for that many minus 0x80 plus two zeros, and 0xc0-0xff is followed by one byte
+	repeated that many minus 0xc0 plus three times.
+	\param in -- the data
+	\param len -- the length of the data
+	\param ref -- the earlier data to code against, or NULL
+	\param refLen -- the length of ref.  Bytes of in past its end are coded as they are.
+	\param out -- the buffer for the coded data
+	\param outMax -- the size of out
+	\returns the length of the coded data, or -1 if it does not fit in outMax bytes
+*/
+int TmCompress(const byte* in, int len, const byte* ref, int refLen, byte* out, int outMax);
+
+/*!	\brief Undo TmCompress()
+	\param in -- the coded data
+	\param len -- the length of the coded data
+	\param ref -- the data passed to TmCompress() as ref, or NULL
+	\param refLen -- the length of ref
+	\param out -- the buffer for the data
+	\param outMax -- the size of out
+	\returns the length of the data, or -1 if the coded data is malformed or does not fit in outMax bytes
+*/
+int TmDecompress(const byte* in, int len, const byte* ref, int refLen, byte* out, int outMax);
+
+/*! @}
+*/
+
+#endif // __TASKMANAGERCOMPRESS_H__
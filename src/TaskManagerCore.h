@@ -27,6 +27,7 @@
 
 //#include <Streaming.h>
 #include "ring.h"
+#include "spscRing.h"
 
 #if defined(ARDUINO_ARCH_AVR)
 typedef uint8_t tm_nodeId_t;	//!<	Storage for Node ID (Atmel architecture)
@@ -59,6 +60,11 @@ typedef uint8_t tm_netId_t;		//!<	Storage for Net ID (ESP architecture)
 #else
 #endif
 
+/*!	\def TASKMGR_RADIO_DATA_SIZE
+	The number of data bytes in one radio packet:  the payload less the command, source node and source task.
+*/
+#define TASKMGR_RADIO_DATA_SIZE (TASKMGR_MAX_PAYLOAD-1-sizeof(tm_nodeId_t)-sizeof(tm_taskId_t))
+
 /*! \def TASKMGR_MESSAGE_SIZE
     The maximum size of a message passed between tasks
 
@@ -71,8 +77,57 @@ typedef uint8_t tm_netId_t;		//!<	Storage for Net ID (ESP architecture)
     ESP-NOW max payload is 250, overhead is 4 for cmd/src and 1 for target.  Message overhead is 4 bytes for 
 	cmd, src node, src task, and 1 byte for target task.  THIS MAY CHANGE IF WE ALLOW MORE THAN 256 TASKS
 	
+	By default a message fits in one radio packet.  It may be defined larger (for instance, as a compiler
+	flag); on ESP, messages to other nodes that do not fit in one packet are then sent in fragments and
+	reassembled by the receiving node.  Every task has a message buffer of this size.
 */
-#define TASKMGR_MESSAGE_SIZE (TASKMGR_MAX_PAYLOAD-1-sizeof(tm_nodeId_t)-2*sizeof(tm_taskId_t))
+#if !defined(TASKMGR_MESSAGE_SIZE)
+#define TASKMGR_MESSAGE_SIZE (TASKMGR_RADIO_DATA_SIZE-sizeof(tm_taskId_t))
+#endif
+
+/*!	\def TASKMGR_MAX_EXECUTORS
+	The number of TaskManager executors that can run at the same time, one per core.
+	
+	This is 2 on dual-core ESP-32 systems and 1 everywhere else.  When it is 1, none of the
+	multi-core code is compiled.
+*/
+#if defined(ARDUINO_ARCH_ESP32) && !defined(CONFIG_FREERTOS_UNICORE)
+#define TASKMGR_MAX_EXECUTORS 2
+#else
+#define TASKMGR_MAX_EXECUTORS 1
+#endif
+
+/*!	\def TASKMGR_CROSS_QUEUE_SIZE
+	The number of messages that can be in flight from one executor to another.  Must be
+	a power of two.  Messages sent to a full queue are dropped (and counted).
+*/
+#define TASKMGR_CROSS_QUEUE_SIZE 8
+
+/*!	\def TASKMGR_EXECUTOR_STACK
+	The default stack size (bytes) of the FreeRTOS task that runs a secondary executor.
+*/
+#define TASKMGR_EXECUTOR_STACK 8192
+
+/*!	\def TASKMGR_EXECUTOR_PAUSE
+	A secondary executor gives up its core for one tick every TASKMGR_EXECUTOR_PAUSE ms, so the
+	FreeRTOS idle task on that core can run (and the task watchdog is fed).
+*/
+#define TASKMGR_EXECUTOR_PAUSE 1000
+
+/*!	\def TASKMGR_OFFLOAD_MAX_WORKERS
+	The maximum number of offload worker threads (see TaskManager::beginOffload()).
+*/
+#define TASKMGR_OFFLOAD_MAX_WORKERS 4
+
+/*!	\def TASKMGR_OFFLOAD_QUEUE_SIZE
+	The number of jobs each offload worker can have waiting.  Must be a power of two.
+*/
+#define TASKMGR_OFFLOAD_QUEUE_SIZE 8
+
+/*!	\def TASKMGR_IDLE_FOREVER
+	Returned by TaskManager::idleTime() when no task will run until a message arrives.
+*/
+#define TASKMGR_IDLE_FOREVER 0xFFFFFFFFUL
 /*x @} */ // ingroup Globals
 
 // Process includes for networking code
@@ -119,6 +174,11 @@ unsigned long TmMillis();
 */
 #define TASKMGR_NULL_TASK TASKMGR_MAX_TASK
 
+/*! \def TASKMGR_SYSTEM_TASK_BASE
+	The lowest task ID reserved for system and common module tasks.  User task IDs are below it.
+*/
+#define TASKMGR_SYSTEM_TASK_BASE 224
+
 /*! \def TASKMGR_RF_MONITOR_TASK
 	The TaskID of the task that monitors the inter-node radio link
 */
@@ -148,6 +208,12 @@ unsigned long TmMillis();
 */
 #define TASKMGR_CLOCK_SYNC_CLIENT_TASK (TASKMGR_NULL_TASK-5)
 
+/*!	\def TASKMGR_RF_TX_TASK
+	The task that hands queued radio frames to the radio.
+	Available on ESP only.
+*/
+#define TASKMGR_RF_TX_TASK (TASKMGR_NULL_TASK-6)
+
 /*x @} */ // ingroup Globals
 
 /*x \ingroup TaskManagerTask
@@ -155,6 +221,68 @@ unsigned long TmMillis();
 */ 
 
 class TaskManager;	// forward declaration
+class _TaskManagerOffloadPool;	// forward declaration
+struct _TaskManagerOffloadJob;	// forward declaration
+
+/*!	\struct _TaskManagerCrossMessage
+	A message queued for later delivery:  passed between two executors (TaskManager instances
+	running on different cores), or waiting in a task's mailbox.  For internal use only.
+*/
+struct _TaskManagerCrossMessage {
+	tm_nodeId_t	m_fromNodeId;				//!< Source node of the message
+	tm_taskId_t	m_fromTaskId;				//!< Source task of the message
+	tm_taskId_t	m_toTaskId;					//!< Target task, which runs on the receiving executor
+	uint16_t	m_len;						//!< Length of the message
+	byte		m_data[TASKMGR_MESSAGE_SIZE];	//!< The message
+};
+
+/*!	\class _TaskManagerMailbox
+	\brief The queue of messages waiting for a task.  For internal use only.
+
+	A task normally holds a single message, and a new message overwrites one the task has not read.
+	A task given a mailbox (TaskManager::setMailbox()) queues them instead, and can read several in one
+	dispatch with TaskManager::nextMessage().  Mailboxes are only touched by the task's own executor,
+	so no locking is needed.
+*/
+class _TaskManagerMailbox {
+private:
+	_TaskManagerCrossMessage* m_entries;
+	uint8_t m_depth;
+	uint8_t m_head;		// oldest entry
+	uint8_t m_count;
+	unsigned int m_drops;	// messages rejected because the mailbox was full
+public:
+	_TaskManagerMailbox(uint8_t depth): m_depth(depth), m_head(0), m_count(0), m_drops(0) {
+		m_entries = new _TaskManagerCrossMessage[depth];
+	}
+	~_TaskManagerMailbox() { delete [] m_entries; }
+	bool put(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, const void* buf, int len);
+	//! \brief Return the oldest message, or NULL if the mailbox is empty
+	_TaskManagerCrossMessage* front() { return m_count==0 ? NULL : &m_entries[m_head]; }
+	//! \brief Remove the oldest message
+	void pop() { if(m_count>0) { m_head = (m_head+1)%m_depth; m_count--; } }
+	//! \brief Return the number of messages waiting
+	uint8_t size() const { return m_count; }
+	//! \brief Return the number of messages dropped because the mailbox was full
+	unsigned int drops() const { return m_drops; }
+};
+
+/*!	\brief Queue a message.
+	\return true if the message was queued, false if the mailbox was full (the message is counted as dropped).
+*/
+inline bool _TaskManagerMailbox::put(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, const void* buf, int len) {
+	if(m_count>=m_depth) {
+		m_drops++;
+		return false;
+	}
+	_TaskManagerCrossMessage* msg = &m_entries[(m_head+m_count)%m_depth];
+	msg->m_fromNodeId = fromNodeId;
+	msg->m_fromTaskId = fromTaskId;
+	msg->m_len = len;
+	memcpy(msg->m_data, buf, len);
+	m_count++;
+	return true;
+}
 
 /*! \class _TaskManagerTask
     \brief Internal class to manage a single active task
@@ -186,6 +314,12 @@ protected:
         TimedOut = 0x40,                //!< Marker that the task had a timeout with a message, and the timeout happened.
         Suspended=0x80                  //!< Task is suspended and will not receive messages or timeouts.
         };
+    /*! \enum DispatchFlags
+        Flag-bits describing how the task is invoked by TaskManager::loop().  Set when the task is added.
+    */
+    enum DispatchFlags {
+        ReturnYield=0x01                //!< Task yields only through the TM_* macros, so it is invoked without setjmp().
+        };
 	/*x @} */ // end public
 public:
 	//!	\name Member Variables
@@ -193,6 +327,8 @@ public:
 	tm_taskId_t	m_fromTaskId;		//!< Source task for a message
 protected:
     uint8_t m_stateFlags; //!< The task's state information
+    uint8_t m_dispatchFlags; //!< How the task is dispatched (DispatchFlags)
+    uint8_t m_yieldType;	//!< The yield requested during the current invocation (TaskManager::YieldTypes)
 
     // Active delay information.  If a task is waiting, here is the reason (or in the
     // case of messaging, the response)
@@ -211,6 +347,11 @@ protected:
 
     tm_taskId_t    m_id; //!< This task's task ID
     void    (*m_fn)(); //!< The procedure to be invoked each cycle
+    void    (*m_ctxFn)(void*); //!< The procedure to be invoked each cycle, if the task carries a context
+    void*   m_context;	//!< The context passed to m_ctxFn.  Retrieved by the task with TaskManager::myContext()
+    unsigned long m_budgetUs;	//!< Time budget for each dispatch, in microseconds.  0 means no budget.
+    uint16_t m_overruns;	//!< The number of dispatches that ran past the budget (saturates)
+    _TaskManagerMailbox* m_mailbox;	//!< Messages waiting for this task, or NULL if it has no mailbox
 
 public:
 	/*x	\defgroup constructors	Constructors and Destructor
@@ -220,6 +361,7 @@ public:
     //!	\name Constructors and destructors
     _TaskManagerTask();
     _TaskManagerTask(tm_taskId_t, void (*)());
+    _TaskManagerTask(tm_taskId_t, void (*)(void*), void*);
     ~_TaskManagerTask();
 	
 	/*x @} */ // end constructors
@@ -245,8 +387,11 @@ protected:
     void setWaitMessage(unsigned long msTimeout=0);
     void setAutoMessage(unsigned long msTimeout=0);
 
+    void invoke();
+
     //!	\name Messaging
     void putMessage(void* buf, int len);
+    bool pullMessage();
 
 public:
     // Things that make the ring of _TaskManagerTask work
@@ -302,7 +447,7 @@ public:
 	*/
 	// Constructor and destructor
 	//!	\name Constructors and Destructors
-    TaskManager();
+    TaskManager(bool primary=false);
     ~TaskManager();
 	/*x @} */ // end Setup
 
@@ -319,7 +464,8 @@ private:
 	/*!	\enum YieldTypes
 		Different methods a task may use when yielding
 	*/		
-    enum YieldTypes { YtYield,
+    enum YieldTypes { YtNone,
+        YtYield,
         YtYieldUntil,
         YtYieldMessage,
         YtYieldMessageTimeout,
@@ -328,8 +474,18 @@ private:
         };
 	//!	\ignore
     jmp_buf  taskJmpBuf;    // Jump buffer used by yield.  For internal use only.
+    bool	m_jmpArmed;		// true while taskJmpBuf is valid for the running task.  For internal use only.
 	//!	\endignore
 
+private:
+    bool	m_returnDispatch;	// true while a task added with addReturnYield() is running
+    unsigned int m_strayYields;	// bare yield*() calls made by such tasks
+    uint16_t m_callSeq;		// the number of the last TM_CALL_NODE*() made on this executor
+    void	sendCallFrame(tm_nodeId_t nodeId, tm_taskId_t taskId, uint16_t callSeq, void* buf, int len);
+    bool	m_budgetActive;			// true while the running task has a time budget
+    unsigned long m_dispatchDeadline;	// micros() value at which the running task's budget is used up
+    void	(*m_overrunHook)(tm_taskId_t taskId, unsigned long elapsedUs);	// called after an overrun, or NULL
+
 public:
 	/*x	\ingroup Add
 		@{
@@ -345,6 +501,28 @@ public:
     void addAutoWaitDelay(tm_taskId_t taskId, void(*fn)(), unsigned long period, bool startDelayed=false);
     void addWaitMessage(tm_taskId_t taskId, void(*fn)(), unsigned long timeout=0);
 	void addAutoWaitMessage(tm_taskId_t taskId, void(*fn)(), unsigned long timeout=0, bool startWaiting=true);
+
+	/*	\name Add a Task with a Context
+
+		These methods add tasks whose procedure takes a context pointer.  One procedure can serve
+		many tasks, each with its own context (state block).
+	*/
+    void add(tm_taskId_t taskId, void (*fn)(void*), void* context);
+    void addWaitDelay(tm_taskId_t taskId, void(*fn)(void*), void* context, unsigned long msDelay);
+    void addWaitUntil(tm_taskId_t taskId, void(*fn)(void*), void* context, unsigned long msWhen);
+    void addAutoWaitDelay(tm_taskId_t taskId, void(*fn)(void*), void* context, unsigned long period, bool startDelayed=false);
+    void addWaitMessage(tm_taskId_t taskId, void(*fn)(void*), void* context, unsigned long timeout=0);
+	void addAutoWaitMessage(tm_taskId_t taskId, void(*fn)(void*), void* context, unsigned long timeout=0, bool startWaiting=true);
+
+	/*	\name Add a Return-path Task
+
+		These methods add tasks that yield only through the TM_* (or TMR_*) macros.  Such a task is
+		invoked without a setjmp(), which makes each dispatch cheaper.  A bare yield*() call from it
+		cannot unwind back to the task manager; see strayYields().
+	*/
+    void addReturnYield(tm_taskId_t taskId, void (*fn)());
+    void addReturnYield(tm_taskId_t taskId, void (*fn)(void*), void* context);
+    unsigned int strayYields() const;
 	/*x @} */ // ingroup Add
 	
 	/*x \defgroup ingroup Yield
@@ -363,6 +541,29 @@ public:
     void yieldDelay(unsigned long ms);
     void yieldUntil(unsigned long when);
     void yieldForMessage(unsigned long timeout=0);
+
+    /*!	\name Return-path Yield
+
+    	These methods record a yield in the current task's control block and return normally.
+    	The caller must then return from the task itself.  They are used by the TM_* macros
+    	so macro-based tasks yield without a longjmp().
+    	@note For internal use by TaskManagerMacros.h.
+    */
+    void markYield();
+    void markYieldDelay(unsigned long ms);
+    void markYieldUntil(unsigned long when);
+    void markYieldForMessage(unsigned long timeout=0);
+
+    /*!	\name Subtask Call and Return
+
+    	These methods carry a TM_CALL*() and its TM_RETURNSUB*() between nodes.  They also
+    	work where there is no radio, in which case every caller is on this node.
+    	@note For internal use by TaskManagerMacros.h.
+    */
+    void getCaller(tm_nodeId_t& nodeId, tm_taskId_t& taskId, uint16_t& callSeq, int paramLen);
+    void returnToCaller(tm_nodeId_t nodeId, tm_taskId_t taskId, uint16_t callSeq, void* buf, int len);
+    uint16_t sendCallMessage(tm_nodeId_t nodeId, tm_taskId_t taskId, void* buf, int len);
+    bool markAwaitReply(tm_nodeId_t nodeId, tm_taskId_t taskId, uint16_t callSeq, unsigned long start, unsigned long timeout);
     /*x @} */ // ingroup Yield
 
 	/*x \ingroup Message
@@ -409,6 +610,18 @@ public:
 	bool resume(tm_nodeId_t nodeId, tm_taskId_t taskId);			// node, task
 #endif // using radio && (atmel || esp)
 
+	/*!	\name Time Budgets
+
+		A task can be given a time budget for each dispatch, normally right after it is added.
+		TM_CHECKPOINT() yields only once the budget has been used up, so long loops can be sprinkled
+		with checkpoints without tuning how often they yield.  A dispatch that runs past its budget
+		is an overrun:  it is counted, and reported to the overrun hook.
+	*/
+	bool setBudget(tm_taskId_t taskId, unsigned long budgetUs);
+	void setOverrunHook(void (*hook)(tm_taskId_t taskId, unsigned long elapsedUs));
+	unsigned int getOverruns(tm_taskId_t taskId);
+	bool overBudget();
+
 	/*x @} */	// ingroup Control
 
 	/* **** Mesh/Radio Internal Routines */
@@ -419,7 +632,7 @@ private:
 		@{
 	*/
 
-	bool radioSender(tm_nodeId_t);	// generic packet sender
+	bool radioSender(tm_nodeId_t, int len=sizeof(_TaskManagerRadioPacket));	// generic packet sender
 
     // status requests/
     //void yieldPingNode(byte);					// node -> status (responding/not responding)
@@ -438,33 +651,359 @@ private:
 	*/
 	enum RadioCmd {
 		tmrNoop,			//!<	Do nothing
-		tmrStatus,			//!<	Request status of this node.
-		tmrAck,				//!<	Node status returned from a tmrStatus request
-		tmrTaskStatus,		//!<	Request status of a task on this node
-		tmrTaskAck,			//!<	Task status returned from a tmrTaskStatus request
+		tmrStatus,			//!<	Request status of this node (ESP only)
+		tmrAck,				//!<	Node status returned from a tmrStatus request (ESP only)
+		tmrTaskStatus,		//!<	Request status of a task on this node (ESP only)
+		tmrTaskAck,			//!<	Task status returned from a tmrTaskStatus request (ESP only)
 		tmrMessage,			//!<	Send a message
 		tmrSuspend,			//!<	Suspend a task
-		tmrResume			//!<	Resume a task
+		tmrResume,			//!<	Resume a task
+		tmrMulti,			//!<	Several messages to tasks on one node, packed into one frame
+		tmrReliable,		//!<	A packet sent with a sequence number, to be acked (ESP only)
+		tmrReliableAck,		//!<	Acks for tmrReliable packets, when there is no packet to carry them (ESP only)
+		tmrFragment,		//!<	Part of a message too large for one packet (ESP only)
+		tmrRouted,			//!<	A packet for a node reached through this one (ESP only)
+		tmrRoute,			//!<	Routes known to the sending node (ESP only)
+		tmrGroup,			//!<	A message to a task on every node in a group (ESP only)
+		tmrCompressed		//!<	A message, compressed (ESP only)
 	};
 	_TaskManagerRadioPacket	radioBuf;
 	bool	m_radioReceiverRunning;
-#if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
-public:
-/*!	\ignore */
-	SemaphoreHandle_t m_TaskManagerMessageQueueSemaphore;
-/*! \endignore */
-#endif // esp
 public:
 	void tmRadioReceiverTask();
 
 #if defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32)
 private:
+	friend class _TaskManagerEspNowTransport;
+	friend class MessageQueue;
 	esp_err_t m_lastESPError;
+	TaskManagerTransport* m_transport;	// set by radioBegin()
+	_TaskManagerRadioPacket* m_rxPacket;	// the frame the radio receiver task is processing, in the receive queue
+	unsigned int m_radioAggWindow;	// ms a message may wait to share a frame; 0 means no aggregation
+	bool m_radioReliable;			// send packets as tmrReliable packets
+	unsigned int m_radioRouteInterval;	// ms between route advertisements; 0 means routes are not learned
+	unsigned long m_radioRouteAdvertised;	// millis() of the last advertisement
+	bool m_radioCompress;			// send messages as tmrCompressed packets where that is shorter
+	unsigned int m_radioNodeRate;	// frames/s to each node; 0 means no limit
+	unsigned int m_radioTaskRate;	// frames/s from each task; 0 means no limit
+	byte m_radioRateBurst;			// frames that may be sent at once
+	bool m_radioRateShed;			// discard frames over the limit rather than holding them
+	unsigned int m_radioBackoffMax;	// most ms sending to a failing node is held off; 0 means no backoff
+	byte m_radioRxBudget;			// frames the radio receiver task processes per pass; 0 means no limit
+	byte m_radioRxScale;			// the receive budget is scaled up by 2^m_radioRxScale while frames are backed up
+	void radioDispatch(int len);
+	bool radioSendFrame(tm_nodeId_t nodeId, const byte* frame, int len);
+	bool radioSendHop(tm_nodeId_t nodeId, const byte* frame, int len);
+	int radioFrameRoom(tm_nodeId_t nodeId);
+	void radioRouteReceive(int len);
+	bool radioRouteCannotHold(int len);
+	void radioRouteAdvert(int len);
+	void radioRouteService();
+	bool radioSendGroup(byte groupId, tm_taskId_t taskId, const byte* buf, int len, bool isString);
+	int radioStatus(byte cmd, tm_taskId_t taskId, byte* buf, int room);
+	void radioTaskStatus(_TaskManagerTask* tsk, TaskManagerTaskStatus* st);
+	void radioStatusReply(int len);
+	bool radioStatusRequest(byte cmd, tm_nodeId_t nodeId, tm_taskId_t taskId);
+	void radioStatusLocal();
+	bool radioTransmit(tm_nodeId_t nodeId, const byte* frame, int len);
+	bool radioRateAllow(tm_nodeId_t nodeId, tm_taskId_t taskId);
+	unsigned long radioRateWait(tm_nodeId_t nodeId, tm_taskId_t taskId);
+	void radioRateResult(tm_nodeId_t nodeId, bool ok);
+	void radioLinkResult(tm_nodeId_t nodeId, bool ok);
+	unsigned long radioIdleTime();
+	bool radioPeer(tm_nodeId_t nodeId);
+	void radioTxDone(bool ok);
+	void (*m_radioSendHook)(tm_taskId_t taskId, tm_nodeId_t nodeId, bool ok);
+	bool radioReliableSend(tm_nodeId_t nodeId, const byte* frame, int len);
+	bool radioReliableReceive(int len);
+	void radioReliableService();
+	bool radioSendFragments(tm_nodeId_t nodeId, tm_taskId_t taskId, const byte* buf, int len, bool isString);
+	void radioFragmentService();
+	void radioReassemble(int len);
+	int radioCompress(tm_nodeId_t nodeId, int len);
+	void radioDecompress(int len);
+	bool radioAggregate(tm_nodeId_t nodeId, int len);
+	void radioFlush(tm_nodeId_t nodeId, bool expiredOnly);
 public:
+	void tmRadioTxTask();
 	/*! \brief Return a textual description of the last ESP error message.
 		\returns A const char* with text describing the last error.
 	*/
 	const char* lastESPError();
+	/*! \brief Return the number of received radio messages discarded because the receive queue was full.
+
+		This counts frames discarded from both lanes of the queue (see radioControlDrops()).
+	*/
+	unsigned long radioReceiveDrops();
+	/*!	\brief Return the number of received control frames discarded because their lane was full
+
+		Received frames wait in one of two lanes.  Control frames (suspend and resume, status requests
+		and replies, acks, routes, and messages to or from system tasks such as clock sync) have their
+		own lane of TASKMGR_CONTROL_QUEUE_SIZE frames, and the radio receiver task processes them
+		before any message waiting in the other lane, so a flood of messages neither crowds them out
+		nor delays them.
+	*/
+	unsigned long radioControlDrops();
+	/*!	\brief Limit the frames the radio receiver task processes each time it runs
+
+		Normally the radio receiver task processes every frame waiting each time it runs, so a burst
+		of frames holds up every other task until it is done.  With a budget it processes at most
+		frames frames, then lets other tasks run.  A time budget can be set too, with
+		setBudget(TASKMGR_RF_MONITOR_TASK, us); the task checks it between frames, and always
+		processes at least one.
+
+		The budget adapts to the queue:  each pass that ends with frames still waiting doubles both
+		budgets for the next pass, up to the size of the queue, and each pass that empties it halves
+		them again, down to what was set.  A backlog drains in a few passes, while in steady traffic
+		other tasks wait for no more than the budget.  See radioReceiveStats() to tune it.
+		\param frames -- frames per pass.  0 (the default) means no limit.
+	*/
+	void setRadioReceiveBudget(byte frames);
+	/*!	\brief Get statistics on the radio receiver task
+		\param[out] stats -- the statistics
+		\param reset -- if true, the counts and maxima start again from 0
+	*/
+	void radioReceiveStats(TaskManagerReceiveStats& stats, bool reset=false);
+	/*!	\brief Pack small outgoing messages to the same node into shared frames
+
+		When enabled, a message sent to another node is held for up to windowMs ms so that later
+		messages to the same node can share its frame.  The frame is sent when the window ends, when
+		it is full, or before any other kind of packet goes to that node.  Messages to or from system
+		tasks are never held.  Several messages can then arrive at a task at once, so receiving tasks
+		should have a mailbox (see setMailbox()).
+		\param windowMs -- how long a message may wait, in ms.  0 (the default) turns aggregation off.
+	*/
+	void setRadioAggregation(unsigned int windowMs);
+	/*!	\brief Turn reliable delivery of radio packets on or off
+
+		When on, each packet sent to another node carries a sequence number.  The receiving node acks
+		it, and it is sent again if no ack arrives in time, up to TASKMGR_RELIABLE_TRIES times in
+		all.  The time is radioLinkTimeout() once round trips to the node have been measured, and
+		TASKMGR_RELIABLE_TIMEOUT ms before that; it doubles for each resend, so a lossy link is not
+		flooded with them.  Duplicates are discarded by the receiver, so a packet
+		is processed at most once, but packets may be processed out of order after a resend.
+		Acks ride on packets going the other way where possible.  Every node processes tmrReliable
+		packets and acks them whether or not it sends reliably itself.
+
+		Each packet grows by TASKMGR_RELIABLE_HEADER_SIZE bytes; a packet too large for that is sent
+		as before.  Sending fails (returns false) if TASKMGR_RELIABLE_WINDOW packets to the node are
+		still waiting for acks.  A message sent in fragments is the exception:  its fragments are sent
+		as acks make room, and sending fails only if TASKMGR_FRAGMENT_SEND_SLOTS such messages are
+		already waiting.
+		\param reliable -- true to turn reliable delivery on.  It is off by default.
+	*/
+	void setRadioReliable(bool reliable);
+	/*! \brief Return true if reliable delivery is on (see setRadioReliable()).
+	*/
+	bool radioReliable() { return m_radioReliable; }
+	/*! \brief Return the number of reliable packets sent again because no ack arrived in time.
+	*/
+	unsigned long radioRetransmits();
+	/*! \brief Return the number of reliable packets given up on after TASKMGR_RELIABLE_TRIES tries.
+	*/
+	unsigned long radioLostFrames();
+	/*! \brief Return the number of fragmented messages discarded before they were complete.
+
+		A message is discarded if all its fragments have not arrived within TASKMGR_REASSEMBLY_TIMEOUT ms,
+		or if TASKMGR_REASSEMBLY_SLOTS newer messages need the reassembly buffers first.  On the sending
+		node, a message whose fragments could not all be sent reliably within TASKMGR_REASSEMBLY_TIMEOUT ms
+		is counted too.
+	*/
+	unsigned long radioReassemblyDrops();
+	/*! \brief Return the number of packets sent to nodes that were already registered as ESP-NOW peers.
+	*/
+	unsigned long radioPeerHits();
+	/*! \brief Return the number of packets sent to nodes that had to be registered first (see registerPeer()).
+	*/
+	unsigned long radioPeerMisses();
+	/*!	\brief Set a routine to be told the result of each radio frame sent
+
+		Radio frames are queued and handed to ESP-NOW by the radio transmit task (TASKMGR_RF_TX_TASK),
+		so sending never waits for the radio.  When ESP-NOW reports on a frame, hook is called with the
+		task that sent it, the node it was sent to, and whether ESP-NOW reports it delivered.  A
+		message sent with aggregation or fragmentation may share a frame or need several; resends and
+		acks are reported as sent by TASKMGR_RF_MONITOR_TASK.  The hook runs in the transmit task; it
+		may send messages but should be short.
+		\param hook -- the routine, or NULL for none.
+	*/
+	void setRadioSendHook(void (*hook)(tm_taskId_t taskId, tm_nodeId_t nodeId, bool ok));
+	/*! \brief Return the number of radio frames discarded because the transmit queue was full.
+	*/
+	unsigned long radioSendDrops();
+	/*! \brief Return the number of radio frames ESP-NOW did not deliver.
+	*/
+	unsigned long radioSendFailures();
+	/*!	\brief Limit the rate frames are sent
+
+		Each destination node and each sending task has a token bucket holding up to burst frames,
+		refilled at its rate.  A frame over either limit is discarded, and the send returns false,
+		if shed is true; otherwise it waits in the transmit queue until it may go.  Frames wait in
+		order, so frames behind it wait too, and if the queue fills more are discarded (see
+		radioSendDrops()).  Frames from system tasks (acks, resends, routing, status replies) are
+		never held or discarded, and have a queue of their own, so they do not wait behind a held
+		frame; but they use up the node's tokens.
+		\param nodeRate -- frames/s to each node.  0 (the default) means no limit.
+		\param taskRate -- frames/s from each task.  0 (the default) means no limit.
+		\param burst -- frames a node or task may send at once
+		\param shed -- true to discard frames over the limit, false to hold them
+	*/
+	void setRadioRateLimit(unsigned int nodeRate, unsigned int taskRate, byte burst=TASKMGR_RATE_BURST, bool shed=true);
+	/*!	\brief Hold off sending to a node whose sends fail
+
+		When on, each failed send to a node holds off sending to it for TASKMGR_RADIO_BACKOFF ms,
+		doubling with each failure in a row up to maxMs.  A successful send ends it.  Frames held off
+		are discarded or held as set by setRadioRateLimit().
+		\param maxMs -- the longest hold off, in ms.  0 (the default) turns backoff off.
+	*/
+	void setRadioBackoff(unsigned int maxMs);
+	/*! \brief Return the number of radio frames discarded by setRadioRateLimit() or setRadioBackoff().
+	*/
+	unsigned long radioRateDrops();
+	/*! \brief Return the number of failed sends that held off sending to a node (see setRadioBackoff()).
+	*/
+	unsigned long radioBackoffs();
+	/*!	\brief Get the statistics of the link to a node
+
+		The history of sends to each of the last TASKMGR_LINK_SLOTS nodes sent to is kept:  how many
+		frames the transport delivered, how many reliable frames were sent again or lost, and the
+		smoothed round trip time, measured from acks (see setRadioReliable()) and from replies
+		reported with radioLinkRtt().
+		\param nodeId -- the node
+		\param[out] stats -- the statistics
+		\returns true if the node has statistics, false if none are kept for it
+	*/
+	bool radioLinkStats(tm_nodeId_t nodeId, TaskManagerLinkStats& stats);
+	/*!	\brief Report a measured round trip time to a node
+
+		Tasks that send requests and wait for replies can report the time from request to reply,
+		so it is used with the times measured from acks.
+		\param nodeId -- the node that replied
+		\param ms -- the time from sending the request to receiving the reply, in ms
+	*/
+	void radioLinkRtt(tm_nodeId_t nodeId, unsigned long ms);
+	/*!	\brief Return how long to wait for a reply from a node
+
+		The time is the smoothed round trip time to the node plus four times its variation, between
+		TASKMGR_LINK_MIN_TIMEOUT and TASKMGR_LINK_MAX_TIMEOUT, or TASKMGR_LINK_TIMEOUT if no round
+		trip to the node has been measured.
+		\param nodeId -- the node
+		\param resends -- if true and reliable delivery is on, the time also covers the resends of
+		the request and the reply
+		\returns the time, in ms
+	*/
+	unsigned long radioLinkTimeout(tm_nodeId_t nodeId, bool resends=false);
+	/*!	\brief Learn routes to nodes out of radio range
+
+		Packets to a node with a route through another node are sent to that node, which passes them
+		on.  Each hop adds at most a pass of its radio receiver task; no other task is involved.  A
+		packet goes through at most TASKMGR_ROUTE_TTL nodes.
+
+		When on, nodes heard directly become neighbours, and every advertiseMs ms each node broadcasts
+		the routes it knows, so routes spread through the mesh.  A learned route is
+		forgotten after three intervals without news of it.  Nodes can also be introduced with
+		addRoute().  At most TASKMGR_ROUTE_SLOTS routes are kept; shorter routes are preferred, and
+		a route through a neighbour that recent sends to have often failed counts as one or two hops longer.
+		Every node forwards packets whether or not it learns routes itself.
+		\param advertiseMs -- ms between route advertisements.  0 (the default) turns learning off;
+		routes from addRoute() are still used.
+	*/
+	void setRadioRouting(unsigned int advertiseMs);
+	/*!	\brief Add a fixed route to a node
+
+		The route is never replaced by a learned one.
+		\param nodeId -- the node
+		\param nextHop -- the neighbour packets to nodeId are sent to.  nodeId itself makes it a neighbour.
+		\returns false if the route table is full of fixed routes
+	*/
+	bool addRoute(tm_nodeId_t nodeId, tm_nodeId_t nextHop);
+	/*!	\brief Forget the route to a node, fixed or learned
+		\param nodeId -- the node
+	*/
+	void removeRoute(tm_nodeId_t nodeId);
+	/*!	\brief Get the route to a node
+		\param nodeId -- the node
+		\param[out] nextHop -- the neighbour packets to nodeId are sent to
+		\param[out] hops -- hops to nodeId; 1 for a neighbour
+		\returns false if there is no route; packets are then sent to nodeId directly
+	*/
+	bool getRoute(tm_nodeId_t nodeId, tm_nodeId_t& nextHop, byte& hops);
+	/*!	\brief Ask a node for its status
+
+		The node's radio receiver task replies without involving any other task.  The reply arrives
+		as a message to the calling task from task TASKMGR_RF_MONITOR_TASK on that node:  a
+		TaskManagerNodeStatus followed by a TaskManagerTaskStatus for each task on the node's main
+		executor, as many as fit in one packet.  Like any message, the request or reply may be lost.
+		\param nodeId -- the node.  This node (or 0) replies on the radio receiver task's next pass.
+		\returns true if the request was queued.  Only one request to this node can wait at a time.
+	*/
+	bool requestStatus(tm_nodeId_t nodeId);
+	/*!	\brief Ask a node for the status of one of its tasks
+
+		As requestStatus(), but the reply is a single TaskManagerTaskStatus, or an empty message if
+		the node has no such task.
+		\param nodeId -- the node.  This node (or 0) replies on the radio receiver task's next pass.
+		\param taskId -- the task
+		\returns true if the request was queued
+	*/
+	bool requestTaskStatus(tm_nodeId_t nodeId, tm_taskId_t taskId);
+	/*!	\brief Send a string message to a task on every node in a group
+
+		The message goes out as one broadcast packet, and only nodes in the group pass it to the task.
+		It reaches the nodes in radio range; it is not routed, fragmented, or sent reliably.  If this
+		node is in the group, the task here gets it too.
+		\param groupId -- the group, or TASKMGR_GROUP_ALL for every node
+		\param taskId -- the task on each node
+		\param message -- the character string message.  A longer string than TASKMGR_GROUP_MESSAGE_SIZE
+		(counting the '\\0') is truncated, here and on the other nodes.
+		\returns true if the packet was queued
+	*/
+	bool broadcastMessage(byte groupId, tm_taskId_t taskId, char* message);
+	/*!	\brief Send a binary message to a task on every node in a group
+
+		As above.
+		\param groupId -- the group, or TASKMGR_GROUP_ALL for every node
+		\param taskId -- the task on each node
+		\param buf -- the message
+		\param len -- the length of the message.  At most TASKMGR_GROUP_MESSAGE_SIZE.
+		\returns true if the packet was queued; false, and it is not delivered here either, if it is too long
+	*/
+	bool broadcastMessage(byte groupId, tm_taskId_t taskId, void* buf, int len);
+	/*!	\brief Put this node in a group (see broadcastMessage())
+		\param groupId -- the group, 1-255
+	*/
+	void joinGroup(byte groupId);
+	/*!	\brief Take this node out of a group
+		\param groupId -- the group, 1-255
+	*/
+	void leaveGroup(byte groupId);
+	/*!	\brief Return true if this node is in a group
+		\param groupId -- the group
+	*/
+	bool inGroup(byte groupId);
+	/*! \brief Return the number of routed packets discarded after TASKMGR_ROUTE_TTL hops, or
+		because more than TASKMGR_ROUTE_HOLD were waiting to be passed on.
+	*/
+	unsigned long radioRouteDrops();
+	/*!	\brief Turn compression of radio messages on or off
+
+		When on, each message sent to another node in one packet is coded with TmCompress().  Every
+		TASKMGR_COMPRESS_KEYFRAME'th message from a task to a task on a node is coded on its own; the
+		others are coded as a delta against it, so a struct whose fields change slowly costs only a
+		few bytes.  A delta is sent only if it makes the packet shorter.  A keyframe may cost a few
+		bytes, so a stream whose deltas do not pay is sent uncompressed for a while.  Compressed packets
+		are never aggregated (see setRadioAggregation()).  A delta whose earlier message was lost is
+		discarded (see radioCompressDrops()), so delivery is better with setRadioReliable().
+		Every node decompresses packets whether or not it compresses them itself.
+		\param compress -- true to turn compression on.  It is off by default.
+	*/
+	void setRadioCompression(bool compress);
+	/*! \brief Return the number of bytes compression has kept off the air.
+	*/
+	unsigned long radioCompressSaved();
+	/*! \brief Return the number of compressed messages discarded because the message they were
+		coded against had not arrived.
+	*/
+	unsigned long radioCompressDrops();
 #endif // esp: ESP error info 
 #endif // using radio && (atmel || esp) :: mesh/radio internal routines
 
@@ -522,8 +1061,22 @@ public:
 	*/
 	bool radioBegin(tm_nodeId_t nodeId, const char* ssid=NULL, const char* pw=NULL);
 
+	/*! \brief Start networking over another transport
+
+		Networking works as with ESP-NOW, but frames are carried by the given transport (see
+		TaskManagerTransport), for instance a TaskManagerUdpTransport.  The transport must last as
+		long as the program.
+		\param nodeId -- this node's ID
+		\param transport -- the transport
+		\note This routine is only available on ESP environments.
+	*/
+	bool radioBegin(tm_nodeId_t nodeId, TaskManagerTransport& transport);
+
 	/*! \brief Add a peer for ESP-Now communications
 
+		Nodes are registered as peers automatically when they are first sent to, and stay registered
+		until TASKMGR_PEER_CACHE_SIZE other nodes have been sent to more recently.  Calling this is
+		only needed to register a node ahead of time.
 		\param nodeId -- A peer node for future communications.
 		\note This routine is only available on ESP environments.
 	*/
@@ -560,6 +1113,7 @@ public:
 	/*! \brief Return the time since the start of the run, in milliseconds
 	*/
     unsigned long runtime() const;
+	unsigned long idleTime();
 	/*x	@) */ // ingroup Misc
 	
 #if DEBUG
@@ -589,12 +1143,37 @@ public:
 		size will be one greater than the string length to account for the trailing null.
 	*/
 	uint16_t getMessageLength();
+
+	/*!	\brief Make the next message in the current task's mailbox the current message
+
+		Lets a task with a mailbox (see setMailbox()) handle a burst of messages in one dispatch
+		instead of one per trip around the task ring.  For example,
+		"int n=0; do { handle(TaskMgr.getMessage()); } while(++n<8 && TaskMgr.nextMessage());"
+		handles up to 8 messages and then returns.  Messages left in the mailbox keep the task runnable.
+		\return true if there was another message; getMessage() and getSource() now return it.
+		false if the mailbox is empty or the task has no mailbox.
+	*/
+	bool nextMessage();
+
+	/*!	\brief Return the number of messages waiting in the current task's mailbox
+		\return The number of messages after the current one.  0 if the task has no mailbox.
+	*/
+	uint8_t pendingMessages();
+
+	bool setMailbox(tm_taskId_t taskId, uint8_t depth);
+	unsigned int getMailboxDrops(tm_taskId_t taskId);
 	
 	/*! \brief Return the task ID of the currently running task
 		\return The byte value that represents the current task's ID.
 	*/
     tm_taskId_t myId();
 
+	/*!	\brief Return the context of the currently running task
+		\return The context pointer given when the task was added with one of the add*(taskId, fn, context, ...)
+		routines.  NULL for tasks added without a context.
+	*/
+	void* myContext();
+
     // We need a publicly available TaskManager::loop() so our global loop() can use it
 	/*x	@} */	// ingroup Message
 	
@@ -623,6 +1202,63 @@ public:
 	/*x	@} */ // ingroup ClockSync
 #endif // ESP
 
+	/*x	\ingroup Misc
+		@{
+	*/
+	/*!	\name Offloading CPU-heavy Jobs
+
+		A task that needs a long computation (an FFT, a CRC over a large buffer) can hand it to a pool
+		of worker threads instead of blocking every other task.  When the job is done, the completion
+		task is sent a message.  The message is the job's arg pointer (sizeof(void*) bytes); its source
+		is the task that called offload().
+	*/
+	bool beginOffload(uint8_t nWorkers=1, int core=0);
+	bool offload(void (*job)(void*), void* arg, tm_taskId_t completionTask);
+	/*x	@} */ // ingroup Misc
+
+#if TASKMGR_MAX_EXECUTORS>1
+	/*x	\ingroup Setup
+		@{
+	*/
+	/*!	\name Multi-core Executors
+
+		Each TaskManager instance is an executor with its own task ring.  TaskMgr runs from the Arduino
+		loop().  Additional instances run on another core after beginCore().  A task runs on the executor
+		it was added to; messages sent to a task on another executor go through a lock-free queue.
+		
+		\note Tasks running on a secondary executor should use TaskManager::current() (or their executor
+		object) rather than TaskMgr.  The TM_* macros do this automatically.  Radio (mesh) routines
+		should only be used from TaskMgr.
+		\note At most TASKMGR_MAX_EXECUTORS instances, TaskMgr included, are executors.  Any more are
+		disabled (executorId() returns TASKMGR_MAX_EXECUTORS).  A task ID should be added on only one
+		executor; messages to an ID added on several are delivered on the sender's executor.
+	*/
+	bool beginCore(BaseType_t core, uint32_t stackSize=TASKMGR_EXECUTOR_STACK, UBaseType_t priority=1);
+	static TaskManager* current();
+	/*!	\brief Return this executor's index.  TaskMgr is executor 0.  TASKMGR_MAX_EXECUTORS means disabled.
+	*/
+	uint8_t executorId() const { return m_executorId; }
+	unsigned long crossDrops() const;
+	/*x	@} */ // ingroup Setup
+
+private:
+	uint8_t m_executorId;		// index into s_executors
+	// m_inbox[n] holds messages sent to this executor by executor n.  Executor n is the only producer
+	// and this executor is the only consumer.
+	spscRing<_TaskManagerCrossMessage, TASKMGR_CROSS_QUEUE_SIZE> m_inbox[TASKMGR_MAX_EXECUTORS];
+	static TaskManager* s_executors[TASKMGR_MAX_EXECUTORS];		// all executors, by executorId
+	static TaskManager* s_running[TASKMGR_MAX_EXECUTORS];		// the executor running on each core
+	static uint8_t s_executorCount;		// secondary executors; they are executors 1..s_executorCount
+	static uint8_t s_taskExecutor[TASKMGR_MAX_TASK+1];			// executorId+1 for each taskId; 0 if unknown,
+																// TASKMGR_TASK_ON_MANY if on several executors
+	static void executorThread(void* arg);
+	_TaskManagerOffloadPool* m_offloadPool;	// worker pool started by beginOffload(), or NULL
+	void drainOffload();
+	bool offloadHeld(tm_taskId_t taskId, const _TaskManagerOffloadJob* held, uint8_t nHeld);
+	bool postCrossMessage(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, tm_taskId_t taskId, const void* buf, int len);
+	void drainInboxes();
+#endif // multiple executors
+
 protected:
 	/*x	\ingroup Internal
 		@{
@@ -651,6 +1287,11 @@ protected:
 	void internalSendMessage(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, tm_taskId_t taskId, void* buf, int len);
 
 private:
+    void legacyYieldJump(int yieldType);
+
+    void addTask(_TaskManagerTask& newTask);
+    void localSendMessage(tm_nodeId_t fromNodeId, tm_taskId_t fromTaskId, tm_taskId_t taskId, void* buf, int len);
+
     // Find the next active task
     // Note: there will always be a runnable task (tne null task) on the list.
     _TaskManagerTask* FindNextRunnable();
@@ -665,6 +1306,17 @@ public:
 };
 /*x @} */ // end TaskManager
 
+/*!	\def TM_CURRENT
+	The TaskManager that is running the current task.  This is TaskMgr unless multiple executors
+	are configured, in which case it is the executor running on the current core.  The TM_* macros
+	use it so they work in tasks on any executor.
+*/
+#if TASKMGR_MAX_EXECUTORS>1
+#define TM_CURRENT (*TaskManager::current())
+#else
+#define TM_CURRENT TaskMgr
+#endif
+
 /* **************************************************************************************************
    *    IMPLEMENTATION   																			*
    **************************************************************************************************
@@ -686,7 +1338,8 @@ public:
     By default, the taskId is set to 0 and the routine is NULL.  This will not run, and the routine must be
     set prior to invoking the main loop.
 */
-inline _TaskManagerTask::_TaskManagerTask(): m_id(0), m_fn(NULL), m_stateFlags(0)
+inline _TaskManagerTask::_TaskManagerTask(): m_stateFlags(0), m_dispatchFlags(0), m_yieldType(0),
+	m_id(0), m_fn(NULL), m_ctxFn(NULL), m_context(NULL), m_budgetUs(0), m_overruns(0), m_mailbox(NULL)
 {
 }
 
@@ -695,7 +1348,18 @@ inline _TaskManagerTask::_TaskManagerTask(): m_id(0), m_fn(NULL), m_stateFlags(0
     \param taskId: The taskId.  User tasks in the range [0 127], system tasks [128 255].  Does not have to be unique.
     \param fn: The routine that is called to perform the process.
 */
-inline _TaskManagerTask::_TaskManagerTask(tm_taskId_t taskId, void (*fn)()): m_id(taskId), m_fn(fn), m_stateFlags(0) {
+inline _TaskManagerTask::_TaskManagerTask(tm_taskId_t taskId, void (*fn)()): m_stateFlags(0), m_dispatchFlags(0), m_yieldType(0),
+	m_id(taskId), m_fn(fn), m_ctxFn(NULL), m_context(NULL), m_budgetUs(0), m_overruns(0), m_mailbox(NULL) {
+}
+
+/*! \brief Construct a _TaskManager task object that carries a context
+
+    \param taskId: The taskId.  User tasks in the range [0 127], system tasks [128 255].  Does not have to be unique.
+    \param fn: The routine that is called to perform the process.  It is passed the context.
+    \param context: The context (normally a pointer to a task-specific state block).
+*/
+inline _TaskManagerTask::_TaskManagerTask(tm_taskId_t taskId, void (*fn)(void*), void* context): m_stateFlags(0), m_dispatchFlags(0),
+	m_yieldType(0), m_id(taskId), m_fn(NULL), m_ctxFn(fn), m_context(context), m_budgetUs(0), m_overruns(0), m_mailbox(NULL) {
 }
 
 /*!	\brief Standard destructor.
@@ -808,6 +1472,13 @@ inline void _TaskManagerTask::setAutoMessage(unsigned long msTimeout/*=0*/)  {
     setAutoDelay(msTimeout);
 }
 
+/*!	\brief Call the task's procedure, passing the context if the task has one
+*/
+inline void _TaskManagerTask::invoke() {
+	if(m_ctxFn!=NULL) (m_ctxFn)(m_context);
+	else (m_fn)();
+}
+
 //
 // Sending messages to a task
 //
@@ -827,6 +1498,22 @@ inline void _TaskManagerTask::putMessage(void* buf, int len) {
     }
 }
 
+/*!	\brief Move the oldest message in the task's mailbox into the task's message slot
+	
+	The message becomes the one returned by getMessage() and getSource(), and a task waiting for a
+	message is woken.
+	\return true if a message was moved, false if there is no mailbox or it is empty.
+*/
+inline bool _TaskManagerTask::pullMessage() {
+	_TaskManagerCrossMessage* msg;
+	if(m_mailbox==NULL || (msg=m_mailbox->front())==NULL) return false;
+	m_fromNodeId = msg->m_fromNodeId;
+	m_fromTaskId = msg->m_fromTaskId;
+	putMessage(msg->m_data, msg->m_len);
+	m_mailbox->pop();
+	return true;
+}
+
 //
 // Testing the status bits of the task
 //
@@ -897,7 +1584,172 @@ inline void _TaskManagerTask::resetCurrentStateBits() {
 inline tm_taskId_t TaskManager::myId() {
 	return m_theTasks.front().m_id;
 };
+
+inline void* TaskManager::myContext() {
+	return m_theTasks.front().m_context;
+}
 /* @} */ // end task
+/*x \ingroup Yield
+	@{
+*/
+/*!	\brief Record a yield() for the current task.  The caller must return immediately.
+	\sa yield()
+*/
+inline void TaskManager::markYield() {
+	m_theTasks.front().m_yieldType = YtYield;
+}
+
+/*!	\brief Record a yieldUntil() for the current task.  The caller must return immediately.
+	\param when -- The target CPU time.
+	\sa yieldUntil()
+*/
+inline void TaskManager::markYieldUntil(unsigned long when) {
+	m_theTasks.front().setWaitUntil(when);
+	m_theTasks.front().m_yieldType = YtYieldUntil;
+}
+
+/*!	\brief Record a yieldDelay() for the current task.  The caller must return immediately.
+	\param ms -- the delay in milliseconds.
+	\sa yieldDelay()
+*/
+inline void TaskManager::markYieldDelay(unsigned long ms) {
+	markYieldUntil(millis()+ms);
+}
+
+/*!	\brief Record a yieldForMessage() for the current task.  The caller must return immediately.
+	\param timeout -- The timeout period, in milliseconds.  0 means no timeout.
+	\sa yieldForMessage()
+*/
+inline void TaskManager::markYieldForMessage(unsigned long timeout/*=0*/) {
+	m_theTasks.front().setWaitMessage(timeout);
+	m_theTasks.front().m_yieldType = YtYieldMessageTimeout;
+}
+
+/*!	\brief Record the sender of the message that started a subtask.  Internal routine.
+
+	Called by TM_BEGINSUB() and TM_BEGINSUB_P().  A caller on this node is recorded as node 0.
+	A message from TM_CALL_NODE*() is the parameter block followed by the call number; one from
+	TM_CALL() or TM_CALL_P() is the parameter block alone, and its call number is recorded as 0.
+	\param[out] nodeId -- the node of the caller
+	\param[out] taskId -- the task of the caller
+	\param[out] callSeq -- the call number, to be returned with the reply
+	\param paramLen -- the size of the subtask's parameter block; 0 if it has none
+*/
+inline void TaskManager::getCaller(tm_nodeId_t& nodeId, tm_taskId_t& taskId, uint16_t& callSeq, int paramLen) {
+	nodeId = m_theTasks.front().m_fromNodeId;
+	taskId = m_theTasks.front().m_fromTaskId;
+	callSeq = 0;
+	if(m_theTasks.front().m_messageLength==paramLen+(int)sizeof(callSeq))
+		memcpy(&callSeq, m_theTasks.front().m_message+paramLen, sizeof(callSeq));
+}
+
+/*!	\brief Send a subtask's return message to its caller.  Internal routine.
+
+	Called by TM_RETURNSUB(), TM_RETURNSUB_R() and TM_ENDSUB().
+	\param nodeId -- the caller's node, as recorded by getCaller()
+	\param taskId -- the caller's task
+	\param callSeq -- the call number, as recorded by getCaller(); 0 if the call had none
+	\param buf -- the result block, or NULL
+	\param len -- the length of the result block
+*/
+inline void TaskManager::returnToCaller(tm_nodeId_t nodeId, tm_taskId_t taskId, uint16_t callSeq, void* buf, int len) {
+	sendCallFrame(nodeId, taskId, callSeq, buf, len);
+}
+
+/*!	\brief Send a subtask call to a task on any node.  Internal routine.
+
+	Called by TM_CALL_NODE_P() and TM_CALL_NODE().  Each call gets the next call number of this
+	TaskManager, which is sent after the parameter block and returned after the result block.
+	\param nodeId -- the node; 0 for this node
+	\param taskId -- the task
+	\param buf -- the parameter block, or NULL
+	\param len -- the length of the parameter block
+	\returns the call number, for markAwaitReply()
+*/
+inline uint16_t TaskManager::sendCallMessage(tm_nodeId_t nodeId, tm_taskId_t taskId, void* buf, int len) {
+	if(++m_callSeq==0) m_callSeq = 1;		// 0 means no call number
+	sendCallFrame(nodeId, taskId, m_callSeq, buf, len);
+	return m_callSeq;
+}
+
+/*!	\brief Send a subtask call or return message to a task on any node.  Internal routine.
+
+	A task on this node (node 0, or this node's ID) is sent the message directly, so the calls
+	work where there is no radio.
+	\param nodeId -- the node; 0 for this node
+	\param taskId -- the task
+	\param callSeq -- the call number to send after the block; 0 to send the block alone
+	\param buf -- the block, or NULL
+	\param len -- the length of the block.  With a call number it must be at most
+		TASKMGR_MESSAGE_SIZE-2; a longer block is not sent.
+*/
+inline void TaskManager::sendCallFrame(tm_nodeId_t nodeId, tm_taskId_t taskId, uint16_t callSeq, void* buf, int len) {
+	byte frame[TASKMGR_MESSAGE_SIZE];
+	if(callSeq!=0) {
+		if(len+(int)sizeof(callSeq)>(int)TASKMGR_MESSAGE_SIZE) return;
+		if(len>0) memcpy(frame, buf, len);
+		memcpy(frame+len, &callSeq, sizeof(callSeq));
+		buf = frame;
+		len += sizeof(callSeq);
+	}
+#if TM_USING_RADIO && ((defined(ARDUINO_ARCH_AVR) && defined(TASKMGR_AVR_RF24)) || defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32))
+	if(nodeId!=0 && nodeId!=myNodeId()) {
+		sendMessage(nodeId, taskId, buf, len);
+		return;
+	}
+#else
+	(void)nodeId;
+#endif // using radio && (atmel || esp)
+	sendMessage(taskId, buf, len);
+}
+
+/*!	\brief Decide whether a TM_CALL_NODE*() has its reply.  Internal routine.
+
+	Called each time the calling task is resumed while it waits for the reply.  The reply is the
+	message from the called task that ends with this call's number.  Any other message -- from
+	another task, or a late reply to an earlier call that timed out -- is dropped, and the wait
+	is recorded again for what is left of the timeout; the caller must then return.
+	\param nodeId -- the node that was called; 0 for this node
+	\param taskId -- the subtask that was called
+	\param callSeq -- the call number, from sendCallMessage()
+	\param start -- the time (millis()) the call was made
+	\param timeout -- the timeout, in milliseconds.  0 means no timeout.
+	\returns true if the task is still waiting, false if the reply arrived or the call timed out
+*/
+inline bool TaskManager::markAwaitReply(tm_nodeId_t nodeId, tm_taskId_t taskId, uint16_t callSeq, unsigned long start, unsigned long timeout) {
+	if(timedOut()) return false;
+	_TaskManagerTask& task = m_theTasks.front();
+	tm_nodeId_t fromNodeId = task.m_fromNodeId;
+#if TM_USING_RADIO && ((defined(ARDUINO_ARCH_AVR) && defined(TASKMGR_AVR_RF24)) || defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32))
+	if(nodeId==myNodeId()) nodeId = 0;
+	if(fromNodeId==myNodeId()) fromNodeId = 0;
+#endif // using radio && (atmel || esp)
+	if(fromNodeId==nodeId && task.m_fromTaskId==taskId && task.m_messageLength>=(int)sizeof(callSeq)) {
+		uint16_t replySeq;
+		memcpy(&replySeq, task.m_message+task.m_messageLength-sizeof(callSeq), sizeof(replySeq));
+		if(replySeq==callSeq) return false;
+	}
+	if(timeout!=0) {
+		unsigned long used = ::millis()-start;
+		timeout = (used<timeout) ? timeout-used : 1;
+	}
+	markYieldForMessage(timeout);
+	return true;
+}
+/*x @} */ // end Yield
+
+/*x \ingroup Control
+	@{
+*/
+/*!	\brief Tell whether the current task has used up its time budget for this dispatch
+	\return true if the task has a budget and it has been used up, false otherwise.
+	\sa setBudget(), TM_CHECKPOINT()
+*/
+inline bool TaskManager::overBudget() {
+	return m_budgetActive && (long)(micros()-m_dispatchDeadline)>=0;
+}
+/*x @} */ // end Control
+
 /*x \ingroup Message
 	@{
 */
@@ -957,6 +1809,13 @@ inline bool TaskManager::sendMessage(tm_taskId_t taskId, void* buf, int len) {
 /*x \ingroup Message
 	@{
 */
+inline bool TaskManager::nextMessage() {
+	return m_theTasks.front().pullMessage();
+}
+inline uint8_t TaskManager::pendingMessages() {
+	_TaskManagerMailbox* mb = m_theTasks.front().m_mailbox;
+	return mb==NULL ? 0 : mb->size();
+}
 inline void* TaskManager::getMessage() {
     return (void*)(&(m_theTasks.front().m_message));
 }
@@ -991,6 +1850,17 @@ inline unsigned long TaskManager::runtime() const { return ::millis()-m_startTim
 /*x \ingroup TaskManager
  *	@{
 */
+#if TASKMGR_MAX_EXECUTORS>1
+/*!	\brief Return the executor running on the current core
+	\return The TaskManager whose loop() is running on this core.  If no executor has run on this
+	core, returns executor 0 (TaskMgr).
+*/
+inline TaskManager* TaskManager::current() {
+	TaskManager* ret = s_running[xPortGetCoreID()];
+	return ret!=NULL ? ret : s_executors[0];
+}
+#endif // multiple executors
+
 #if TM_USING_RADIO && ((defined(ARDUINO_ARCH_AVR) && defined(TASKMGR_AVR_RF24)) || defined(ARDUINO_ARCH_ESP8266) || defined(ARDUINO_ARCH_ESP32) )
 inline tm_nodeId_t TaskManager::myNodeId() {
 	return m_myNodeId;
@@ -33,6 +33,11 @@
 	TM_BEGIN() creates the initial code enabling the macros to execute correctly.
 	It should be placed at/near the start of the procedure.  No TM_YIELD*() calls
 	can come before it
+
+	The TM_YIELD*() macros record the yield in the task and return, so no longjmp() back
+	to TaskManager::loop() is needed.  For this reason, the TM_* macros must be used in the
+	task procedure itself, not in a routine it calls.  A task that yields only this way can be
+	added with TaskManager::addReturnYield(), which also skips the setjmp() on each dispatch.
 */
 #define TM_BEGIN()							\
 	static unsigned int __tmNext__ = 0;			\
@@ -71,7 +76,8 @@
 #define TM_YIELD(n)			\
 	{						\
 			__tmNext__ = n;					\
-			TaskMgr.yield();				\
+			TM_CURRENT.markYield();			\
+			return;							\
 		case n:  ;   }
 
 /*!	\brief	Yield with a delay and return to the next statement
@@ -85,7 +91,8 @@
 #define TM_YIELDDELAY(n,ms)			\
 	{				\
 			__tmNext__ = n;					\
-			TaskMgr.yieldDelay(ms);			\
+			TM_CURRENT.markYieldDelay(ms);		\
+			return;							\
 		case n: ; }
 
 /*!	\brief	Yield until a message has been received, and then return to the next statement
@@ -98,7 +105,8 @@
 #define TM_YIELDMESSAGE(n)					\
 	{										\
 			__tmNext__ = n;					\
-			TaskMgr.yieldForMessage();		\
+			TM_CURRENT.markYieldForMessage();	\
+			return;							\
 		case n: ; }
 
 /*!	\brief	Yield until a message is received or a time has passed, and then return to the next statement
@@ -112,7 +120,26 @@
 #define TM_YIELDMESSAGETIMEOUT(n,msTimeout)		\
 	{	\
 			__tmNext__ = n;					\
-			TaskMgr.yieldForMessage(msTimeout);	\
+			TM_CURRENT.markYieldForMessage(msTimeout);	\
+			return;							\
+		case n:  ; }
+
+/*!	\brief	Yield only if the task has used up its time budget
+
+	If the task's time budget for this dispatch (see TaskManager::setBudget()) has been used up,
+	perform a yield() operation; upon return to this task, execution will continue at the next
+	statement.  Otherwise, continue immediately.  This costs one clock read and compare, so
+	checkpoints can be placed inside long loops.  Tasks without a budget never yield here.
+	\param n -- an integer label.  The label should be unique for all of the TM_YIELD*()
+	routines in this task.
+	\note As with TM_YIELD(), local (non-static) variables are not preserved across a yield.
+*/
+#define TM_CHECKPOINT(n)					\
+	{	if(TM_CURRENT.overBudget()) {		\
+			__tmNext__ = n;					\
+			TM_CURRENT.markYield();			\
+			return;							\
+		}									\
 		case n:  ; }
 /*!	@} */ // End primary
 
@@ -136,22 +163,31 @@
 	Note that this is an internal function and may not be available in later releases
 */
 #define TM_ADDSUBTASK(id, task)		\
-	TaskMgr.addAutoWaitMessage(id, task);
+	TM_CURRENT.addAutoWaitMessage(id, task);
 
 /*!	\brief Procedure definition header for subtask
 	TM_BEGINSUB() is used at the start of a subtask procedure.
-	This procedure should be called using TM_CALL().
-
+	This procedure should be called using TM_CALL() or, from any node, TM_CALL_NODE().
+	The caller's node, task and call number are recorded so TM_RETURNSUB() can reply to it.
 */
 #define TM_BEGINSUB()						\
+	TM_BEGINSUB_LEN_(0)
+
+/*!	\brief Start a subtask whose parameter block is paramLen bytes.  Internal macro.
+	Used by TM_BEGINSUB() and TM_BEGINSUB_P(), which know how long a call's parameter block
+	is and so where its call number is.
+*/
+#define TM_BEGINSUB_LEN_(paramLen)			\
+	static tm_nodeId_t __callingNode__;		\
 	static tm_taskId_t __callingTask__; 	\
-	TM_BEGIN();							    \	
-	TaskMgr.getSource(__callingTask__);
+	static uint16_t __callingSeq__;			\
+	TM_BEGIN();							    \
+	TM_CURRENT.getCaller(__callingNode__, __callingTask__, __callingSeq__, (paramLen));
 
 /*!	\brief Procedure definition header for a subtask with parameters.
 	TM_BEGINSUB_P(vtype, vlocal) is used at the start of a subtask procedure that is
 	expecting a parameter of type vtype.  This procedure should be called using
-	TM_CALL_P().
+	TM_CALL_P() or TM_CALL_NODE_P().
 	\param vtype - the type of the parameter (normally a struct/class)
 	\param vlocal - the name of the procedure-local variable of type vtype.
 
@@ -159,16 +195,27 @@
 */
 #define TM_BEGINSUB_P(vtype, vlocal)		\
 	static vtype vlocal;					\
-	TM_BEGINSUB();							\
-	memcpy((void*)&vlocal, TaskMgr.getMessage(), sizeof(vtype));
+	TM_BEGINSUB_LEN_(sizeof(vtype));		\
+	memcpy((void*)&vlocal, TM_CURRENT.getMessage(), sizeof(vtype));
 
 /*!	\brief Return from a subtask
 	TM_RETURNSUB() is used to return from a procedure.  Note that all subtasks MUST use
 	TM_RETURNSUB() -- bare returns are not allowed.  TM_RETURNSUB() can be used
-	from multiple places within a subtask
+	from multiple places within a subtask.  If the caller is on another node, the
+	return message is sent to it over the radio.
 */
 #define TM_RETURNSUB()		\
-	{ TaskMgr.sendMessage(__callingTask__, NULL, 0); __tmNext__ = 0; return; }
+	{ TM_CURRENT.returnToCaller(__callingNode__, __callingTask__, __callingSeq__, NULL, 0); __tmNext__ = 0; return; }
+
+/*!	\brief Return from a subtask, passing a result block back to the caller
+	TM_RETURNSUB_R() is used like TM_RETURNSUB(), and also sends vresult (normally a
+	struct/class object) to the caller.  TM_CALL_NODE_R() copies it into the caller's
+	result object.  The size of the object must be less than or equal to the size of a message,
+	less 2 bytes if the caller used TM_CALL_NODE*().
+	\param vresult - the object being returned
+*/
+#define TM_RETURNSUB_R(vresult)		\
+	{ TM_CURRENT.returnToCaller(__callingNode__, __callingTask__, __callingSeq__, (void*)&vresult, sizeof(vresult)); __tmNext__ = 0; return; }
 
 /*!	\brief Call a subtask
 	TM_CALL() calls a subtask.  When the subtask has been completed (via TM_SUBTASK_RETURN()), the
@@ -177,7 +224,7 @@
 	\param taskId - the taskId that is to be called
 */
 #define TM_CALL(n, taskId)		\
-	{ TaskMgr.sendMessage(taskId, NULL, 0); \
+	{ TM_CURRENT.sendMessage(taskId, NULL, 0); \
 	  TM_YIELDMESSAGE(n); }
 
 /*!	\brief Call a subtask, passing a parameter block
@@ -195,10 +242,77 @@
 */
 #define TM_CALL_P(n, taskId, vparam)										\
 	{																		\
-		TaskMgr.sendMessage(taskId, (void*)&vparam, sizeof(vparam));		\
+		TM_CURRENT.sendMessage(taskId, (void*)&vparam, sizeof(vparam));		\
 		TM_YIELDMESSAGE(n);													\
 	}
 
+/*!	\brief Call a subtask on any node, passing a parameter block
+	TM_CALL_NODE_P() calls a subtask on the given node, which may be this one.  The calling
+	routine resumes when the subtask has returned (via TM_RETURNSUB()) or the timeout has
+	passed; use TM_CURRENT.timedOut() to tell which.
+
+	Each call is numbered, and the number is sent after the parameter block and returned after
+	the result block, so the object must be at most the size of a message less 2 bytes.  While
+	the caller waits, any message that is not the called subtask's reply to this call is dropped:
+	messages from other nodes and tasks, and late replies to earlier calls that timed out.
+
+	Pointers in the parameter cannot be used to return values from another node; use
+	TM_CALL_NODE_R() with TM_RETURNSUB_R() instead.
+	\param n - a unique (within the procedure) value
+	\param nodeId - the node the subtask is on; 0 for this node
+	\param taskId - the taskId that is to be called
+	\param vparam - the object being passed
+	\param msTimeout - the longest time (in ms) to wait for the return; 0 waits forever
+	\note Calls to another node are only available on ESP and RF24-enabled AVR environments.
+*/
+#define TM_CALL_NODE_P(n, nodeId, taskId, vparam, msTimeout)					\
+	{	static unsigned long __tmCallStart__;									\
+		static uint16_t __tmCallSeq__;											\
+		__tmCallStart__ = millis();												\
+		__tmCallSeq__ = TM_CURRENT.sendCallMessage(nodeId, taskId, (void*)&vparam, sizeof(vparam));	\
+		__tmNext__ = n;															\
+		TM_CURRENT.markYieldForMessage(msTimeout);								\
+		return;																	\
+	case n:																		\
+		if(TM_CURRENT.markAwaitReply(nodeId, taskId, __tmCallSeq__, __tmCallStart__, msTimeout)) return;	\
+	}
+
+/*!	\brief Call a subtask on any node
+	TM_CALL_NODE() is TM_CALL_NODE_P() without a parameter block.
+	\param n - a unique (within the procedure) value
+	\param nodeId - the node the subtask is on; 0 for this node
+	\param taskId - the taskId that is to be called
+	\param msTimeout - the longest time (in ms) to wait for the return; 0 waits forever
+*/
+#define TM_CALL_NODE(n, nodeId, taskId, msTimeout)								\
+	{	static unsigned long __tmCallStart__;									\
+		static uint16_t __tmCallSeq__;											\
+		__tmCallStart__ = millis();												\
+		__tmCallSeq__ = TM_CURRENT.sendCallMessage(nodeId, taskId, NULL, 0);					\
+		__tmNext__ = n;															\
+		TM_CURRENT.markYieldForMessage(msTimeout);								\
+		return;																	\
+	case n:																		\
+		if(TM_CURRENT.markAwaitReply(nodeId, taskId, __tmCallSeq__, __tmCallStart__, msTimeout)) return;	\
+	}
+
+/*!	\brief Call a subtask on any node, passing a parameter block and receiving a result block
+	TM_CALL_NODE_R() is TM_CALL_NODE_P(), and then copies the result block the subtask
+	returned with TM_RETURNSUB_R() into vresult.  vresult is left unchanged if the call timed
+	out or the subtask returned without a result of the same size.
+	\param n - a unique (within the procedure) value
+	\param nodeId - the node the subtask is on; 0 for this node
+	\param taskId - the taskId that is to be called
+	\param vparam - the object being passed
+	\param vresult - the object that receives the result
+	\param msTimeout - the longest time (in ms) to wait for the return; 0 waits forever
+*/
+#define TM_CALL_NODE_R(n, nodeId, taskId, vparam, vresult, msTimeout)			\
+	{	TM_CALL_NODE_P(n, nodeId, taskId, vparam, msTimeout);					\
+		if(!TM_CURRENT.timedOut() && TM_CURRENT.getMessageLength()==sizeof(vresult)+sizeof(uint16_t))	\
+			memcpy((void*)&vresult, TM_CURRENT.getMessage(), sizeof(vresult));	\
+	}
+
 /*! \brief End a subtask
 	TM_ENDSUB()
 	Used at the bottom of a subtask.
@@ -206,7 +320,7 @@
 #define TM_ENDSUB() 								\
 		default:	break;							\
 	}												\
-	TaskMgr.sendMessage(__callingTask__, NULL, 0);	\
+	TM_CURRENT.returnToCaller(__callingNode__, __callingTask__, __callingSeq__, NULL, 0);	\
 	__tmNext__ = 0;
 
 /*!	@} */ // end subtask
@@ -230,17 +344,35 @@
 	\param someArr -- an array of someType objects.  Must be sized with one entry for each
 	task that will use this code, and the "taskId" of each entry must match one of the tasks.
 	\param arrSize -- the integer size of someArr.
-	\sa TM_BEGIN
+	\note TMR_BEGIN searches someArr on every invocation.  TMR_BEGIN_CONTEXT avoids the search.
+	\sa TM_BEGIN, TMR_BEGIN_CONTEXT
 */
 #define TMR_BEGIN(someType, someArr, arrSize)                                       \
   someType* myData;                                                                 \
   int i;                                                                            \
-  for(i=0; i<arrSize; i++) if(someArr[i].taskID==TaskMgr.myId()) break;           \
+  for(i=0; i<arrSize; i++) if(someArr[i].taskID==TM_CURRENT.myId()) break;           \
   if(i==arrSize) return; /* no assocated task  */                                   \
   myData = &someArr[i];                                                             \
   switch(myData->tmrNext) {                                                       \
     case 0:
 
+/*!	\brief Start a reentrant task that carries its state as its context
+
+	Functionally similar to TMR_BEGIN, except the state block is the task's context (see
+	TaskManager::add(taskId, fn, context)) rather than an entry found by searching an array.
+	The lookup is O(1).  The struct must have a "uint32_t tmrNext" field; it does not need a
+	taskId field.  The macro creates a variable:  "someType* myData".
+	
+	The task procedure takes a void* argument, which is ignored; for example
+	"void sensorTask(void*) { TMR_BEGIN_CONTEXT(SensorState); ... TMR_END(); }".
+	\param someType -- the type (struct/class) used to store task-specific information.
+	\sa TMR_BEGIN, TaskManager::myContext(), TaskManager::addReturnYield()
+*/
+#define TMR_BEGIN_CONTEXT(someType)                                                 \
+  someType* myData = (someType*)TM_CURRENT.myContext();                                \
+  switch(myData->tmrNext) {                                                         \
+    case 0:
+
 /*! \brief Designates the end of the code implementing the task.  This is
 	placed at the end of the actual code.
 */
@@ -261,7 +393,8 @@
 */
 #define TMR_YIELD(n)              \
       myData->tmrNext = n;         \
-      TaskMgr.yield();        \
+      TM_CURRENT.markYield();         \
+      return;                      \
     case n:
 
 /*!	\brief	Yield with a delay and return to the next statement
@@ -272,9 +405,11 @@
 	routines in this task.
 	\param ms -- a long integer value representing the time (in ms) for the delay.
 	\sa TM_YIELDDELAY
-*/#define TMR_YIELDDELAY(n,ms)          \
+*/
+#define TMR_YIELDDELAY(n,ms)          \
       myData->tmrNext = n;         \
-      TaskMgr.yieldDelay(ms);     \
+      TM_CURRENT.markYieldDelay(ms);  \
+      return;                      \
     case n:
 
 /*!	\brief	Yield until a message has been received, and then return to the next statement
@@ -287,7 +422,8 @@
 */
 #define TMR_YIELDMESSAGE(n)          \
       myData->tmrNext = n;         \
-      TaskMgr.yieldForMessage();    \
+      TM_CURRENT.markYieldForMessage(); \
+      return;                      \
     case n:
 
 /*!	\brief	Yield until a message is received or a time has passed, and then return to the next statement
@@ -300,7 +436,24 @@
 */
 #define TMR_YIELDMESSAGETIMEOUT(n,msTimeout)    \
       myData->tmrNext = n;         \
-      TaskMgr.yieldForMessage(msTimeout);  \
+      TM_CURRENT.markYieldForMessage(msTimeout); \
+      return;                      \
+    case n:
+
+/*!	\brief	Yield only if the task has used up its time budget
+
+	If the task's time budget for this dispatch has been used up, perform a yield() operation.
+	Otherwise, continue immediately.
+	\param n -- an integer label.  The label should be unique for all of the TM_YIELD*()
+	routines in this task.
+	\sa TM_CHECKPOINT
+*/
+#define TMR_CHECKPOINT(n)    \
+      if(TM_CURRENT.overBudget()) { \
+        myData->tmrNext = n;         \
+        TM_CURRENT.markYield();         \
+        return;                      \
+      }                              \
     case n:
 
 /*!	@} */ // end reentrant
@@ -330,7 +483,7 @@
 		int __i, __where;																\
 		__done = false;																	\
 		for(__i=0; allParams[__i].taskId!=0; __i++) 									\
-			if(allParams[__i].taskId==TaskMgr.myId()) { __done=true; __where=__i; }		\
+			if(allParams[__i].taskId==TM_CURRENT.myId()) { __done=true; __where=__i; }		\
 		if(__done) { localp = &(allParams[__where]);	}								\
 		else return;																	\
 	}
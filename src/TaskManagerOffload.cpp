@@ -0,0 +1,277 @@
+//
+//	Implementation file for TaskManager offloading
+//
+//	Runs CPU-heavy jobs for cooperative tasks on a pool of worker threads.
+//	On ESP-32 the workers are FreeRTOS tasks pinned to the other core.  On a Linux host
+//	built with the MeshSim shims (test/MeshSim/host), the same FreeRTOS calls start them as
+//	std::threads.  Where there is only one core, jobs are run in place.
+//
+
+#include <arduino.h>
+#include <TaskManagerCore.h>
+
+/*! \file TaskManagerOffload.cpp
+    Implementation file for offloading CPU-heavy jobs from TaskManager tasks
+*/
+
+/*!	\struct _TaskManagerOffloadJob
+	A job handed to the offload pool.  For internal use only.
+*/
+struct _TaskManagerOffloadJob {
+	void		(*m_fn)(void*);		//!< The job
+	void*		m_arg;				//!< Passed to the job, and returned in the completion message
+	tm_taskId_t	m_fromTaskId;		//!< The task that called offload()
+	tm_taskId_t	m_completionTask;	//!< The task that is sent the completion message
+};
+
+#if TASKMGR_MAX_EXECUTORS>1
+
+/*!	\class _TaskManagerJobQueue
+	\brief One worker's queue of jobs.
+
+	The executor that owns the pool is the only producer.  Any worker may remove a job:  a worker
+	normally takes from its own queue and steals from the other workers' queues when its own is
+	empty.  Removal claims the job with a compare-and-swap on the head, so it is lock-free.
+*/
+class _TaskManagerJobQueue {
+	static_assert((TASKMGR_OFFLOAD_QUEUE_SIZE&(TASKMGR_OFFLOAD_QUEUE_SIZE-1))==0, "TASKMGR_OFFLOAD_QUEUE_SIZE must be a power of two");
+private:
+	_TaskManagerOffloadJob m_jobs[TASKMGR_OFFLOAD_QUEUE_SIZE];
+	unsigned int m_head;	// next job to take.  Advanced by CAS.
+	unsigned int m_tail;	// next free slot.  Written only by the producer.
+public:
+	_TaskManagerJobQueue(): m_head(0), m_tail(0) {}
+	bool push(const _TaskManagerOffloadJob& job);
+	bool take(_TaskManagerOffloadJob& job);
+	//! \brief Return the number of jobs waiting in the queue
+	unsigned int size() const { return __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE); }
+};
+
+/*!	\brief Add a job to the queue.  Producer (owning executor) only.
+	\return true if the job was queued, false if the queue was full.
+*/
+bool _TaskManagerJobQueue::push(const _TaskManagerOffloadJob& job) {
+	unsigned int tail = m_tail;
+	if(tail - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) >= TASKMGR_OFFLOAD_QUEUE_SIZE) return false;
+	m_jobs[tail&(TASKMGR_OFFLOAD_QUEUE_SIZE-1)] = job;
+	__atomic_store_n(&m_tail, tail+1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/*!	\brief Claim the oldest job in the queue.  Any worker.
+
+	The job is copied out before it is claimed.  If another worker claims it first, the CAS fails,
+	the copy is discarded and the next job is tried.  A slot is only reused by the producer after
+	the head has moved past it, so a copy that wins the CAS is never torn.
+	\param[out] job -- receives the job.
+	\return true if a job was claimed, false if the queue was empty.
+*/
+bool _TaskManagerJobQueue::take(_TaskManagerOffloadJob& job) {
+	unsigned int head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+	for(;;) {
+		if(head == __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE)) return false;
+		job = m_jobs[head&(TASKMGR_OFFLOAD_QUEUE_SIZE-1)];
+		if(__atomic_compare_exchange_n(&m_head, &head, head+1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return true;
+	}
+}
+
+/*!	\class _TaskManagerOffloadPool
+	\brief The worker threads and queues behind TaskManager::offload().
+*/
+class _TaskManagerOffloadPool {
+public:
+	/*!	\brief What a worker thread is started with */
+	struct Worker {
+		_TaskManagerOffloadPool* m_pool;
+		uint8_t m_index;
+		TaskHandle_t m_thread;
+	};
+	uint8_t m_nWorkers;
+	uint8_t m_nextWorker;		// where the search for the least-loaded queue starts
+	SemaphoreHandle_t m_work;	// counting semaphore, one token per queued job
+	Worker m_workers[TASKMGR_OFFLOAD_MAX_WORKERS];
+	_TaskManagerJobQueue m_queues[TASKMGR_OFFLOAD_MAX_WORKERS];
+	// m_done[n] holds jobs finished by worker n.  Worker n is the only producer, the owning executor the only consumer.
+	spscRing<_TaskManagerOffloadJob, TASKMGR_OFFLOAD_QUEUE_SIZE> m_done[TASKMGR_OFFLOAD_MAX_WORKERS];
+	// finished jobs whose completion task was not ready for them, oldest first.  Owning executor only.
+	_TaskManagerOffloadJob m_held[TASKMGR_OFFLOAD_MAX_WORKERS*TASKMGR_OFFLOAD_QUEUE_SIZE];
+	uint8_t m_nHeld;
+
+	bool submit(const _TaskManagerOffloadJob& job);
+	static void workerThread(void* arg);
+};
+
+/*!	\brief Queue a job on the least-loaded worker and wake a worker.  Owning executor only.
+	\return true if the job was queued, false if every queue was full.
+*/
+bool _TaskManagerOffloadPool::submit(const _TaskManagerOffloadJob& job) {
+	uint8_t best = m_nextWorker;
+	for(uint8_t i=1; i<m_nWorkers; i++) {
+		uint8_t w = (m_nextWorker+i)%m_nWorkers;
+		if(m_queues[w].size()<m_queues[best].size()) best = w;
+	}
+	if(!m_queues[best].push(job)) return false;
+	m_nextWorker = (best+1)%m_nWorkers;
+	xSemaphoreGive(m_work);
+	return true;
+}
+
+/*!	\brief The FreeRTOS task body for one offload worker.
+
+	Each semaphore token stands for one queued job, so a worker that gets a token will find a job,
+	either in its own queue or by stealing from another worker's queue.
+	\param arg -- the worker's Worker record.
+*/
+void _TaskManagerOffloadPool::workerThread(void* arg) {
+	Worker* me = (Worker*)arg;
+	_TaskManagerOffloadPool* pool = me->m_pool;
+	_TaskManagerOffloadJob job;
+	for(;;) {
+		xSemaphoreTake(pool->m_work, portMAX_DELAY);
+		bool found = pool->m_queues[me->m_index].take(job);
+		for(uint8_t i=1; !found; i++) {
+			if(i==pool->m_nWorkers) { i = 0; taskYIELD(); }
+			found = pool->m_queues[(me->m_index+i)%pool->m_nWorkers].take(job);
+		}
+		(job.m_fn)(job.m_arg);
+		while(!pool->m_done[me->m_index].push(job)) vTaskDelay(1);	// executor is behind; wait for it
+	}
+}
+
+/*!	\brief Start the offload worker pool
+
+	Creates nWorkers worker threads pinned to the given core.  Jobs passed to offload() by tasks on
+	this executor are run by the workers.  Completion messages are delivered by this executor's loop().
+
+	\param nWorkers -- the number of worker threads, at most TASKMGR_OFFLOAD_MAX_WORKERS.
+	\param core -- the core the workers run on.  On ESP-32 the Arduino loop() normally runs on core 1,
+	so the workers normally use core 0.
+	\returns true if the pool was started, false otherwise (including if it was already started).
+	\note On systems with a single core, this returns false and offload() runs jobs in place.  On a
+	Linux host the workers are std::threads and core is only recorded (see test/OffloadBench).
+*/
+bool TaskManager::beginOffload(uint8_t nWorkers/*=1*/, int core/*=0*/) {
+	if(m_offloadPool!=NULL || nWorkers==0 || nWorkers>TASKMGR_OFFLOAD_MAX_WORKERS) return false;
+	_TaskManagerOffloadPool* pool = new _TaskManagerOffloadPool();
+	pool->m_nWorkers = nWorkers;
+	pool->m_nextWorker = 0;
+	pool->m_nHeld = 0;
+	pool->m_work = xSemaphoreCreateCounting(nWorkers*TASKMGR_OFFLOAD_QUEUE_SIZE, 0);
+	if(pool->m_work==NULL) { delete pool; return false; }
+	for(uint8_t i=0; i<nWorkers; i++) {
+		pool->m_workers[i].m_pool = pool;
+		pool->m_workers[i].m_index = i;
+		if(xTaskCreatePinnedToCore(_TaskManagerOffloadPool::workerThread, "TaskMgrOffload", TASKMGR_EXECUTOR_STACK,
+				&pool->m_workers[i], 1, &pool->m_workers[i].m_thread, core)!=pdPASS) {
+			// no job has been queued, so the workers already started are all waiting on m_work
+			while(i>0) vTaskDelete(pool->m_workers[--i].m_thread);
+			vSemaphoreDelete(pool->m_work);
+			delete pool;
+			return false;
+		}
+	}
+	m_offloadPool = pool;
+	return true;
+}
+
+/*!	\brief Send a CPU-heavy job to the offload workers
+
+	The job runs on a worker thread while the cooperative tasks keep running.  When it finishes,
+	completionTask is sent a message containing arg (sizeof(void*) bytes), exactly as if the
+	calling task had sent it.  The job must not call any TaskManager routines, and the caller
+	must not touch whatever arg points to until the completion message arrives.
+
+	If beginOffload() has not been called on this executor, the job is run in place and the
+	completion message is sent before offload() returns.
+
+	\param job -- the job.  It is passed arg.
+	\param arg -- the job's data.
+	\param completionTask -- the task that is sent the completion message.
+	\returns true if the job was accepted, false if the worker queues are full.
+*/
+bool TaskManager::offload(void (*job)(void*), void* arg, tm_taskId_t completionTask) {
+	if(m_offloadPool==NULL) {
+		(job)(arg);
+		internalSendMessage(0, myId(), completionTask, (void*)&arg, sizeof(arg));
+		return true;
+	}
+	_TaskManagerOffloadJob newJob;
+	newJob.m_fn = job;
+	newJob.m_arg = arg;
+	newJob.m_fromTaskId = myId();
+	newJob.m_completionTask = completionTask;
+	return m_offloadPool->submit(newJob);
+}
+
+/*!	\brief Deliver completion messages for finished offload jobs.  Internal routine.
+
+	A task holds only one message, so a completion for an auto-wait-message task on this executor
+	is held until the task has read the previous one.  Held completions are set aside in the pool,
+	so they do not stop later completions for other tasks, and are retried first on the next call.
+	A task's completions are still delivered in the order its jobs finished.
+*/
+void TaskManager::drainOffload() {
+	_TaskManagerOffloadPool* pool = m_offloadPool;
+	_TaskManagerOffloadJob* job;
+	uint8_t kept = 0;
+	for(uint8_t i=0; i<pool->m_nHeld; i++) {
+		if(offloadHeld(pool->m_held[i].m_completionTask, pool->m_held, kept)) pool->m_held[kept++] = pool->m_held[i];
+		else internalSendMessage(0, pool->m_held[i].m_fromTaskId, pool->m_held[i].m_completionTask,
+				(void*)&pool->m_held[i].m_arg, sizeof(pool->m_held[i].m_arg));
+	}
+	pool->m_nHeld = kept;
+	for(uint8_t w=0; w<pool->m_nWorkers; w++) {
+		while((job=pool->m_done[w].peek())!=NULL) {
+			if(offloadHeld(job->m_completionTask, pool->m_held, pool->m_nHeld)) {
+				if(pool->m_nHeld==sizeof(pool->m_held)/sizeof(pool->m_held[0])) break;	// leave it with the worker
+				pool->m_held[pool->m_nHeld++] = *job;
+			} else {
+				internalSendMessage(0, job->m_fromTaskId, job->m_completionTask, (void*)&job->m_arg, sizeof(job->m_arg));
+			}
+			pool->m_done[w].release();
+		}
+	}
+}
+
+/*!	\brief Test if a completion for a task must wait.  Internal routine.
+	\param taskId -- the completion task.
+	\param held -- the completions already held.
+	\param nHeld -- the number of entries in held.
+	\returns true if the task is an auto-wait-message task that has not read its last message,
+	or if an earlier completion for it is held.
+*/
+bool TaskManager::offloadHeld(tm_taskId_t taskId, const _TaskManagerOffloadJob* held, uint8_t nHeld) {
+	_TaskManagerTask* tsk = findTaskById(taskId);
+	if(tsk!=NULL && tsk->stateTestBit(_TaskManagerTask::AutoReWaitMessage)
+			&& !tsk->stateTestBit(_TaskManagerTask::WaitMessage)) return true;
+	for(uint8_t i=0; i<nHeld; i++) if(held[i].m_completionTask==taskId) return true;
+	return false;
+}
+
+#else // single executor
+
+/*!	\brief Start the offload worker pool
+	\returns false.  There is no second core, so offload() runs jobs in place.
+*/
+bool TaskManager::beginOffload(uint8_t nWorkers/*=1*/, int core/*=0*/) {
+	(void)nWorkers;
+	(void)core;
+	return false;
+}
+
+/*!	\brief Run a CPU-heavy job and send the completion message
+
+	There is no second core, so the job is run in place.  completionTask is then sent a message
+	containing arg (sizeof(void*) bytes), exactly as if the calling task had sent it.
+	\param job -- the job.  It is passed arg.
+	\param arg -- the job's data.
+	\param completionTask -- the task that is sent the completion message.
+	\returns true.
+*/
+bool TaskManager::offload(void (*job)(void*), void* arg, tm_taskId_t completionTask) {
+	(job)(arg);
+	internalSendMessage(0, myId(), completionTask, (void*)&arg, sizeof(arg));
+	return true;
+}
+
+#endif // multiple executors
@@ -0,0 +1,122 @@
+//
+// Transport interface for TaskManager networking
+//  A transport moves radio frames between nodes.  Everything above it
+//  (queueing, aggregation, reliable delivery, fragmentation, peer caching)
+//  is the same whichever transport is used.  ESP-NOW is the default;
+//  TaskManagerUdpTransport sends frames as UDP datagrams.
+
+#if !defined(__TASKMANAGER_TRANSPORT)
+#define __TASKMANAGER_TRANSPORT
+
+/*!	\addtogroup TaskManagerRadioESP
+	@{
+*/
+
+/*!	\class TaskManagerTransport
+	\brief How radio frames get from this node to others.
+
+	A transport is started by TaskManager::radioBegin(nodeId, transport).  The radio transmit task
+	calls send() for each frame.  Every send() that returns tmtOk must be followed, now or later and
+	in order, by exactly one call to sent() with the result.  A transport that knows which node a
+	result is for should say so, so a result that comes after its frame has timed out is not taken
+	for a later frame's.  Frames that arrive are passed to
+	received(), from any one context (an interrupt or WiFi task is fine).  poll() is called on each
+	pass of the radio receiver task, for transports that have to look for frames.
+
+	Transports that need peers registered before sending (as ESP-NOW does) implement addPeer() and
+	delPeer(); TaskManager keeps an LRU cache of registered peers on top of them.
+*/
+class TaskManagerTransport {
+public:
+	/*!	\enum Status
+		Results of transport operations
+	*/
+	enum Status {
+		tmtOk,			//!<	Done
+		tmtFull,		//!<	The peer table is full
+		tmtExists,		//!<	The peer is already registered
+		tmtNotFound,	//!<	The peer is not registered
+		tmtError		//!<	Anything else
+	};
+	virtual ~TaskManagerTransport() {}
+	/*!	\brief Start the transport
+		\param nodeId -- this node's ID
+		\returns true if the transport started
+	*/
+	virtual bool begin(tm_nodeId_t nodeId) = 0;
+	/*!	\brief Send a frame to a node
+		\param nodeId -- the node
+		\param frame -- the frame
+		\param len -- the length of the frame, at most TASKMGR_MAX_PAYLOAD bytes
+		\returns tmtOk if the frame is on its way; sent() will then report on it
+		\note nodeId may be TASKMGR_BROADCAST_NODE, for every node in range.
+	*/
+	virtual Status send(tm_nodeId_t nodeId, const byte* frame, int len) = 0;
+	/*!	\brief Register a node before sending to it.  The default does nothing.
+	*/
+	virtual Status addPeer(tm_nodeId_t nodeId) { (void)nodeId; return tmtOk; }
+	/*!	\brief Unregister a node.  The default does nothing.
+	*/
+	virtual Status delPeer(tm_nodeId_t nodeId) { (void)nodeId; return tmtOk; }
+	/*!	\brief Look for received frames.  The default does nothing.
+	*/
+	virtual void poll() {}
+protected:
+	static void received(const byte* frame, int len);
+	static void sent(bool ok);
+	static void sent(tm_nodeId_t nodeId, bool ok);
+};
+
+#if defined(ARDUINO_ARCH_ESP32) || defined(DOXYGEN_ALL)
+/*!	\def TASKMGR_UDP_BASE_PORT
+	The UDP port of node 0 for TaskManagerUdpTransport.  Node n uses TASKMGR_UDP_BASE_PORT+n.
+*/
+#define TASKMGR_UDP_BASE_PORT 47000
+
+/*!	\def TASKMGR_UDP_MAX_NODE
+	The highest node ID a TaskManagerUdpTransport broadcast is sent to, by default.
+*/
+#define TASKMGR_UDP_MAX_NODE 32
+
+/*!	\class TaskManagerUdpTransport
+	\brief A transport that sends frames as UDP datagrams.
+
+	All nodes are at one IPv4 address (by default 127.0.0.1) and node n listens on port
+	basePort+n.  With the loopback address, several TaskManager nodes can run as processes on one
+	host, which makes it possible to try out and benchmark networked programs without radios.
+	The sockets API is all it needs, so it also runs on ESP-32 once WiFi is up, and in a Linux
+	host build with the MeshSim shims (see test/UdpMesh).
+	A broadcast is sent to each node up to maxNode in turn.
+*/
+class TaskManagerUdpTransport : public TaskManagerTransport {
+public:
+	/*!	\brief Describe the transport.  Nothing is opened until begin().
+		\param basePort -- the port of node 0
+		\param host -- the IPv4 address of every node, in host byte order
+		\param maxNode -- the highest node ID a broadcast is sent to
+	*/
+	TaskManagerUdpTransport(uint16_t basePort=TASKMGR_UDP_BASE_PORT, uint32_t host=0x7f000001UL,
+			tm_nodeId_t maxNode=TASKMGR_UDP_MAX_NODE)
+		: m_socket(-1), m_basePort(basePort), m_host(host), m_nodeId(0), m_maxNode(maxNode) {}
+	virtual ~TaskManagerUdpTransport();
+	virtual bool begin(tm_nodeId_t nodeId);
+	virtual Status send(tm_nodeId_t nodeId, const byte* frame, int len);
+	virtual void poll();
+	/*!	\brief Return the socket, so a host program can wait for frames with select() or poll()
+		\returns the socket's file descriptor, or -1 before begin()
+	*/
+	int fd() const { return m_socket; }
+private:
+	bool sendTo(tm_nodeId_t nodeId, const byte* frame, int len);
+	int m_socket;
+	uint16_t m_basePort;
+	uint32_t m_host;
+	tm_nodeId_t m_nodeId;
+	tm_nodeId_t m_maxNode;
+};
+#endif // ESP32: sockets
+
+/*! @}
+*/
+
+#endif // __TASKMANAGER_TRANSPORT
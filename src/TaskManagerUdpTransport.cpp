@@ -0,0 +1,92 @@
+//
+//	Implementation file for the TaskManager UDP transport
+//
+//	Sends radio frames between nodes as UDP datagrams, node n on port basePort+n.
+//	On ESP-32 the sockets come from lwIP.  Elsewhere (a Linux or macOS host build, such as
+//	test/UdpMesh) they come from the POSIX headers.
+//
+
+#include <arduino.h>
+#include <TaskManagerCore.h>
+
+#if TM_USING_RADIO && defined(ARDUINO_ARCH_ESP32)
+
+#if defined(ESP_PLATFORM)
+#include <lwip/sockets.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#else
+#error "TaskManagerUdpTransport needs lwIP (ESP-32) or POSIX sockets"
+#endif
+#include <fcntl.h>
+
+/*! \file TaskManagerUdpTransport.cpp
+    Implementation file for TaskManagerUdpTransport
+*/
+
+TaskManagerUdpTransport::~TaskManagerUdpTransport() {
+	if(m_socket>=0) close(m_socket);
+}
+
+/*!	\brief Open a non-blocking socket on this node's port
+	\param nodeId -- this node's ID
+	\returns true if the socket is open
+*/
+bool TaskManagerUdpTransport::begin(tm_nodeId_t nodeId) {
+	struct sockaddr_in addr;
+	m_nodeId = nodeId;
+	m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if(m_socket<0) return false;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(m_basePort+nodeId);
+	addr.sin_addr.s_addr = htonl(m_host);
+	if(bind(m_socket, (struct sockaddr*)&addr, sizeof(addr))<0
+			|| fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL, 0)|O_NONBLOCK)<0) {
+		close(m_socket);
+		m_socket = -1;
+		return false;
+	}
+	return true;
+}
+
+/*!	\brief Send a frame as one datagram to one node
+*/
+bool TaskManagerUdpTransport::sendTo(tm_nodeId_t nodeId, const byte* frame, int len) {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(m_basePort+nodeId);
+	addr.sin_addr.s_addr = htonl(m_host);
+	return sendto(m_socket, frame, len, 0, (struct sockaddr*)&addr, sizeof(addr))==len;
+}
+
+/*!	\brief Send a frame as one datagram, or one to each other node for a broadcast.  The result is reported at once.
+*/
+TaskManagerTransport::Status TaskManagerUdpTransport::send(tm_nodeId_t nodeId, const byte* frame, int len) {
+	if(nodeId==TASKMGR_BROADCAST_NODE) {
+		for(tm_nodeId_t n=1; n<=m_maxNode; n++) {
+			if(n!=m_nodeId) sendTo(n, frame, len);	// nobody may be there
+		}
+	} else if(!sendTo(nodeId, frame, len)) {
+		return tmtError;
+	}
+	sent(nodeId, true);
+	return tmtOk;
+}
+
+/*!	\brief Pass every waiting datagram to the radio receiver
+*/
+void TaskManagerUdpTransport::poll() {
+	byte frame[TASKMGR_MAX_PAYLOAD];
+	int len;
+	while((len=recvfrom(m_socket, frame, sizeof(frame), 0, NULL, NULL))>0) {
+		received(frame, len);
+	}
+}
+
+#endif // radio && ESP32 (or a host build with the ESP-32 shims)
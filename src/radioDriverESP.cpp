@@ -26,6 +26,7 @@
 
 #include <TaskManagerCore.h>
 #include "radioDriverESP.h"
+#include <TaskManagerCompress.h>
 
 // Get rid of DEBUG at some point
 #define DEBUG false
@@ -53,10 +54,12 @@ static void radioReceiverTask() {
 	TaskMgr.tmRadioReceiverTask();
 }
 
-// Semaphore to coordinate queue calls (so we don't call add (from the receive callback) while we
-// are in the middle of a remove).
-//static SemaphoreHandle_t _TaskManagerMessageQueueSemaphore;
-
+/*!	\brief Radio transmit task.
+	Hands queued frames to ESP-NOW and collects their send results.
+*/
+static void radioTxTask() {
+	TaskMgr.tmRadioTxTask();
+}
 
 // Configuration
 //	Which WiFi channel to use
@@ -97,120 +100,217 @@ static char* espErrText(esp_err_t err) {
 // Incoming message queue
 //
 // Design note:  TaskManager will be using _TaskManagerRadioPacket objects to transport data between
-// nodes.  The message queue will send full packets and just absorb whatever returns.
+// nodes.  Only the header and the part of m_data in use are sent, so frames vary in length.
 // Also, the HAL will read/write arbitrary buffers.
 // So:  The HAL will expect a uint8_t* buffer and a size.  It will send or receive it.  The high level
-// routine will pass in the uint8_t* buffer and a size of sizeof(_TaskManagerRadioPacket).  When polling
-// the message queue, it will provide a buffer and a short* in return, even though the short* will always
-// receive sizeof(_TaskManagerRadioPacket)
+// routine will pass in the uint8_t* buffer and the number of bytes in use.  The receive callback
+// copies the bytes in use into a slot of the queue, and the receiver task processes the frame
+// where it lies (m_rxPacket) and frees the slot when it is done, so a message is copied only once
+// more, into its task.  The receiver task derives the message length from the frame length.
 // Note that the radio packet will contain a short nodeID and a byte taskID.
+// The queue itself (MessageQueue) is declared in radioDriverESP.h.
 //
 
-/*!	\class MessageQueue
-	The queue of incoming messages.  Messages are added by the interrupt handler and removed by the
-	radio receiver task.
-	
-	If the buffer is full, new messages are discarded.
-*/
-class MessageQueue {
-  private:
-	_TaskManagerRadioPacket m_packets[TASKMGR_MESSAGE_QUEUE_SIZE];
-	short m_lengths[TASKMGR_MESSAGE_QUEUE_SIZE];
-	bool m_isEmpty;
-	short m_head;	// oldest entry
-	short m_tail;	// newest entry
-  public:
-  	MessageQueue(): m_isEmpty(true), m_head(0), m_tail(0) {};
-	//! \brief Tells whether or not the message queue is empty.
-	bool isEmpty() { return m_isEmpty; }
-	bool add(const uint8_t* dat, const byte len);
-	bool remove(uint8_t* dat, byte* len);
-	/*!	\brief Return the size of the message queue.  Return 0 if the queue is empty.
-	*/
-	short size() {
-		if(isEmpty()) return 0;
-		else if(m_tail<=m_head) return m_head-m_tail+1;
-		else return (m_head+TASKMGR_MESSAGE_QUEUE_SIZE)-m_tail;
-	}
-};
-
-#if false	// old ff debug stuff
-struct tmpStruct { byte cmd; byte fromTaskId; tm_nodeId_t fromNodeId; byte ffcmd; uint32_t seq; };
-#endif
+/*!	\brief Tell whether a frame goes in the control lane.
 
+	Everything but messages to and from ordinary tasks is control.  The frame carried by a
+	tmrReliable or tmrRouted frame decides where it goes.
+	\param dat - the frame
+	\param len - the length of the frame
+*/
+bool MessageQueue::isControl(const uint8_t* dat, const byte len) {
+	const _TaskManagerRadioPacket* packet = (const _TaskManagerRadioPacket*)dat;
+	const byte* data = packet->m_data;
+	int n = len-TASKMGR_RADIO_HEADER_SIZE;
+	byte cmd = packet->m_cmd;
+	if(cmd==TaskManager::tmrReliable && n>=TASKMGR_RELIABLE_HEADER_SIZE) {
+		cmd = data[3]&~TASKMGR_RELIABLE_ACK_VALID;
+		data += TASKMGR_RELIABLE_HEADER_SIZE;
+		n -= TASKMGR_RELIABLE_HEADER_SIZE;
+	}
+	if(cmd==TaskManager::tmrRouted && n>=TASKMGR_ROUTE_HEADER_SIZE) {
+		cmd = data[5];
+		data += TASKMGR_ROUTE_HEADER_SIZE;
+		n -= TASKMGR_ROUTE_HEADER_SIZE;
+	}
+	switch(cmd) {
+		case TaskManager::tmrMessage:
+		case TaskManager::tmrCompressed:
+			return packet->m_fromTaskId>=TASKMGR_SYSTEM_TASK_BASE || (n>=1 && data[0]>=TASKMGR_SYSTEM_TASK_BASE);
+		case TaskManager::tmrMulti:
+		case TaskManager::tmrFragment:
+		case TaskManager::tmrGroup:
+		case TaskManager::tmrReliable:
+		case TaskManager::tmrRouted:
+			return false;
+		default:
+			return true;
+	}
+}
 
 /*! \brief Add a message to the message queue.
 	The given message is added to the message queue at the end of the queue.
-	If the queue is full, the message is discarded.
+	If the queue is full, the message is discarded.  Called only from the receive callback.
 	\param dat - a pointer to the byte array of the message.
 	\param len - the length of the message, in bytes
 	\returns true if the message was added, false if discarded.
 */
 bool MessageQueue::add(const uint8_t* dat, const byte len) {
-	// if we can't grab the semaphore in a ms, just ignore the message.
-	bool ret;
-#if false	// old ff debug stuff
-	tmpStruct* ts;
-	ts = (tmpStruct*)dat;
-	if(DEBUG) Serial << "-->MessageQueue::add cmd: " << ts->cmd
-		<< " from: " << ts->fromNodeId << ' ' << ts->fromTaskId
-		<< " ffcmd: " << ts->ffcmd << " ffseq: " << ts->seq << endl;
-#endif
-	if(xSemaphoreTake(TaskMgr.m_TaskManagerMessageQueueSemaphore,1000)==pdFALSE) {
-		return false;
-	}
-    if(m_isEmpty) {
-        m_isEmpty = false;
-        memcpy(&m_packets[m_tail], dat, len);
-        m_lengths[m_tail] = len;
-		ret = true;
-    } else if (m_head==((m_tail+1)%TASKMGR_MESSAGE_QUEUE_SIZE)) {
-        Serial.print("<receive buffer full, incoming message ignored>\n");
-		ret = false;
-    } else {
-        m_tail = (m_tail+1)%TASKMGR_MESSAGE_QUEUE_SIZE;
-        memcpy(&m_packets[m_tail], dat, len);
-        m_lengths[m_tail] = len;
-		ret = true;
-    }
-    xSemaphoreGive(TaskMgr.m_TaskManagerMessageQueueSemaphore);
-    if(DEBUG) Serial << "<--MessageQueue::add\n";
-	return ret;
-};
-/*! \brief Remove a message from the queue.
-	Removes a message from the queue.  Returns true if a message could be removed;
-	false if the queue was empty.
-	Note that the buffer should be sufficiently large to hold any sized message.
-	\param dat - a pointer to a message buffer
-	\param len - the number of bytes returned.
-	\returns true if the message was saved, false if not saved.
-*/
-bool MessageQueue::remove(uint8_t* dat, byte* len) {
-	int t_at, t_len;
-	bool ret;
-	if(xSemaphoreTake(TaskMgr.m_TaskManagerMessageQueueSemaphore,1000)==pdFALSE) return false;
-    if(m_isEmpty) {
-		xSemaphoreGive(TaskMgr.m_TaskManagerMessageQueueSemaphore);
-        printf("<empty>");
-        return false;;
-    } else if(m_head==m_tail) {
-        memcpy(dat, &m_packets[m_head], sizeof(_TaskManagerRadioPacket));
-        *len = m_lengths[m_head];
-        t_at = m_head; t_len = *len;
-        m_isEmpty = true;
-		ret = true;
-    } else {
-        memcpy(dat, &m_packets[m_head], sizeof(_TaskManagerRadioPacket));
-        *len = m_lengths[m_head];
-        t_at = m_head; t_len = *len;
-        m_head = (m_head+1) % TASKMGR_MESSAGE_QUEUE_SIZE;
-		ret = true;
-    }
-    xSemaphoreGive(TaskMgr.m_TaskManagerMessageQueueSemaphore);
-    return ret;
+	_TaskManagerRadioFrame* frame;
+	bool control;
+	if(len<TASKMGR_RADIO_HEADER_SIZE || len>sizeof(_TaskManagerRadioPacket)) return false;
+	control = isControl(dat, len);
+	frame = control ? m_control.reserve() : m_frames.reserve();
+	if(frame==NULL) return false;	// full; counted by the ring
+	memcpy(&frame->m_packet, dat, len);
+	frame->m_len = len;
+	if(control) m_control.commit();
+	else m_frames.commit();
+	return true;
 };
 
+/*!	\brief Return the oldest control frame, or if there is none the oldest message, left in the
+	queue.  Returns NULL if the queue is empty.  Called only from the radio receiver task.
+*/
+_TaskManagerRadioFrame* MessageQueue::front() {
+	_TaskManagerRadioFrame* frame = m_control.peek();
+	m_frontControl = frame!=NULL;
+	return m_frontControl ? frame : m_frames.peek();
+}
+
 static MessageQueue _TaskManagerIncomingMessages;
+static TaskManagerReceiveStats _TaskManagerReceiveStats;
+
+//
+// Outgoing aggregation
+//
+// Messages to the same node can be held briefly and packed into one tmrMulti frame.  The frame
+// is the usual header (source task unused) followed by records of
+// [target task][source task][length][message].
+//
+
+/*!	\struct _TaskManagerRadioAggregate
+	Messages waiting to be sent to one node in a single tmrMulti frame.
+*/
+struct _TaskManagerRadioAggregate {
+	tm_nodeId_t m_nodeId;		// destination
+	byte m_len;					// bytes of m_frame in use; 0 if the slot is free
+	unsigned long m_started;	// millis() when the first message was added
+	byte m_frame[sizeof(_TaskManagerRadioPacket)];
+};
+
+static _TaskManagerRadioAggregate _TaskManagerOutgoing[TASKMGR_RADIO_AGG_SLOTS];
+
+static void reassemblyExpire();
+static tm_nodeId_t routeNextHop(tm_nodeId_t nodeId);
+static bool groupMember(byte groupId);
+static void routeLearn(tm_nodeId_t nodeId, tm_nodeId_t nextHop, byte hops);
+static void compressSent(bool queued);
+
+//
+// Transmit queue
+//
+// Frames are not sent by the task that builds them.  radioTransmit() queues them, and the radio
+// transmit task hands them to ESP-NOW, keeping at most TASKMGR_RADIO_TX_INFLIGHT frames waiting
+// for their send callback.  msg_send_cb() passes each result back through a lock-free ring, and
+// the transmit task reports it to the sending task's hook (see setRadioSendHook()).
+//
+
+/*!	\struct _TaskManagerTxFrame
+	A frame waiting for the radio transmit task.
+*/
+struct _TaskManagerTxFrame {
+	tm_nodeId_t m_nodeId;		// destination
+	tm_taskId_t m_fromTaskId;	// the task that sent it
+	byte m_len;					// bytes of m_frame in use
+	byte m_frame[sizeof(_TaskManagerRadioPacket)];
+};
+
+/*!	\struct _TaskManagerTxResult
+	A send result, from the transport to the transmit task.
+*/
+struct _TaskManagerTxResult {
+	tm_nodeId_t m_nodeId;		// the node the frame was sent to; 0 if the transport did not say
+	bool m_ok;					// true if delivered
+};
+
+/*!	\struct _TaskManagerTxInFlight
+	A frame handed to ESP-NOW whose send callback has not arrived.
+*/
+struct _TaskManagerTxInFlight {
+	tm_nodeId_t m_nodeId;
+	tm_taskId_t m_fromTaskId;
+	unsigned long m_sentAt;		// millis() when handed to ESP-NOW
+};
+
+static spscRing<_TaskManagerTxFrame, TASKMGR_RADIO_TX_QUEUE_SIZE> _TaskManagerTxQueue;
+// frames from system tasks, which are never held
+static spscRing<_TaskManagerTxFrame, TASKMGR_RADIO_TX_SYSTEM_QUEUE_SIZE> _TaskManagerTxSystemQueue;
+// send results, from the transport to the transmit task
+static spscRing<_TaskManagerTxResult, TASKMGR_RADIO_TX_QUEUE_SIZE> _TaskManagerTxResults;
+// oldest first.  Used only by the transmit task.
+static _TaskManagerTxInFlight _TaskManagerTxPending[TASKMGR_RADIO_TX_INFLIGHT];
+static byte _TaskManagerTxPendingHead = 0;
+static byte _TaskManagerTxPendingCount = 0;
+static unsigned long _TaskManagerTxFailures = 0;
+static bool _TaskManagerTxHeld = false;		// the frame at the head of _TaskManagerTxQueue is over its rate limit
+
+//
+// Rate limits
+//
+// Each destination node and each sending task can have a token bucket.  Tokens are kept in
+// thousandths of a frame, so a rate in frames/s refills one per ms per frame/s.  Buckets live in
+// small LRU tables; a node or task that loses its slot starts again with a full bucket.  A node's
+// bucket also carries its run of failed sends, for backoff.
+//
+
+/*!	\struct _TaskManagerRateBucket
+	The token bucket of a destination node or sending task.
+*/
+struct _TaskManagerRateBucket {
+	tm_nodeId_t m_id;			// the node or task
+	bool m_inUse;				// false if the slot is free
+	byte m_fails;				// failed sends in a row (nodes only)
+	unsigned long m_tokens;		// thousandths of a frame
+	unsigned long m_refilled;	// millis() when last refilled
+	unsigned long m_holdUntil;	// millis() until which sending is held off (nodes only)
+	unsigned long m_used;		// _TaskManagerRateClock when last used
+};
+
+static _TaskManagerRateBucket _TaskManagerNodeRates[TASKMGR_RATE_SLOTS];
+static _TaskManagerRateBucket _TaskManagerTaskRates[TASKMGR_RATE_SLOTS];
+static unsigned long _TaskManagerRateClock = 0;
+static unsigned long _TaskManagerRateDrops = 0;
+static unsigned long _TaskManagerBackoffs = 0;
+
+//
+// Peer cache
+//
+// ESP-NOW can only send to registered peers, and it can only register ESP_NOW_MAX_TOTAL_PEER_NUM
+// of them.  Nodes are registered when first sent to and stay registered; when the table is full,
+// the node sent to least recently is unregistered to make room.
+//
+
+/*!	\struct _TaskManagerPeerEntry
+	A node registered with ESP-NOW.
+*/
+struct _TaskManagerPeerEntry {
+	tm_nodeId_t m_nodeId;		// 0 if the entry is free
+	unsigned long m_lastUsed;	// _TaskManagerPeerClock when last sent to
+};
+
+static _TaskManagerPeerEntry _TaskManagerPeers[TASKMGR_PEER_CACHE_SIZE];
+static unsigned long _TaskManagerPeerClock = 0;
+static unsigned long _TaskManagerPeerHits = 0;
+static unsigned long _TaskManagerPeerMisses = 0;
+
+/*!	\brief Remove a node from the peer cache, without unregistering it
+*/
+static void peerCacheForget(tm_nodeId_t nodeId) {
+	for(int i=0; i<TASKMGR_PEER_CACHE_SIZE; i++) {
+		if(_TaskManagerPeers[i].m_nodeId==nodeId) _TaskManagerPeers[i].m_nodeId = 0;
+	}
+}
 
 // shared buf for MAC address; last two bytes are set to nodeID
 static byte nodeMac[6] = { 0xA6, 'T', 'M', 0, 0, 0};
@@ -220,9 +320,12 @@ static byte nodeMac[6] = { 0xA6, 'T', 'M', 0, 0, 0};
 //
 static void msg_send_cb(const uint8_t* mac, esp_now_send_status_t sendStatus) {
 	// We sent a message to the designated mac.  The message was sent with
-	// sendStatus status.
-
-	// for now, do nothing.
+	// sendStatus status.  The last two bytes of the mac are the node, which
+	// the transmit task matches to its frames in flight.
+	_TaskManagerTxResult result;
+	result.m_nodeId = mac==NULL ? 0 : (mac[4]<<8) | mac[5];
+	result.m_ok = sendStatus==ESP_NOW_SEND_SUCCESS;
+	_TaskManagerTxResults.push(result);
 }
 
 #if defined(NEWAPI)
@@ -232,7 +335,7 @@ static void msg_recv_cb(const uint8_t *mac, const uint8_t* data, int len) {
 #endif
 	// We have received a message from the given MAC with the accompanying data.
 	// Save the data in the "incoming message" queue
-	// We don't use taskENTER_CRITICAL here because 'add' does it as needed.
+	// The queue is lock-free, so this never blocks the WiFi task.
 	if(DEBUG) Serial << "-->msg_recv_cb\nreceived message len=" << len << "\n";
 	_TaskManagerIncomingMessages.add(data, len&0x0ff);
 	if(DEBUG) Serial << "Queue is now " << (_TaskManagerIncomingMessages.isEmpty() ? " " : "not ") << "empty\n";
@@ -240,196 +343,2078 @@ static void msg_recv_cb(const uint8_t *mac, const uint8_t* data, int len) {
 	if(DEBUG) Serial << "<--msg_recv_cb\n";
 }
 
-// General purpose receiver.  Checks the message queue for delivered messages and processes the first one
+void TaskManagerTransport::received(const byte* frame, int len) {
+	_TaskManagerIncomingMessages.add(frame, len&0x0ff);
+}
+
+void TaskManagerTransport::sent(bool ok) {
+	sent(0, ok);
+}
+
+void TaskManagerTransport::sent(tm_nodeId_t nodeId, bool ok) {
+	_TaskManagerTxResult result;
+	result.m_nodeId = nodeId;
+	result.m_ok = ok;
+	_TaskManagerTxResults.push(result);
+}
+
+// General purpose receiver.  Checks the message queue for delivered messages and processes them,
+// as many as the receive budget allows
 void TaskManager::tmRadioReceiverTask() {
-	static byte len;
+	_TaskManagerRadioFrame* frame;
+	unsigned long started = micros();
+	int budget = m_radioRxBudget<<m_radioRxScale;
+	int count = 0;
 	// polled receiver -- if there is a packet waiting, grab and process it
 	// receive packet from ESP radio mgmt..  Poll and process messages
 	// We need to find the destination task and save the fromNode and fromTask.
 	// They are saved on the task instead of the TaskManager object in case several
 	// messages/signals have been received.
-	while(true) {	// process all messages
-		if(_TaskManagerIncomingMessages.isEmpty()) {
-			break;
-//			return;
-		}
+	m_transport->poll();
+	_TaskManagerReceiveStats.m_passes++;
+	_TaskManagerReceiveStats.m_depth = _TaskManagerIncomingMessages.size();
+	if(_TaskManagerReceiveStats.m_depth>_TaskManagerReceiveStats.m_maxDepth) _TaskManagerReceiveStats.m_maxDepth = _TaskManagerReceiveStats.m_depth;
+	// a time budget (setBudget()) is scaled with the frame budget
+	if(m_budgetActive && m_radioRxScale!=0) m_dispatchDeadline += m_theTasks.front().m_budgetUs*((1UL<<m_radioRxScale)-1);
+	while((frame=_TaskManagerIncomingMessages.front())!=NULL) {	// process messages
+		if(count!=0 && ((budget!=0 && count>=budget) || overBudget())) break;
+		count++;
 		if(DEBUG) Serial << "-->TaskManagerESP::tmRadioReceiverTask\n";
-		// read a packet
-		//m_rf24->read((void*)(&radioBuf), sizeof(radioBuf));
-		_TaskManagerIncomingMessages.remove((uint8_t*)&radioBuf, &len);
-		// process it
-		switch(radioBuf.m_cmd) {
-			case tmrNoop:
-				break;
-			case tmrStatus:	// NYI
-				break;
-			case tmrAck:	// NYI
-				break;
-			case tmrTaskStatus:	// NYI
-				break;
-			case tmrTaskAck:	// NYI
-				break;
-			case tmrMessage:
-				if(DEBUG) Serial << "radioReceiverTask: msg from n/t " << radioBuf.m_fromNodeId << "/" << radioBuf.m_fromTaskId 
-					<< " for task " << radioBuf.m_data[0] << endl;
-				internalSendMessage(radioBuf.m_fromNodeId, radioBuf.m_fromTaskId,
-					radioBuf.m_data[0], &radioBuf.m_data[1], TASKMGR_MESSAGE_SIZE);
-				break;
-			case tmrSuspend:
-				TaskManager::suspend(radioBuf.m_data[0]);
-				break;
-			case tmrResume:
-				TaskManager::resume(radioBuf.m_data[0]);
-				break;
-		} // end switch
+		// process the packet where the receive callback left it
+		m_rxPacket = &frame->m_packet;
+		// whoever sent it directly is a neighbour
+		if(m_radioRouteInterval!=0 && m_rxPacket->m_fromNodeId!=0) routeLearn(m_rxPacket->m_fromNodeId, m_rxPacket->m_fromNodeId, 1);
+		radioDispatch(frame->m_len);
+		_TaskManagerIncomingMessages.pop();
 		if(DEBUG) Serial << "<--TaskManager:tmRadioReceiverTask finished a message\n";
 		if(DEBUG) Serial << "   Queue is now " << (_TaskManagerIncomingMessages.isEmpty() ? " " : "not ") << "empty\n";
 		if(DEBUG) Serial << "   Queue size is now " << _TaskManagerIncomingMessages.size() << endl;
 	}  // end while true
+	started = micros()-started;
+	_TaskManagerReceiveStats.m_frames += count;
+	if(started>_TaskManagerReceiveStats.m_maxPassUs) _TaskManagerReceiveStats.m_maxPassUs = started;
+	// grow the budget while frames are backed up, up to the whole queue, and shrink it back as they clear
+	if(!_TaskManagerIncomingMessages.isEmpty()) {
+		_TaskManagerReceiveStats.m_budgetStops++;
+		if(((m_radioRxBudget!=0 ? m_radioRxBudget : 1)<<m_radioRxScale)<TASKMGR_MESSAGE_QUEUE_SIZE+TASKMGR_CONTROL_QUEUE_SIZE) m_radioRxScale++;
+	} else if(m_radioRxScale!=0) {
+		m_radioRxScale--;
+	}
+	_TaskManagerReceiveStats.m_budget = m_radioRxBudget<<m_radioRxScale;
+	// send any aggregated frames whose window has ended
+	if(m_radioAggWindow!=0) radioFlush(0, true);
+	// send due acks and retransmit unacknowledged frames
+	radioReliableService();
+	// send fragments that were waiting for room in the reliable window
+	radioFragmentService();
+	// give up on fragmented messages that are taking too long
+	reassemblyExpire();
+	// pass on held frames and tell neighbours about routes
+	radioRouteService();
+	// answer a status request from this node
+	radioStatusLocal();
+}
+
+/*!	\brief Process the frame in m_rxPacket->  Internal routine.
+	\param len - the length of the frame
+*/
+void TaskManager::radioDispatch(int len) {
+	switch(m_rxPacket->m_cmd) {
+		case tmrNoop:
+			break;
+		case tmrStatus:
+		case tmrTaskStatus:
+			radioStatusReply(len);
+			break;
+		case tmrAck:
+		case tmrTaskAck:
+			// status replies go to the asking task, from the radio receiver
+			if(len<(int)TASKMGR_RADIO_HEADER_SIZE+1) break;
+			internalSendMessage(m_rxPacket->m_fromNodeId, TASKMGR_RF_MONITOR_TASK,
+				m_rxPacket->m_data[0], &m_rxPacket->m_data[1], len-TASKMGR_RADIO_HEADER_SIZE-1);
+			break;
+		case tmrMessage:
+			if(DEBUG) Serial << "radioReceiverTask: msg from n/t " << m_rxPacket->m_fromNodeId << "/" << m_rxPacket->m_fromTaskId 
+				<< " for task " << m_rxPacket->m_data[0] << endl;
+			// the message is whatever follows the header and target task
+			if(len<(int)TASKMGR_RADIO_HEADER_SIZE+1) break;
+			internalSendMessage(m_rxPacket->m_fromNodeId, m_rxPacket->m_fromTaskId,
+				m_rxPacket->m_data[0], &m_rxPacket->m_data[1], len-TASKMGR_RADIO_HEADER_SIZE-1);
+			break;
+		case tmrSuspend:
+			TaskManager::suspend(m_rxPacket->m_data[0]);
+			break;
+		case tmrResume:
+			TaskManager::resume(m_rxPacket->m_data[0]);
+			break;
+		case tmrMulti: {
+			// records follow the header:  target task, source task, length, message
+			byte* rec = (byte*)m_rxPacket;
+			for(int at=TASKMGR_RADIO_HEADER_SIZE;
+					at+TASKMGR_RADIO_RECORD_HEADER_SIZE<=len && at+TASKMGR_RADIO_RECORD_HEADER_SIZE+rec[at+2]<=len;
+					at += TASKMGR_RADIO_RECORD_HEADER_SIZE+rec[at+2]) {
+				internalSendMessage(m_rxPacket->m_fromNodeId, rec[at+1], rec[at],
+					&rec[at+TASKMGR_RADIO_RECORD_HEADER_SIZE], rec[at+2]);
+			}
+			break;
+		}
+		case tmrReliable:
+			// a frame to pass on that can't be held is not acked, so it will be sent again
+			if(radioRouteCannotHold(len)) break;
+			// radioReliableReceive() strips the reliability header unless this is a duplicate
+			if(radioReliableReceive(len)) radioDispatch(len-TASKMGR_RELIABLE_HEADER_SIZE);
+			break;
+		case tmrReliableAck:
+			radioReliableReceive(len);
+			break;
+		case tmrFragment:
+			radioReassemble(len);
+			break;
+		case tmrRouted:
+			radioRouteReceive(len);
+			break;
+		case tmrRoute:
+			radioRouteAdvert(len);
+			break;
+		case tmrGroup:
+			if(len<(int)TASKMGR_RADIO_HEADER_SIZE+2 || !groupMember(m_rxPacket->m_data[0])) break;
+			internalSendMessage(m_rxPacket->m_fromNodeId, m_rxPacket->m_fromTaskId,
+				m_rxPacket->m_data[1], &m_rxPacket->m_data[2], len-TASKMGR_RADIO_HEADER_SIZE-2);
+			break;
+		case tmrCompressed:
+			radioDecompress(len);
+			break;
+	} // end switch
 }
 
 // General purpose sender.  Sends a message somewhere (varying with the kind of radio)
 /*!	\brief Generic packet sender
 	TaskManager.radioBuf contains a complete formatted packet of information to 
-	send to the designated node.  radioSender(node) sends the packet to the node.
+	send to the designated node.  radioSender(node, len) sends the first len bytes of the
+	packet to the node.  The receiver recovers the message length from the frame length.
 	
 	This routine is only present in radio-enabled environments.  It is implemented 
 	in the driver module.
 	\param node - The target node
-	\returns - boolean, true if the remote node received the packet (low-level receive).  This
-	does not guarantee that the task has received the packet.
+	\param len - The number of bytes of radioBuf to send:  TASKMGR_RADIO_HEADER_SIZE plus the m_data bytes in use.
+	\returns - boolean, true if the packet was queued for the radio transmit task.  The result of the
+	send is reported later (see setRadioSendHook()).  If compression is on (see setRadioCompression()),
+	a tmrMessage packet may be sent as a tmrCompressed one.  If aggregation is on (see
+	setRadioAggregation()), a tmrMessage packet may be held to share a frame; the return is then true.
 */
-bool TaskManager::radioSender(tm_nodeId_t destNodeID) {
-//Serial << "radioSender, sending to node " << destNodeID << " from n/t " 
-//<< radioBuf.m_fromNodeId << "/" << radioBuf.m_fromTaskId 
-//<< " for t " << radioBuf.m_data[0] << " swarm cmd " << radioBuf.m_data[1] << endl;
-	nodeMac[4] = (destNodeID>>8)&0x0ff;
-	nodeMac[5] = destNodeID&0x0ff;
-	m_lastESPError = esp_now_send(nodeMac, (byte*)&radioBuf, sizeof(radioBuf));
-//Serial << "radioSender, error code is " << m_lastESPError << endl;
-	if(m_lastESPError!=ESP_OK) Serial << "***ERR " << espErrText(m_lastESPError) << " sending to node " << destNodeID << "***\n";
-	return m_lastESPError == ESP_OK;
+bool TaskManager::radioSender(tm_nodeId_t destNodeID, int len) {
+	bool queued;
+	if(m_radioCompress && radioBuf.m_cmd==tmrMessage) len = radioCompress(destNodeID, len);
+	if(m_radioAggWindow!=0) {
+		if(radioBuf.m_cmd==tmrMessage && radioAggregate(destNodeID, len)) return true;
+		radioFlush(destNodeID, false);	// keep packets to this node in order
+	}
+	queued = radioSendFrame(destNodeID, (byte*)&radioBuf, len);
+	compressSent(queued);
+	return queued;
 }
 
-// If we have different radio receivers, they will have different instantiation routines.
+/*!	\brief Send a frame to a node.  Internal routine.
 
-bool TaskManager::radioBegin(tm_nodeId_t nodeID, const char* ssid, const char* pw) {
-	// Initialize ESP-NOW and WiFi system
-	if(DEBUG) { Serial << "-->radioBegin  nodeID=" << nodeID <<"\n"; }
-	WiFi.mode(ssid==NULL ? WIFI_STA : WIFI_AP_STA);
-	if(DEBUG) { Serial << "\tradioBegin: past Wifi.mode()\n"; }
-	nodeMac[4] = (nodeID>>8)&0x0ff;
-	nodeMac[5] = nodeID & 0x0ff;
-#if defined(NEWAPI)
-	m_lastESPError = esp_wifi_set_mac(WIFI_IF_STA, nodeMac);
-#else
-	m_lastESPError = esp_wifi_set_mac(ESP_IF_WIFI_STA, nodeMac);
-#endif
-	if(DEBUG) Serial << "\tradioBegin: past esp_wifi_set_mac()\n";
-	if(m_lastESPError!=ESP_OK) {
-		if(DEBUG) Serial << "<--radioBegin error, can't set_mac()\n";
+	If the node is reached through another (see setRadioRouting()), the frame is sent to the next
+	hop as a tmrRouted frame.
+	\param destNodeID - The target node
+	\param frame - The frame, starting with a _TaskManagerRadioPacket header
+	\param len - The length of the frame
+	\returns - boolean, true if the frame was queued for the radio
+*/
+bool TaskManager::radioSendFrame(tm_nodeId_t destNodeID, const byte* frame, int len) {
+	tm_nodeId_t nextHop = routeNextHop(destNodeID);
+	if(nextHop!=destNodeID && len+TASKMGR_ROUTE_HEADER_SIZE<=(int)sizeof(_TaskManagerRadioPacket)) {
+		byte routed[sizeof(_TaskManagerRadioPacket)];
+		byte* hdr = &routed[TASKMGR_RADIO_HEADER_SIZE];
+		memcpy(routed, frame, TASKMGR_RADIO_HEADER_SIZE);
+		((_TaskManagerRadioPacket*)routed)->m_cmd = tmrRouted;
+		hdr[0] = destNodeID&0x0ff;
+		hdr[1] = (destNodeID>>8)&0x0ff;
+		hdr[2] = myNodeId()&0x0ff;
+		hdr[3] = (myNodeId()>>8)&0x0ff;
+		hdr[4] = TASKMGR_ROUTE_TTL;
+		hdr[5] = frame[0];
+		memcpy(&hdr[TASKMGR_ROUTE_HEADER_SIZE], &frame[TASKMGR_RADIO_HEADER_SIZE], len-TASKMGR_RADIO_HEADER_SIZE);
+		return radioSendHop(nextHop, routed, len+TASKMGR_ROUTE_HEADER_SIZE);
+	}
+	return radioSendHop(destNodeID, frame, len);
+}
+
+/*!	\brief Send a frame to a neighbouring node.  Internal routine.
+
+	If reliable delivery is on (see setRadioReliable()), the frame is sent as a tmrReliable frame,
+	unless it is a broadcast.
+	\param destNodeID - The target node, or TASKMGR_BROADCAST_NODE
+	\param frame - The frame, starting with a _TaskManagerRadioPacket header
+	\param len - The length of the frame
+	\returns - boolean, true if the frame was queued for the radio
+*/
+bool TaskManager::radioSendHop(tm_nodeId_t destNodeID, const byte* frame, int len) {
+	// nobody acks a broadcast
+	if(m_radioReliable && destNodeID!=TASKMGR_BROADCAST_NODE && len+TASKMGR_RELIABLE_HEADER_SIZE<=(int)sizeof(_TaskManagerRadioPacket)) {
+		return radioReliableSend(destNodeID, frame, len);
+	}
+	return radioTransmit(destNodeID, frame, len);
+}
+
+/*!	\brief Queue a frame for the radio transmit task.  Internal routine.
+
+	This never waits for the radio.  A frame that finds the transmit queue full is discarded and
+	counted (see radioSendDrops()).  Frames from system tasks go in a queue of their own.
+	\param destNodeID - The target node
+	\param frame - The frame, starting with a _TaskManagerRadioPacket header
+	\param len - The length of the frame
+	\returns - boolean, true if the frame was queued, false if the transmit queue is full or the
+	frame is over its rate limit (see setRadioRateLimit())
+*/
+bool TaskManager::radioTransmit(tm_nodeId_t destNodeID, const byte* frame, int len) {
+	_TaskManagerTxFrame* f;
+	if(m_radioRateShed && !radioRateAllow(destNodeID, myId())) {
+		_TaskManagerRateDrops++;
 		return false;
 	}
-	if(ssid==NULL) {
-		// ESP-NOW only
-		if(DEBUG) Serial << "\tradioBegin: esp-now only, about to WiFi.disconnect()\n";
-		WiFi.disconnect();
-		if(DEBUG) Serial << "\tradioBegin esp-now only: past Wifi.disconnect()\n";
-	} else {
-		// ESP-NOW, but project uses WiFi
-		// Get channel
-		int32_t channel;
-		channel = 0;
-	  	if (int32_t n = WiFi.scanNetworks()) {
-		  for (uint8_t i=0; i<n; i++) {
-			if (!strcmp(ssid, WiFi.SSID(i).c_str())) {
-			  channel = WiFi.channel(i);
-			} // end if
-		  } // end for each found network entry
-	  	} // end if there are any network entries
-		// Set our channel
-		esp_wifi_set_promiscuous(true);
-		esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
-  		esp_wifi_set_promiscuous(false);
-		if(pw!=NULL) {
-			// we need to configure the WiFi link to the access point
-			WiFi.begin(ssid, pw);
-			for(int i=0; i<10 && WiFi.status()!=WL_CONNECTED; i++) delay(500);
-			if(WiFi.status()!=WL_CONNECTED) {
-				if(DEBUG) Serial << "<--radioBegin error, Wifi.begin(ssid,pw) failed.\n";
-				return false;
+	bool system = myId()>=TASKMGR_SYSTEM_TASK_BASE;
+	f = system ? _TaskManagerTxSystemQueue.reserve() : _TaskManagerTxQueue.reserve();
+	if(f==NULL) return false;
+	f->m_nodeId = destNodeID;
+	f->m_fromTaskId = myId();
+	f->m_len = len;
+	memcpy(f->m_frame, frame, len);
+	if(system) _TaskManagerTxSystemQueue.commit();
+	else _TaskManagerTxQueue.commit();
+	return true;
+}
+
+/*!	\brief Report the result of the oldest frame handed to ESP-NOW.  Internal routine.
+	\param ok - true if ESP-NOW reported the frame delivered
+*/
+void TaskManager::radioTxDone(bool ok) {
+	_TaskManagerTxInFlight* p = &_TaskManagerTxPending[_TaskManagerTxPendingHead];
+	_TaskManagerTxPendingHead = (_TaskManagerTxPendingHead+1)%TASKMGR_RADIO_TX_INFLIGHT;
+	_TaskManagerTxPendingCount--;
+	if(!ok) _TaskManagerTxFailures++;
+	radioRateResult(p->m_nodeId, ok);
+	radioLinkResult(p->m_nodeId, ok);
+	if(m_radioSendHook!=NULL) (m_radioSendHook)(p->m_fromTaskId, p->m_nodeId, ok);
+}
+
+/*!	\brief The radio transmit task.  Internal routine.
+
+	Collects send results, then hands queued frames to the transport until TASKMGR_RADIO_TX_INFLIGHT
+	are waiting for their send results, or the next frame is over its rate limit.  Frames from system
+	tasks go first; they are never held, so a held frame does not stop them.
+
+	Results come in the order the frames were sent.  A result that names its node goes to the oldest
+	frame in flight to that node; frames in flight ahead of it lost their results, and are counted as
+	failed.  A result for a node with no frame in flight is late, for a frame already timed out, and
+	is dropped.  A result that does not name its node goes to the oldest frame in flight.
+*/
+void TaskManager::tmRadioTxTask() {
+	_TaskManagerTxResult* result;
+	_TaskManagerTxFrame* f;
+	_TaskManagerTxHeld = false;
+	while(true) {
+		while((result=_TaskManagerTxResults.peek())!=NULL) {
+			if(result->m_nodeId!=0) {
+				bool inFlight = false;
+				for(int i=0; i<_TaskManagerTxPendingCount && !inFlight; i++) {
+					inFlight = _TaskManagerTxPending[(_TaskManagerTxPendingHead+i)%TASKMGR_RADIO_TX_INFLIGHT].m_nodeId==result->m_nodeId;
+				}
+				while(inFlight && _TaskManagerTxPending[_TaskManagerTxPendingHead].m_nodeId!=result->m_nodeId) radioTxDone(false);
+				if(inFlight) radioTxDone(result->m_ok);
+			} else if(_TaskManagerTxPendingCount!=0) {
+				radioTxDone(result->m_ok);
 			}
-		} else {
-			WiFi.disconnect();
+			_TaskManagerTxResults.release();
 		}
+		// a callback that never comes must not stop the queue
+		if(_TaskManagerTxPendingCount!=0
+				&& ::millis()-_TaskManagerTxPending[_TaskManagerTxPendingHead].m_sentAt>=TASKMGR_RADIO_TX_TIMEOUT) {
+			radioTxDone(false);
+		}
+		if(_TaskManagerTxPendingCount>=TASKMGR_RADIO_TX_INFLIGHT) break;
+		bool system = (f=_TaskManagerTxSystemQueue.peek())!=NULL;
+		if(!system && (_TaskManagerTxHeld || (f=_TaskManagerTxQueue.peek())==NULL)) break;
+		if(!m_radioRateShed && !radioRateAllow(f->m_nodeId, f->m_fromTaskId)) {
+			_TaskManagerTxHeld = true;
+			continue;
+		}
+		_TaskManagerTxInFlight* p = &_TaskManagerTxPending[(_TaskManagerTxPendingHead+_TaskManagerTxPendingCount)%TASKMGR_RADIO_TX_INFLIGHT];
+		p->m_nodeId = f->m_nodeId;
+		p->m_fromTaskId = f->m_fromTaskId;
+		p->m_sentAt = ::millis();
+		_TaskManagerTxPendingCount++;
+		TaskManagerTransport::Status status = TaskManagerTransport::tmtNotFound;
+		for(int tries=0; tries<2 && status==TaskManagerTransport::tmtNotFound; tries++) {
+			if(tries!=0) peerCacheForget(f->m_nodeId);	// removed behind the cache's back; register it again
+			if(!radioPeer(f->m_nodeId)) break;
+			status = m_transport->send(f->m_nodeId, f->m_frame, f->m_len);
+		}
+		if(status!=TaskManagerTransport::tmtOk) {
+			if(DEBUG) Serial << "***ERR sending to node " << f->m_nodeId << "***\n";
+			// no callback will come; it is the newest in flight, so take it back and report it
+			_TaskManagerTxPendingCount--;
+			_TaskManagerTxFailures++;
+			radioRateResult(p->m_nodeId, false);
+			radioLinkResult(p->m_nodeId, false);
+			if(m_radioSendHook!=NULL) (m_radioSendHook)(p->m_fromTaskId, p->m_nodeId, false);
+		}
+		if(system) _TaskManagerTxSystemQueue.release();
+		else _TaskManagerTxQueue.release();
 	}
-	/////
+}
 
-	/////
-	m_lastESPError = esp_now_init();
-	if(m_lastESPError!=ESP_OK) {
-		if(DEBUG) Serial << "<--radioBegin error, esp_now_init() failed\n";
-		return false;
+void TaskManager::setRadioSendHook(void (*hook)(tm_taskId_t taskId, tm_nodeId_t nodeId, bool ok)) {
+	m_radioSendHook = hook;
+}
+
+unsigned long TaskManager::radioSendDrops() {
+	return _TaskManagerTxQueue.drops()+_TaskManagerTxSystemQueue.drops();
+}
+
+unsigned long TaskManager::radioSendFailures() {
+	return _TaskManagerTxFailures;
+}
+
+/*!	\brief Find the bucket of a node or task, taking a free or the least recently used slot if it has none
+	\param buckets -- _TaskManagerNodeRates or _TaskManagerTaskRates
+	\param id -- the node or task
+	\param burst -- the tokens a new bucket starts with, in frames
+*/
+static _TaskManagerRateBucket* rateBucket(_TaskManagerRateBucket* buckets, tm_nodeId_t id, byte burst) {
+	_TaskManagerRateBucket* b = NULL;
+	for(int i=0; i<TASKMGR_RATE_SLOTS; i++) {
+		_TaskManagerRateBucket* c = &buckets[i];
+		if(c->m_inUse && c->m_id==id) {
+			c->m_used = ++_TaskManagerRateClock;
+			return c;
+		}
+		if(b==NULL || (b->m_inUse && (!c->m_inUse || c->m_used<b->m_used))) b = c;
 	}
+	b->m_id = id;
+	b->m_inUse = true;
+	b->m_fails = 0;
+	b->m_tokens = burst*1000UL;
+	b->m_refilled = ::millis();
+	b->m_used = ++_TaskManagerRateClock;
+	return b;
+}
 
-	delay(10);
+/*!	\brief Add the tokens earned since a bucket was last refilled
+	\returns true if the bucket has a whole frame's worth
+*/
+static bool rateRefill(_TaskManagerRateBucket* b, unsigned int rate, byte burst) {
+	unsigned long now = ::millis();
+	unsigned long elapsed = now-b->m_refilled;
+	// long enough to fill the bucket; any longer and the product could overflow
+	unsigned long most = (burst*1000UL+rate-1)/rate;
+	b->m_tokens += (elapsed<most ? elapsed : most)*rate;
+	if(b->m_tokens>burst*1000UL) b->m_tokens = burst*1000UL;
+	b->m_refilled = now;
+	return b->m_tokens>=1000;
+}
 
-	// register callbacks
-	m_lastESPError = esp_now_register_recv_cb(msg_recv_cb);
-	if(m_lastESPError!=ESP_OK) {
-		Serial << "<--radioBegin error, esp_now_register_recv_cb() failed\n";
-		return false;
+/*!	\brief Return the ms until a bucket has a whole frame's worth of tokens
+*/
+static unsigned long rateWait(_TaskManagerRateBucket* b, unsigned int rate, byte burst) {
+	if(rateRefill(b, rate, burst)) return 0;
+	return (1000-b->m_tokens+rate-1)/rate;
+}
+
+/*!	\brief Check a frame against the rate limits and backoff, using up its tokens if it may be sent.  Internal routine.
+	\param destNodeID - The target node
+	\param taskId - The task sending the frame
+	\returns - true if the frame may be sent now
+*/
+bool TaskManager::radioRateAllow(tm_nodeId_t destNodeID, tm_taskId_t taskId) {
+	_TaskManagerRateBucket* nb = NULL;
+	_TaskManagerRateBucket* tb = NULL;
+	if(m_radioNodeRate==0 && m_radioTaskRate==0 && m_radioBackoffMax==0) return true;
+	if(m_radioNodeRate!=0 || m_radioBackoffMax!=0) nb = rateBucket(_TaskManagerNodeRates, destNodeID, m_radioRateBurst);
+	if(taskId>=TASKMGR_SYSTEM_TASK_BASE) {
+		// never held, but it counts against the node
+		if(m_radioNodeRate!=0 && rateRefill(nb, m_radioNodeRate, m_radioRateBurst)) nb->m_tokens -= 1000;
+		return true;
 	}
-	#if defined(NEWAPI)
-	m_lastESPError = esp_now_register_send_cb(esp_now_send_cb_t(msg_send_cb));
-	#else
-	m_lastESPError = esp_now_register_send_cb(msg_send_cb);
-	#endif
-	if(m_lastESPError!=ESP_OK) {
-		Serial << "<--radioBegin error, esp_now_register_send_cb() failed\n";
-		return false;
+	if(m_radioBackoffMax!=0 && nb->m_fails!=0 && (long)(::millis()-nb->m_holdUntil)<0) return false;
+	if(m_radioNodeRate!=0 && !rateRefill(nb, m_radioNodeRate, m_radioRateBurst)) return false;
+	if(m_radioTaskRate!=0) {
+		tb = rateBucket(_TaskManagerTaskRates, taskId, m_radioRateBurst);
+		if(!rateRefill(tb, m_radioTaskRate, m_radioRateBurst)) return false;
+		tb->m_tokens -= 1000;
+	}
+	if(m_radioNodeRate!=0) nb->m_tokens -= 1000;
+	return true;
+}
+
+/*!	\brief Return the ms until radioRateAllow() lets a frame go.  Internal routine.
+	\param destNodeID - The target node
+	\param taskId - The task sending the frame
+	\returns - the ms until its tokens are refilled and its backoff is over; 0 if it may be sent now
+*/
+unsigned long TaskManager::radioRateWait(tm_nodeId_t destNodeID, tm_taskId_t taskId) {
+	unsigned long now = ::millis();
+	unsigned long wait = 0;
+	unsigned long w;
+	_TaskManagerRateBucket* b;
+	if(m_radioNodeRate==0 && m_radioTaskRate==0 && m_radioBackoffMax==0) return 0;
+	if(m_radioNodeRate!=0 || m_radioBackoffMax!=0) {
+		b = rateBucket(_TaskManagerNodeRates, destNodeID, m_radioRateBurst);
+		if(m_radioBackoffMax!=0 && b->m_fails!=0 && (long)(now-b->m_holdUntil)<0) wait = b->m_holdUntil-now;
+		if(m_radioNodeRate!=0 && (w=rateWait(b, m_radioNodeRate, m_radioRateBurst))>wait) wait = w;
+	}
+	if(m_radioTaskRate!=0 && taskId<TASKMGR_SYSTEM_TASK_BASE) {
+		b = rateBucket(_TaskManagerTaskRates, taskId, m_radioRateBurst);
+		if((w=rateWait(b, m_radioTaskRate, m_radioRateBurst))>wait) wait = w;
 	}
+	return wait;
+}
 
-	// create our semaphore
-	m_TaskManagerMessageQueueSemaphore = xSemaphoreCreateMutex();
+/*!	\brief Note the result of a send, for backoff.  Internal routine.
+	\param destNodeID - The node sent to
+	\param ok - true if the frame was delivered
+*/
+void TaskManager::radioRateResult(tm_nodeId_t destNodeID, bool ok) {
+	if(m_radioBackoffMax==0) return;
+	_TaskManagerRateBucket* b = rateBucket(_TaskManagerNodeRates, destNodeID, m_radioRateBurst);
+	if(ok) {
+		b->m_fails = 0;
+		return;
+	}
+	if(b->m_fails<16) b->m_fails++;
+	unsigned long hold = (unsigned long)TASKMGR_RADIO_BACKOFF<<(b->m_fails-1);
+	b->m_holdUntil = ::millis() + (hold<m_radioBackoffMax ? hold : m_radioBackoffMax);
+	_TaskManagerBackoffs++;
+}
 
-	// start our handler
-	TaskMgr.add(TASKMGR_RF_MONITOR_TASK, radioReceiverTask);
+void TaskManager::setRadioRateLimit(unsigned int nodeRate, unsigned int taskRate, byte burst, bool shed) {
+	m_radioNodeRate = nodeRate;
+	m_radioTaskRate = taskRate;
+	m_radioRateBurst = burst!=0 ? burst : 1;
+	m_radioRateShed = shed;
+}
 
-	// final cleanup
-	m_myNodeId = nodeID;
-	m_radioReceiverRunning = true;
-	if(DEBUG) Serial << "<--radioBegin successful return\n";
+void TaskManager::setRadioBackoff(unsigned int maxMs) {
+	m_radioBackoffMax = maxMs;
+}
+
+unsigned long TaskManager::radioRateDrops() {
+	return _TaskManagerRateDrops;
+}
+
+unsigned long TaskManager::radioBackoffs() {
+	return _TaskManagerBackoffs;
+}
+
+/*!	\brief Add the tmrMessage packet in radioBuf to the aggregated frame for a node.  Internal routine.
+
+	If the node's frame does not have room, it is sent first.  If every slot is in use by other
+	nodes, the oldest is sent to free one.
+	\param destNodeID - The target node
+	\param len - The length of the packet in radioBuf
+	\returns - true if the message was added, false if it must be sent on its own
+*/
+bool TaskManager::radioAggregate(tm_nodeId_t destNodeID, int len) {
+	_TaskManagerRadioAggregate* agg = NULL;
+	_TaskManagerRadioAggregate* oldest = NULL;
+	int msgLen = len-TASKMGR_RADIO_HEADER_SIZE-1;
+	int recLen = TASKMGR_RADIO_RECORD_HEADER_SIZE+msgLen;
+	if(radioBuf.m_data[0]>=TASKMGR_SYSTEM_TASK_BASE || radioBuf.m_fromTaskId>=TASKMGR_SYSTEM_TASK_BASE) return false;
+	// leave room for the reliability and routing headers
+	int room = TASKMGR_RADIO_HEADER_SIZE + radioFrameRoom(destNodeID) - (m_radioReliable ? TASKMGR_RELIABLE_HEADER_SIZE : 0);
+	if((int)TASKMGR_RADIO_HEADER_SIZE+recLen>room) return false;
+	for(int i=0; i<TASKMGR_RADIO_AGG_SLOTS && agg==NULL; i++) {
+		if(_TaskManagerOutgoing[i].m_len!=0 && _TaskManagerOutgoing[i].m_nodeId==destNodeID) agg = &_TaskManagerOutgoing[i];
+	}
+	if(agg!=NULL && agg->m_len+recLen>room) {
+		radioSendFrame(agg->m_nodeId, agg->m_frame, agg->m_len);
+		agg->m_len = 0;
+	}
+	if(agg==NULL) {
+		// use a free slot, or send the oldest frame to free its slot
+		for(int i=0; i<TASKMGR_RADIO_AGG_SLOTS; i++) {
+			if(_TaskManagerOutgoing[i].m_len==0) {
+				agg = &_TaskManagerOutgoing[i];
+				break;
+			}
+			if(oldest==NULL || (long)(_TaskManagerOutgoing[i].m_started-oldest->m_started)<0) oldest = &_TaskManagerOutgoing[i];
+		}
+		if(agg==NULL) {
+			agg = oldest;
+			radioSendFrame(agg->m_nodeId, agg->m_frame, agg->m_len);
+			agg->m_len = 0;
+		}
+	}
+	if(agg->m_len==0) {
+		_TaskManagerRadioPacket* hdr = (_TaskManagerRadioPacket*)agg->m_frame;
+		hdr->m_cmd = tmrMulti;
+		hdr->m_fromNodeId = myNodeId();
+		hdr->m_fromTaskId = 0;
+		agg->m_nodeId = destNodeID;
+		agg->m_len = TASKMGR_RADIO_HEADER_SIZE;
+		agg->m_started = ::millis();
+	}
+	agg->m_frame[agg->m_len] = radioBuf.m_data[0];
+	agg->m_frame[agg->m_len+1] = radioBuf.m_fromTaskId;
+	agg->m_frame[agg->m_len+2] = msgLen;
+	memcpy(&agg->m_frame[agg->m_len+TASKMGR_RADIO_RECORD_HEADER_SIZE], &radioBuf.m_data[1], msgLen);
+	agg->m_len += recLen;
+	// if another record can't fit, there is no reason to wait
+	if(agg->m_len+TASKMGR_RADIO_RECORD_HEADER_SIZE>=room) {
+		radioSendFrame(agg->m_nodeId, agg->m_frame, agg->m_len);
+		agg->m_len = 0;
+	}
 	return true;
 }
 
-bool TaskManager::registerPeer(tm_nodeId_t nodeId) {
-	// register the partner nodeID as a peer
-	esp_now_peer_info_t peer;
-	nodeMac[4] = (nodeId>>8)&0x0ff;
-	nodeMac[5] = nodeId & 0x0ff;
-	memcpy(peer.peer_addr, &nodeMac, 6);
-	peer.channel = WIFI_CHANNEL;
-#if defined(NEWAPI)
-	peer.ifidx = WIFI_IF_STA;
-#else
-	peer.ifidx = ESP_IF_WIFI_STA;
-#endif
-	peer.encrypt=false;
-	m_lastESPError = esp_now_add_peer(&peer);
-	return m_lastESPError==ESP_OK;
+/*!	\brief Send aggregated frames.  Internal routine.
+	\param destNodeID - The node whose frame is sent.  0 means all nodes.
+	\param expiredOnly - If true, only send frames whose aggregation window has ended.
+*/
+void TaskManager::radioFlush(tm_nodeId_t destNodeID, bool expiredOnly) {
+	for(int i=0; i<TASKMGR_RADIO_AGG_SLOTS; i++) {
+		_TaskManagerRadioAggregate* agg = &_TaskManagerOutgoing[i];
+		if(agg->m_len==0) continue;
+		if(destNodeID!=0 && agg->m_nodeId!=destNodeID) continue;
+		if(expiredOnly && ::millis()-agg->m_started<m_radioAggWindow) continue;
+		radioSendFrame(agg->m_nodeId, agg->m_frame, agg->m_len);
+		agg->m_len = 0;
+	}
 }
 
-bool TaskManager::unRegisterPeer(tm_nodeId_t nodeId){
-	// unregister the partner nodeID as a peer
-	nodeMac[4] = (nodeId>>8)&0x0ff;
-	nodeMac[5] = nodeId & 0x0ff;
-	m_lastESPError = esp_now_del_peer(nodeMac);
-	return m_lastESPError==ESP_OK;
+void TaskManager::setRadioAggregation(unsigned int windowMs) {
+	if(windowMs==0) radioFlush(0, false);
+	m_radioAggWindow = windowMs;
 }
 
-const char* TaskManager::lastESPError() {
-	return espErrText(m_lastESPError);
+//
+// Link statistics
+//
+// Each node sent to has a _TaskManagerLink, kept in a small table with the least recently used
+// replaced.  The success ratio is a moving average of the transport's send results.  The round
+// trip time is smoothed as TCP does (RFC 6298):  m_srtt holds 8 times the average and m_rttVar
+// 4 times the mean deviation, so the arithmetic stays in integers.  Only acks for frames sent
+// once are timed, since the ack for a resent frame may be for either send.
+//
+
+/*!	\struct _TaskManagerLink
+	The send history of one node.
+*/
+struct _TaskManagerLink {
+	tm_nodeId_t m_nodeId;		// 0 if the slot is free
+	uint16_t m_ratio;			// recent deliveries, in 1/256ths
+	uint16_t m_srtt;			// smoothed round trip time, times 8, in ms; 0 if none has been measured
+	uint16_t m_rttVar;			// smoothed mean deviation, times 4, in ms
+	unsigned long m_sent;
+	unsigned long m_failed;
+	unsigned long m_retries;
+	unsigned long m_lost;
+	unsigned long m_used;		// _TaskManagerLinkClock when last used
+};
+
+static _TaskManagerLink _TaskManagerLinks[TASKMGR_LINK_SLOTS];
+static unsigned long _TaskManagerLinkClock = 0;
+
+/*!	\brief Find the statistics of a node
+	\param nodeId - the node
+	\param create - if true and the node has none, take a free slot or the least recently used one
+	\returns the entry, or NULL
+*/
+static _TaskManagerLink* linkFind(tm_nodeId_t nodeId, bool create) {
+	_TaskManagerLink* l = NULL;
+	if(nodeId==0 || nodeId==TASKMGR_BROADCAST_NODE) return NULL;
+	for(int i=0; i<TASKMGR_LINK_SLOTS; i++) {
+		_TaskManagerLink* c = &_TaskManagerLinks[i];
+		if(c->m_nodeId==nodeId) {
+			c->m_used = ++_TaskManagerLinkClock;
+			return c;
+		}
+		if(l==NULL || (l->m_nodeId!=0 && (c->m_nodeId==0 || c->m_used<l->m_used))) l = c;
+	}
+	if(!create) return NULL;
+	memset(l, 0, sizeof(_TaskManagerLink));
+	l->m_nodeId = nodeId;
+	l->m_ratio = 256;
+	l->m_used = ++_TaskManagerLinkClock;
+	return l;
+}
+
+/*!	\brief Add a round trip time to a node's average
+*/
+static void linkRttSample(tm_nodeId_t nodeId, unsigned long ms) {
+	_TaskManagerLink* l = linkFind(nodeId, true);
+	if(l==NULL) return;
+	if(ms>TASKMGR_LINK_MAX_TIMEOUT) ms = TASKMGR_LINK_MAX_TIMEOUT;
+	if(ms==0) ms = 1;	// so m_srtt is never 0 once measured
+	if(l->m_srtt==0) {
+		l->m_srtt = ms<<3;
+		l->m_rttVar = ms<<1;
+		return;
+	}
+	long err = (long)ms - (l->m_srtt>>3);
+	l->m_srtt += err;
+	if(err<0) err = -err;
+	l->m_rttVar += err - (l->m_rttVar>>2);
+}
+
+/*!	\brief Return the time to wait for a reply from a node, in ms
+*/
+static unsigned long linkTimeout(_TaskManagerLink* l) {
+	if(l==NULL || l->m_srtt==0) return TASKMGR_LINK_TIMEOUT;
+	unsigned long t = (l->m_srtt>>3) + l->m_rttVar;
+	if(t<TASKMGR_LINK_MIN_TIMEOUT) t = TASKMGR_LINK_MIN_TIMEOUT;
+	if(t>TASKMGR_LINK_MAX_TIMEOUT) t = TASKMGR_LINK_MAX_TIMEOUT;
+	return t;
+}
+
+/*!	\brief Return the time to wait for an ack before sending a reliable frame again
+	\param nodeId - the node it was sent to
+	\param tries - the times it has been sent
+*/
+static unsigned long linkResendTimeout(tm_nodeId_t nodeId, byte tries) {
+	_TaskManagerLink* l = linkFind(nodeId, false);
+	unsigned long t = (l!=NULL && l->m_srtt!=0) ? linkTimeout(l) : TASKMGR_RELIABLE_TIMEOUT;
+	t <<= (tries>1 ? tries-1 : 0);
+	return t<TASKMGR_LINK_MAX_TIMEOUT ? t : TASKMGR_LINK_MAX_TIMEOUT;
+}
+
+/*!	\brief Return the hops a route through a neighbour is counted as longer by, for its recent send failures
+*/
+static byte linkPenalty(tm_nodeId_t nodeId) {
+	_TaskManagerLink* l = linkFind(nodeId, false);
+	if(l==NULL || l->m_ratio>=192) return 0;
+	return l->m_ratio>=128 ? 1 : 2;
+}
+
+/*!	\brief Note the result of a send for the link statistics.  Internal routine.
+	\param destNodeID - The node sent to
+	\param ok - true if the frame was delivered
+*/
+void TaskManager::radioLinkResult(tm_nodeId_t destNodeID, bool ok) {
+	_TaskManagerLink* l = linkFind(destNodeID, true);
+	if(l==NULL) return;
+	l->m_sent++;
+	if(!ok) l->m_failed++;
+	l->m_ratio = l->m_ratio - (l->m_ratio+7)/8 + (ok ? 32 : 0);
+}
+
+bool TaskManager::radioLinkStats(tm_nodeId_t nodeId, TaskManagerLinkStats& stats) {
+	_TaskManagerLink* l = linkFind(nodeId, false);
+	if(l==NULL) return false;
+	stats.m_sent = l->m_sent;
+	stats.m_failed = l->m_failed;
+	stats.m_retries = l->m_retries;
+	stats.m_lost = l->m_lost;
+	stats.m_successRatio = l->m_ratio;
+	stats.m_rtt = (l->m_srtt+4)>>3;
+	stats.m_rttVar = (l->m_rttVar+2)>>2;
+	stats.m_timeout = linkTimeout(l);
+	return true;
+}
+
+void TaskManager::radioLinkRtt(tm_nodeId_t nodeId, unsigned long ms) {
+	linkRttSample(nodeId, ms);
+}
+
+unsigned long TaskManager::radioLinkTimeout(tm_nodeId_t nodeId, bool resends) {
+	unsigned long t = linkTimeout(linkFind(nodeId, false));
+	if(resends && m_radioReliable) {
+		// the request or the reply may need every resend
+		for(byte tries=1; tries<TASKMGR_RELIABLE_TRIES; tries++) t += linkResendTimeout(nodeId, tries);
+	}
+	return t;
+}
+
+//
+// Reliable delivery
+//
+// A tmrReliable frame is the usual header followed by [seq][ack][ack mask][inner cmd][session]
+// [ack session], then the m_data bytes of the frame it carries.  Sequence numbers are kept per
+// node.  ack is the highest sequence number received from that node, and bit i of the ack mask
+// says that ack-1-i was received too.  TASKMGR_RELIABLE_ACK_VALID in the inner cmd says the ack
+// fields are valid.  session is picked at random when a node first sends a reliable frame, so a
+// node that restarts starts a new session and its receivers start their windows again.  ack
+// session is the session of the frames being acked, so an ack from before a restart is ignored.
+// A tmrReliableAck frame is the header followed by [ack][ack mask][ack session].  It is only
+// sent when no tmrReliable frame to that node has carried the ack within TASKMGR_RELIABLE_ACK_DELAY ms.
+//
+
+/*!	\struct _TaskManagerReliableFrame
+	A tmrReliable frame that has been sent and not yet acked.
+*/
+struct _TaskManagerReliableFrame {
+	byte m_len;					// bytes of m_frame in use; 0 if the slot is free
+	byte m_tries;				// times sent
+	unsigned long m_sentAt;		// millis() when last sent
+	byte m_frame[sizeof(_TaskManagerRadioPacket)];
+};
+
+/*!	\struct _TaskManagerReliablePeer
+	Reliable delivery state for one node, in both directions.
+*/
+struct _TaskManagerReliablePeer {
+	tm_nodeId_t m_nodeId;		// 0 if the entry is free
+	byte m_txSeq;				// next sequence number to send
+	byte m_rxSeq;				// highest sequence number received
+	byte m_rxMask;				// bit i:  m_rxSeq-1-i has been received
+	byte m_rxSession;			// the node's session
+	bool m_rxValid;				// something has been received in m_rxSession
+	bool m_ackPending;			// something received has not been acked
+	unsigned long m_ackDue;		// millis() when a standalone ack is sent
+	_TaskManagerReliableFrame m_unacked[TASKMGR_RELIABLE_WINDOW];
+};
+
+static _TaskManagerReliablePeer _TaskManagerReliablePeers[TASKMGR_RELIABLE_PEERS];
+static byte _TaskManagerReliableSession = 0;	// this node's session; 0 until the first reliable frame
+static unsigned long _TaskManagerRetransmits = 0;
+static unsigned long _TaskManagerLostFrames = 0;
+
+/*!	\brief Find the reliable delivery state for a node
+	\param nodeId - the node
+	\param create - if true and the node has no entry, take a free entry or one with nothing outstanding
+	\returns the entry, or NULL
+*/
+static _TaskManagerReliablePeer* reliablePeer(tm_nodeId_t nodeId, bool create) {
+	_TaskManagerReliablePeer* idle = NULL;
+	for(int i=0; i<TASKMGR_RELIABLE_PEERS; i++) {
+		_TaskManagerReliablePeer* peer = &_TaskManagerReliablePeers[i];
+		if(peer->m_nodeId==nodeId) return peer;
+		if(!create || (idle!=NULL && idle->m_nodeId==0)) continue;
+		if(peer->m_nodeId==0) {
+			idle = peer;
+			continue;
+		}
+		bool busy = peer->m_ackPending;
+		for(int j=0; j<TASKMGR_RELIABLE_WINDOW && !busy; j++) busy = peer->m_unacked[j].m_len!=0;
+		if(!busy && idle==NULL) idle = peer;
+	}
+	if(idle!=NULL) {
+		memset(idle, 0, sizeof(_TaskManagerReliablePeer));
+		idle->m_nodeId = nodeId;
+	}
+	return idle;
+}
+
+/*!	\brief Put the current ack for a node in an outgoing tmrReliable frame
+*/
+static void reliableStampAck(_TaskManagerReliablePeer* peer, byte* frame) {
+	byte* rel = &frame[TASKMGR_RADIO_HEADER_SIZE];
+	rel[1] = peer->m_rxSeq;
+	rel[2] = peer->m_rxMask;
+	rel[5] = peer->m_rxSession;
+	if(peer->m_rxValid) rel[3] |= TASKMGR_RELIABLE_ACK_VALID;
+	peer->m_ackPending = false;
+}
+
+/*!	\brief Release the frames to a node covered by an ack from it
+*/
+static void reliableApplyAck(_TaskManagerReliablePeer* peer, byte ack, byte mask) {
+	for(int i=0; i<TASKMGR_RELIABLE_WINDOW; i++) {
+		_TaskManagerReliableFrame* f = &peer->m_unacked[i];
+		if(f->m_len==0) continue;
+		byte behind = ack - f->m_frame[TASKMGR_RADIO_HEADER_SIZE];
+		if(behind==0 || (behind<=8 && (mask&(1<<(behind-1))))) {
+			if(f->m_tries==1) linkRttSample(peer->m_nodeId, ::millis()-f->m_sentAt);
+			f->m_len = 0;
+		}
+	}
+}
+
+/*!	\brief Send a frame as a tmrReliable frame.  Internal routine.
+
+	The frame is kept until it is acked, or until it has been sent TASKMGR_RELIABLE_TRIES times.
+	\param destNodeID - The target node
+	\param frame - The frame, starting with a _TaskManagerRadioPacket header
+	\param len - The length of the frame
+	\returns - true if the frame was accepted, false if TASKMGR_RELIABLE_WINDOW frames to the node are
+	already waiting for an ack, if one sent 8 or more frames ago still is, or if TASKMGR_RELIABLE_PEERS
+	other nodes have frames waiting
+*/
+bool TaskManager::radioReliableSend(tm_nodeId_t destNodeID, const byte* frame, int len) {
+	_TaskManagerReliablePeer* peer = reliablePeer(destNodeID, true);
+	_TaskManagerReliableFrame* f = NULL;
+	if(peer==NULL) return false;
+	for(int i=0; i<TASKMGR_RELIABLE_WINDOW; i++) {
+		_TaskManagerReliableFrame* u = &peer->m_unacked[i];
+		if(u->m_len==0) {
+			if(f==NULL) f = u;
+		} else if((byte)(peer->m_txSeq-u->m_frame[TASKMGR_RADIO_HEADER_SIZE])>=8) {
+			return false;	// the receiver only remembers the last 8 sequence numbers
+		}
+	}
+	if(f==NULL) return false;
+	while(_TaskManagerReliableSession==0) _TaskManagerReliableSession = (byte)esp_random();
+	byte* rel = &f->m_frame[TASKMGR_RADIO_HEADER_SIZE];
+	memcpy(f->m_frame, frame, TASKMGR_RADIO_HEADER_SIZE);
+	f->m_frame[0] = tmrReliable;
+	rel[0] = peer->m_txSeq++;
+	rel[3] = frame[0];
+	rel[4] = _TaskManagerReliableSession;
+	reliableStampAck(peer, f->m_frame);
+	memcpy(&rel[TASKMGR_RELIABLE_HEADER_SIZE], &frame[TASKMGR_RADIO_HEADER_SIZE], len-TASKMGR_RADIO_HEADER_SIZE);
+	f->m_len = len+TASKMGR_RELIABLE_HEADER_SIZE;
+	f->m_tries = 1;
+	f->m_sentAt = ::millis();
+	radioTransmit(destNodeID, f->m_frame, f->m_len);
+	return true;	// if the transmit failed, the frame is sent again like a lost frame
+}
+
+/*!	\brief Process a received tmrReliable or tmrReliableAck frame.  Internal routine.
+
+	The ack it carries releases frames sent to that node.  A tmrReliable frame is noted to be acked
+	and, unless it is a duplicate, the received frame is rewritten in place as the frame it carries.
+	\param len - the length of the frame being received
+	\returns - true if the frame now holds the frame it carried, of len-TASKMGR_RELIABLE_HEADER_SIZE bytes
+*/
+bool TaskManager::radioReliableReceive(int len) {
+	byte* rel = &((byte*)m_rxPacket)[TASKMGR_RADIO_HEADER_SIZE];
+	_TaskManagerReliablePeer* peer;
+	bool isNew;
+	if(m_rxPacket->m_cmd==tmrReliableAck) {
+		if(len<(int)TASKMGR_RADIO_HEADER_SIZE+3) return false;
+		peer = reliablePeer(m_rxPacket->m_fromNodeId, false);
+		if(peer!=NULL && rel[2]==_TaskManagerReliableSession) reliableApplyAck(peer, rel[0], rel[1]);
+		return false;
+	}
+	if(len<(int)(TASKMGR_RADIO_HEADER_SIZE+TASKMGR_RELIABLE_HEADER_SIZE)) return false;
+	peer = reliablePeer(m_rxPacket->m_fromNodeId, true);
+	if(peer==NULL) return false;	// can't track it; the sender will try again
+	if((rel[3]&TASKMGR_RELIABLE_ACK_VALID) && rel[5]==_TaskManagerReliableSession) reliableApplyAck(peer, rel[1], rel[2]);
+	// a new session means the sender has restarted; its sequence numbers start again
+	if(rel[4]!=peer->m_rxSession) {
+		peer->m_rxSession = rel[4];
+		peer->m_rxValid = false;
+	}
+	// drop duplicates.  Anything more than 8 behind is taken as a new run of sequence numbers.
+	signed char ahead = (signed char)(rel[0]-peer->m_rxSeq);
+	if(!peer->m_rxValid || ahead>0 || ahead<-8) {
+		peer->m_rxMask = (!peer->m_rxValid || ahead<=0 || ahead>8) ? 0 : ((peer->m_rxMask<<ahead) | (1<<(ahead-1)));
+		peer->m_rxSeq = rel[0];
+		peer->m_rxValid = true;
+		isNew = true;
+	} else if(ahead==0) {
+		isNew = false;
+	} else {
+		isNew = !(peer->m_rxMask & (1<<(-ahead-1)));
+		peer->m_rxMask |= 1<<(-ahead-1);
+	}
+	if(!peer->m_ackPending) {
+		peer->m_ackPending = true;
+		peer->m_ackDue = ::millis()+TASKMGR_RELIABLE_ACK_DELAY;
+	}
+	if(!isNew) return false;
+	m_rxPacket->m_cmd = rel[3]&~TASKMGR_RELIABLE_ACK_VALID;
+	memmove(rel, &rel[TASKMGR_RELIABLE_HEADER_SIZE], len-TASKMGR_RADIO_HEADER_SIZE-TASKMGR_RELIABLE_HEADER_SIZE);
+	return true;
+}
+
+/*!	\brief Send due acks and resend frames that have not been acked.  Internal routine.
+
+	Called on each pass of the radio receiver task.
+*/
+void TaskManager::radioReliableService() {
+	unsigned long now = ::millis();
+	for(int i=0; i<TASKMGR_RELIABLE_PEERS; i++) {
+		_TaskManagerReliablePeer* peer = &_TaskManagerReliablePeers[i];
+		if(peer->m_nodeId==0) continue;
+		for(int j=0; j<TASKMGR_RELIABLE_WINDOW; j++) {
+			_TaskManagerReliableFrame* f = &peer->m_unacked[j];
+			if(f->m_len==0 || now-f->m_sentAt<linkResendTimeout(peer->m_nodeId, f->m_tries)) continue;
+			_TaskManagerLink* l = linkFind(peer->m_nodeId, true);
+			if(f->m_tries>=TASKMGR_RELIABLE_TRIES) {
+				f->m_len = 0;
+				_TaskManagerLostFrames++;
+				if(l!=NULL) l->m_lost++;
+				continue;
+			}
+			reliableStampAck(peer, f->m_frame);
+			f->m_tries++;
+			f->m_sentAt = now;
+			_TaskManagerRetransmits++;
+			if(l!=NULL) l->m_retries++;
+			radioTransmit(peer->m_nodeId, f->m_frame, f->m_len);
+		}
+		if(peer->m_ackPending && (long)(now-peer->m_ackDue)>=0) {
+			byte ack[TASKMGR_RADIO_HEADER_SIZE+3];
+			_TaskManagerRadioPacket* hdr = (_TaskManagerRadioPacket*)ack;
+			hdr->m_cmd = tmrReliableAck;
+			hdr->m_fromNodeId = myNodeId();
+			hdr->m_fromTaskId = 0;
+			ack[TASKMGR_RADIO_HEADER_SIZE] = peer->m_rxSeq;
+			ack[TASKMGR_RADIO_HEADER_SIZE+1] = peer->m_rxMask;
+			ack[TASKMGR_RADIO_HEADER_SIZE+2] = peer->m_rxSession;
+			peer->m_ackPending = false;
+			radioTransmit(peer->m_nodeId, ack, sizeof(ack));
+		}
+	}
+}
+
+void TaskManager::setRadioReliable(bool reliable) {
+	m_radioReliable = reliable;
+}
+
+unsigned long TaskManager::radioRetransmits() {
+	return _TaskManagerRetransmits;
+}
+
+unsigned long TaskManager::radioLostFrames() {
+	return _TaskManagerLostFrames;
+}
+
+//
+// Fragmentation
+//
+// A message too large for one packet is sent as tmrFragment packets, each the usual header followed
+// by [target task][message number][fragment number][fragment count][offset (2 bytes)] and then
+// that piece of the message.  The receiver copies each piece into place in a reassembly buffer
+// and delivers the message when every fragment has arrived.
+//
+
+/*!	\struct _TaskManagerReassembly
+	A fragmented message being reassembled.
+*/
+struct _TaskManagerReassembly {
+	tm_nodeId_t m_fromNodeId;	// source node; 0 if the slot is free
+	tm_taskId_t m_fromTaskId;	// source task
+	tm_taskId_t m_toTaskId;		// target task
+	byte m_msgId;				// the sender's message number
+	byte m_count;				// fragments in the message
+	uint32_t m_have;			// bit i:  fragment i has arrived
+	int m_len;					// message length, once the last fragment has arrived
+	unsigned long m_started;	// millis() when the first fragment arrived
+	byte* m_buf;				// TASKMGR_MESSAGE_SIZE bytes, allocated when first used
+};
+
+static _TaskManagerReassembly _TaskManagerReassemblies[TASKMGR_REASSEMBLY_SLOTS];
+static unsigned long _TaskManagerReassemblyDrops = 0;
+static byte _TaskManagerNextMsgId = 0;
+
+/*!	\brief Discard messages whose fragments have not all arrived in time
+*/
+static void reassemblyExpire() {
+	for(int i=0; i<TASKMGR_REASSEMBLY_SLOTS; i++) {
+		_TaskManagerReassembly* r = &_TaskManagerReassemblies[i];
+		if(r->m_fromNodeId!=0 && ::millis()-r->m_started>=TASKMGR_REASSEMBLY_TIMEOUT) {
+			r->m_fromNodeId = 0;
+			_TaskManagerReassemblyDrops++;
+		}
+	}
+}
+
+/*!	\struct _TaskManagerFragmentSend
+	A message being sent as tmrFragment packets.  With reliable delivery on, only
+	TASKMGR_RELIABLE_WINDOW packets to a node can wait for acks, so a message in more fragments
+	keeps a slot until the rest have been sent.
+*/
+struct _TaskManagerFragmentSend {
+	tm_nodeId_t m_toNodeId;		// target node; 0 if the slot is free
+	tm_taskId_t m_fromTaskId;	// source task
+	tm_taskId_t m_toTaskId;		// target task
+	byte m_msgId;				// the message number
+	byte m_next;				// the next fragment to send
+	byte m_count;				// fragments in the message
+	bool m_isString;			// a '\0' is sent in place of the last byte
+	int m_len;					// message length
+	int m_room;					// message bytes in each fragment
+	unsigned long m_started;	// millis() when the first fragment was sent
+	byte* m_buf;				// TASKMGR_MESSAGE_SIZE bytes, allocated when first used
+};
+
+static _TaskManagerFragmentSend _TaskManagerFragmentSends[TASKMGR_FRAGMENT_SEND_SLOTS];
+
+/*!	\brief Build one fragment of a message in a packet
+	\param pkt - the packet; its command and node are left to the caller
+	\param s - the message
+	\param i - the fragment
+	\returns the length of the packet
+*/
+static int fragmentFill(_TaskManagerRadioPacket& pkt, const _TaskManagerFragmentSend* s, int i) {
+	int offset = i*s->m_room;
+	int n = (i==s->m_count-1) ? s->m_len-offset : s->m_room;
+	pkt.m_fromTaskId = s->m_fromTaskId;
+	pkt.m_data[0] = s->m_toTaskId;
+	pkt.m_data[1] = s->m_msgId;
+	pkt.m_data[2] = i;
+	pkt.m_data[3] = s->m_count;
+	pkt.m_data[4] = offset&0x0ff;
+	pkt.m_data[5] = (offset>>8)&0x0ff;
+	memcpy(&pkt.m_data[TASKMGR_FRAGMENT_HEADER_SIZE], &s->m_buf[offset], n);
+	if(s->m_isString && i==s->m_count-1) pkt.m_data[TASKMGR_FRAGMENT_HEADER_SIZE+n-1] = '\0';
+	return TASKMGR_RADIO_HEADER_SIZE+TASKMGR_FRAGMENT_HEADER_SIZE+n;
+}
+
+/*!	\brief Send a message to another node as tmrFragment packets.  Internal routine.
+
+	With reliable delivery on, the fragments are sent as the reliable window to the node has room,
+	from this call and then from the radio receiver task.  Fragments that cannot all be sent within
+	TASKMGR_REASSEMBLY_TIMEOUT ms are given up on, as the receiver would discard them.
+	\param destNodeID - The target node
+	\param taskId - The target task
+	\param buf - The message
+	\param len - The length of the message, at most TASKMGR_MESSAGE_SIZE
+	\param isString - If true, a '\\0' is sent in place of buf[len-1]
+	\returns - true if every fragment was sent or, with reliable delivery on, is waiting to be sent;
+	false if TASKMGR_FRAGMENT_SEND_SLOTS messages are already waiting
+*/
+bool TaskManager::radioSendFragments(tm_nodeId_t destNodeID, tm_taskId_t taskId, const byte* buf, int len, bool isString) {
+	_TaskManagerFragmentSend msg;
+	_TaskManagerFragmentSend* s = &msg;
+	// leave room for the reliability header, so every fragment can be sent reliably, and for routing
+	msg.m_room = radioFrameRoom(destNodeID) - TASKMGR_FRAGMENT_HEADER_SIZE
+		- (m_radioReliable ? TASKMGR_RELIABLE_HEADER_SIZE : 0);
+	int count = (len+msg.m_room-1)/msg.m_room;
+	bool ok = true;
+	if(count>TASKMGR_FRAGMENT_MAX) return false;
+	msg.m_count = count;
+	if(m_radioReliable) {
+		for(int i=0; i<TASKMGR_FRAGMENT_SEND_SLOTS && s==&msg; i++) {
+			if(_TaskManagerFragmentSends[i].m_toNodeId==0) s = &_TaskManagerFragmentSends[i];
+		}
+		if(s==&msg) return false;
+		if(s->m_buf==NULL) s->m_buf = new byte[TASKMGR_MESSAGE_SIZE];
+		memcpy(s->m_buf, buf, len);
+		s->m_room = msg.m_room;
+		s->m_count = msg.m_count;
+	} else {
+		msg.m_buf = (byte*)buf;
+	}
+	s->m_toNodeId = destNodeID;
+	s->m_fromTaskId = myId();
+	s->m_toTaskId = taskId;
+	s->m_msgId = _TaskManagerNextMsgId++;
+	s->m_next = 0;
+	s->m_isString = isString;
+	s->m_len = len;
+	s->m_started = ::millis();
+	radioBuf.m_cmd = tmrFragment;
+	radioBuf.m_fromNodeId = myNodeId();
+	if(s!=&msg) {
+		radioFragmentService();
+		return true;
+	}
+	for(int i=0; i<count; i++) ok = radioSender(destNodeID, fragmentFill(radioBuf, &msg, i)) && ok;
+	return ok;
+}
+
+/*!	\brief Send the fragments of messages that are waiting for room in the reliable window.  Internal routine.
+
+	Called by radioSendFragments() and on each pass of the radio receiver task.
+*/
+void TaskManager::radioFragmentService() {
+	for(int i=0; i<TASKMGR_FRAGMENT_SEND_SLOTS; i++) {
+		_TaskManagerFragmentSend* s = &_TaskManagerFragmentSends[i];
+		if(s->m_toNodeId==0) continue;
+		radioBuf.m_cmd = tmrFragment;
+		radioBuf.m_fromNodeId = myNodeId();
+		while(s->m_next<s->m_count && radioSender(s->m_toNodeId, fragmentFill(radioBuf, s, s->m_next))) s->m_next++;
+		if(s->m_next==s->m_count) {
+			s->m_toNodeId = 0;
+		} else if(::millis()-s->m_started>=TASKMGR_REASSEMBLY_TIMEOUT) {
+			s->m_toNodeId = 0;
+			_TaskManagerReassemblyDrops++;
+		}
+	}
+}
+
+/*!	\brief Add the tmrFragment packet being received to its message, and deliver the message if it is complete.  Internal routine.
+	\param len - the length of the packet
+*/
+void TaskManager::radioReassemble(int len) {
+	_TaskManagerReassembly* r = NULL;
+	_TaskManagerReassembly* oldest = NULL;
+	byte* hdr = m_rxPacket->m_data;
+	int n = len-TASKMGR_RADIO_HEADER_SIZE-TASKMGR_FRAGMENT_HEADER_SIZE;
+	int offset = hdr[4] | (hdr[5]<<8);
+	if(n<=0 || hdr[3]==0 || hdr[3]>TASKMGR_FRAGMENT_MAX || hdr[2]>=hdr[3] || offset+n>(int)TASKMGR_MESSAGE_SIZE) return;
+	for(int i=0; i<TASKMGR_REASSEMBLY_SLOTS && r==NULL; i++) {
+		_TaskManagerReassembly* s = &_TaskManagerReassemblies[i];
+		if(s->m_fromNodeId==m_rxPacket->m_fromNodeId && s->m_fromTaskId==m_rxPacket->m_fromTaskId && s->m_msgId==hdr[1]) r = s;
+	}
+	if(r==NULL) {
+		// use a free slot, or give up on the oldest message
+		for(int i=0; i<TASKMGR_REASSEMBLY_SLOTS && r==NULL; i++) {
+			_TaskManagerReassembly* s = &_TaskManagerReassemblies[i];
+			if(s->m_fromNodeId==0) r = s;
+			else if(oldest==NULL || (long)(s->m_started-oldest->m_started)<0) oldest = s;
+		}
+		if(r==NULL) {
+			r = oldest;
+			_TaskManagerReassemblyDrops++;
+		}
+		if(r->m_buf==NULL) r->m_buf = new byte[TASKMGR_MESSAGE_SIZE];
+		r->m_fromNodeId = m_rxPacket->m_fromNodeId;
+		r->m_fromTaskId = m_rxPacket->m_fromTaskId;
+		r->m_toTaskId = hdr[0];
+		r->m_msgId = hdr[1];
+		r->m_count = hdr[3];
+		r->m_have = 0;
+		r->m_len = 0;
+		r->m_started = ::millis();
+	}
+	memcpy(&r->m_buf[offset], &hdr[TASKMGR_FRAGMENT_HEADER_SIZE], n);
+	r->m_have |= 1UL<<hdr[2];
+	if(hdr[2]==r->m_count-1) r->m_len = offset+n;
+	if(r->m_have==(r->m_count==32 ? 0xffffffffUL : (1UL<<r->m_count)-1)) {
+		internalSendMessage(r->m_fromNodeId, r->m_fromTaskId, r->m_toTaskId, r->m_buf, r->m_len);
+		r->m_fromNodeId = 0;
+	}
+}
+
+unsigned long TaskManager::radioReassemblyDrops() {
+	return _TaskManagerReassemblyDrops;
+}
+
+//
+// Compression
+//
+// A tmrCompressed frame is the usual header followed by [target task][flags][keyframe number] and
+// then the message coded by TmCompress().  Messages from a task to a task on a node form a stream.
+// Every TASKMGR_COMPRESS_KEYFRAME'th message of a stream is a keyframe, coded on its own; both
+// ends keep it, and the messages after it are coded against it (TASKMGR_COMPRESS_DELTA).  A delta
+// names its keyframe, so one whose keyframe was lost is recognized and discarded.  Keyframe numbers
+// come from one counter for all streams, so a stream slot that is reused does not repeat a number
+// the receiver still holds, and the sender only keeps a keyframe once its packet has been queued.
+//
+
+/*!	\struct _TaskManagerCompressStream
+	The keyframe of a stream of compressed messages, at the sending or the receiving end.
+*/
+struct _TaskManagerCompressStream {
+	tm_nodeId_t m_nodeId;		// the other end's node; 0 if the slot is free
+	tm_taskId_t m_fromTaskId;	// source task
+	tm_taskId_t m_toTaskId;		// target task
+	byte m_keyId;				// the keyframe's number
+	byte m_count;				// messages sent since the keyframe, including it
+	byte m_skip;				// messages still to send uncompressed, because deltas did not pay
+	int m_len;					// the keyframe's length; -1 if there is none
+	unsigned long m_used;		// _TaskManagerCompressClock when last used
+	byte* m_buf;				// TASKMGR_RADIO_DATA_SIZE bytes, allocated when first used
+};
+
+static _TaskManagerCompressStream _TaskManagerCompressOut[TASKMGR_COMPRESS_STREAMS];
+static _TaskManagerCompressStream _TaskManagerCompressIn[TASKMGR_COMPRESS_STREAMS];
+static unsigned long _TaskManagerCompressClock = 0;
+static long _TaskManagerCompressSaved = 0;
+static unsigned long _TaskManagerCompressDrops = 0;
+static byte _TaskManagerCompressKeys = 0;		// the last keyframe number used
+
+/*!	\struct _TaskManagerCompressPending
+	The packet in radioBuf that radioCompress() coded, until radioSender() knows whether it was queued.
+*/
+struct _TaskManagerCompressPending {
+	_TaskManagerCompressStream* m_stream;	// NULL if there is none
+	int m_len;					// for a keyframe, its length; -1 for a delta
+	byte m_keyId;				// for a keyframe, its number
+	byte m_buf[TASKMGR_RADIO_DATA_SIZE];	// for a keyframe, the message
+};
+
+static _TaskManagerCompressPending _TaskManagerCompressSending = { NULL, -1, 0, {0} };
+
+/*!	\brief Find a stream, optionally creating it
+	\param streams -- _TaskManagerCompressOut or _TaskManagerCompressIn
+	\param nodeId -- the node at the other end
+	\param fromTaskId -- the source task
+	\param toTaskId -- the target task
+	\param create -- if true and there is no such stream, a free slot or the least recently used one is taken
+	\returns the stream, or NULL if there is none
+*/
+static _TaskManagerCompressStream* compressStream(_TaskManagerCompressStream* streams, tm_nodeId_t nodeId,
+		tm_taskId_t fromTaskId, tm_taskId_t toTaskId, bool create) {
+	_TaskManagerCompressStream* s = NULL;
+	for(int i=0; i<TASKMGR_COMPRESS_STREAMS; i++) {
+		_TaskManagerCompressStream* c = &streams[i];
+		if(c->m_nodeId==nodeId && c->m_fromTaskId==fromTaskId && c->m_toTaskId==toTaskId) {
+			c->m_used = ++_TaskManagerCompressClock;
+			return c;
+		}
+		if(s==NULL || (s->m_nodeId!=0 && (c->m_nodeId==0 || c->m_used<s->m_used))) s = c;
+	}
+	if(!create) return NULL;
+	if(s->m_buf==NULL) s->m_buf = new byte[TASKMGR_RADIO_DATA_SIZE];
+	s->m_nodeId = nodeId;
+	s->m_fromTaskId = fromTaskId;
+	s->m_toTaskId = toTaskId;
+	s->m_keyId = 0;
+	s->m_count = 0;
+	s->m_skip = 0;
+	s->m_len = -1;
+	s->m_used = ++_TaskManagerCompressClock;
+	return s;
+}
+
+/*!	\brief Turn the tmrMessage packet in radioBuf into a tmrCompressed packet, if that is worthwhile.  Internal routine.
+	\param destNodeID - The target node
+	\param len - The length of the packet in radioBuf
+	\returns - the length of the packet in radioBuf, which is unchanged if it was not compressed
+*/
+int TaskManager::radioCompress(tm_nodeId_t destNodeID, int len) {
+	byte coded[TASKMGR_RADIO_DATA_SIZE];
+	const byte* msg = &radioBuf.m_data[1];
+	int msgLen = len-TASKMGR_RADIO_HEADER_SIZE-1;
+	// leave room for the reliability and routing headers
+	int room = radioFrameRoom(destNodeID) - TASKMGR_COMPRESS_HEADER_SIZE - (m_radioReliable ? TASKMGR_RELIABLE_HEADER_SIZE : 0);
+	int n;
+	byte flags = 0;
+	if(msgLen<=TASKMGR_COMPRESS_HEADER_SIZE || room<=0) return len;
+	_TaskManagerCompressStream* s = compressStream(_TaskManagerCompressOut, destNodeID, radioBuf.m_fromTaskId, radioBuf.m_data[0], true);
+	if(s->m_skip!=0) {
+		s->m_skip--;
+		return len;
+	}
+	if(s->m_len>=0 && s->m_count<TASKMGR_COMPRESS_KEYFRAME) {
+		// a delta is only sent if it makes the packet shorter
+		int most = msgLen-TASKMGR_COMPRESS_HEADER_SIZE;
+		n = TmCompress(msg, msgLen, s->m_buf, s->m_len, coded, most<room ? most : room);
+		if(n<0) {
+			s->m_len = -1;
+			s->m_skip = TASKMGR_COMPRESS_KEYFRAME;
+			return len;
+		}
+		flags = TASKMGR_COMPRESS_DELTA;
+		_TaskManagerCompressSending.m_len = -1;
+		_TaskManagerCompressSending.m_keyId = s->m_keyId;
+	} else {
+		n = TmCompress(msg, msgLen, NULL, 0, coded, room);
+		if(n<0) return len;
+		// kept by compressSent() once the packet is queued
+		memcpy(_TaskManagerCompressSending.m_buf, msg, msgLen);
+		_TaskManagerCompressSending.m_len = msgLen;
+		_TaskManagerCompressSending.m_keyId = ++_TaskManagerCompressKeys;
+	}
+	_TaskManagerCompressSending.m_stream = s;
+	radioBuf.m_cmd = tmrCompressed;
+	radioBuf.m_data[1] = flags;
+	radioBuf.m_data[2] = _TaskManagerCompressSending.m_keyId;
+	memcpy(&radioBuf.m_data[TASKMGR_COMPRESS_HEADER_SIZE], coded, n);
+	n += TASKMGR_RADIO_HEADER_SIZE+TASKMGR_COMPRESS_HEADER_SIZE;
+	_TaskManagerCompressSaved += len-n;
+	return n;
+}
+
+/*!	\brief Update the stream of the packet radioCompress() coded, now that it is known whether it was queued
+	\param queued -- true if the packet was queued for the radio
+*/
+static void compressSent(bool queued) {
+	_TaskManagerCompressStream* s = _TaskManagerCompressSending.m_stream;
+	if(s==NULL) return;
+	_TaskManagerCompressSending.m_stream = NULL;
+	if(!queued) return;
+	if(_TaskManagerCompressSending.m_len<0) {
+		s->m_count++;
+		return;
+	}
+	memcpy(s->m_buf, _TaskManagerCompressSending.m_buf, _TaskManagerCompressSending.m_len);
+	s->m_len = _TaskManagerCompressSending.m_len;
+	s->m_keyId = _TaskManagerCompressSending.m_keyId;
+	s->m_count = 1;
+}
+
+/*!	\brief Deliver the message in the tmrCompressed packet in m_rxPacket->  Internal routine.
+	\param len - the length of the packet
+*/
+void TaskManager::radioDecompress(int len) {
+	byte msg[TASKMGR_RADIO_DATA_SIZE];
+	byte* hdr = m_rxPacket->m_data;
+	_TaskManagerCompressStream* s;
+	int n;
+	if(len<(int)(TASKMGR_RADIO_HEADER_SIZE+TASKMGR_COMPRESS_HEADER_SIZE)) return;
+	if(hdr[1]&TASKMGR_COMPRESS_DELTA) {
+		s = compressStream(_TaskManagerCompressIn, m_rxPacket->m_fromNodeId, m_rxPacket->m_fromTaskId, hdr[0], false);
+		if(s==NULL || s->m_len<0 || s->m_keyId!=hdr[2]) {
+			_TaskManagerCompressDrops++;
+			return;
+		}
+		n = TmDecompress(&hdr[TASKMGR_COMPRESS_HEADER_SIZE], len-TASKMGR_RADIO_HEADER_SIZE-TASKMGR_COMPRESS_HEADER_SIZE,
+			s->m_buf, s->m_len, msg, TASKMGR_MESSAGE_SIZE);
+		if(n<0) return;
+	} else {
+		n = TmDecompress(&hdr[TASKMGR_COMPRESS_HEADER_SIZE], len-TASKMGR_RADIO_HEADER_SIZE-TASKMGR_COMPRESS_HEADER_SIZE,
+			NULL, 0, msg, TASKMGR_MESSAGE_SIZE);
+		if(n<0) return;
+		s = compressStream(_TaskManagerCompressIn, m_rxPacket->m_fromNodeId, m_rxPacket->m_fromTaskId, hdr[0], true);
+		memcpy(s->m_buf, msg, n);
+		s->m_len = n;
+		s->m_keyId = hdr[2];
+	}
+	internalSendMessage(m_rxPacket->m_fromNodeId, m_rxPacket->m_fromTaskId, hdr[0], msg, n);
+}
+
+void TaskManager::setRadioCompression(bool compress) {
+	m_radioCompress = compress;
+}
+
+unsigned long TaskManager::radioCompressSaved() {
+	return _TaskManagerCompressSaved>0 ? _TaskManagerCompressSaved : 0;
+}
+
+unsigned long TaskManager::radioCompressDrops() {
+	return _TaskManagerCompressDrops;
+}
+
+//
+// Routing
+//
+// A node out of range is reached through others.  A frame for it is sent to the next hop as a
+// tmrRouted frame:  the usual header, with this hop's node, followed by [dest lo][dest hi]
+// [origin lo][origin hi][ttl][inner cmd], then the m_data bytes of the frame it carries.  Each node
+// on the way forwards it from the receiver task, and the destination unwraps it and processes it
+// as if the origin had sent it.  Reliable delivery, if on, applies to each hop.
+// Routes are learned from frames heard (a node sending directly is a neighbour, and a tmrRouted
+// frame gives a route back to its origin) and from tmrRoute frames.  Each node broadcasts one
+// every advertising interval, listing [node lo][node hi][hops][next hop lo][next hop hi] for the
+// routes it has.  A receiver ignores the routes that go through itself.
+//
+
+/*!	\struct _TaskManagerRoute
+	A route to a node.
+*/
+struct _TaskManagerRoute {
+	tm_nodeId_t m_nodeId;		// 0 if the entry is free
+	tm_nodeId_t m_nextHop;		// the neighbour frames are sent to
+	byte m_hops;				// hops to the node; 1 for a neighbour
+	bool m_static;				// set by addRoute(); never learned over or expired
+	unsigned long m_heard;		// millis() when last learned
+};
+
+/*!	\struct _TaskManagerRouteHeld
+	A tmrRouted frame waiting to be passed on, because its next hop was not taking frames.
+*/
+struct _TaskManagerRouteHeld {
+	byte m_len;
+	byte m_frame[sizeof(_TaskManagerRadioPacket)];
+};
+
+static _TaskManagerRoute _TaskManagerRoutes[TASKMGR_ROUTE_SLOTS];
+static byte _TaskManagerRouteCount = 0;		// entries in use
+static unsigned long _TaskManagerRouteDrops = 0;
+// frames being passed on, oldest first
+static _TaskManagerRouteHeld _TaskManagerRouteHold[TASKMGR_ROUTE_HOLD];
+static byte _TaskManagerRouteHoldHead = 0;
+static byte _TaskManagerRouteHoldCount = 0;
+
+/*!	\brief Find the route to a node
+	\returns the entry, or NULL if there is none
+*/
+static _TaskManagerRoute* routeFind(tm_nodeId_t nodeId) {
+	if(_TaskManagerRouteCount==0) return NULL;
+	for(int i=0; i<TASKMGR_ROUTE_SLOTS; i++) {
+		if(_TaskManagerRoutes[i].m_nodeId==nodeId) return &_TaskManagerRoutes[i];
+	}
+	return NULL;
+}
+
+/*!	\brief Return the node to send frames for a node to:  its next hop, or the node itself if there is no route
+*/
+static tm_nodeId_t routeNextHop(tm_nodeId_t nodeId) {
+	_TaskManagerRoute* r = routeFind(nodeId);
+	return r!=NULL ? r->m_nextHop : nodeId;
+}
+
+/*!	\brief Learn a route to a node, if it is new or better than the one known
+	\param nodeId - the node
+	\param nextHop - the neighbour it was heard through
+	\param hops - hops to the node through nextHop
+*/
+static void routeLearn(tm_nodeId_t nodeId, tm_nodeId_t nextHop, byte hops) {
+	_TaskManagerRoute* r = routeFind(nodeId);
+	if(r!=NULL) {
+		if(r->m_static) return;
+		// news from the current next hop is always taken; otherwise only a shorter route, counting
+		// a next hop that sends have been failing to as farther away
+		if(r->m_nextHop!=nextHop && hops+linkPenalty(nextHop)>=r->m_hops+linkPenalty(r->m_nextHop)) return;
+	} else {
+		// use a free entry, or replace the longest learned route if the new one is shorter
+		for(int i=0; i<TASKMGR_ROUTE_SLOTS; i++) {
+			_TaskManagerRoute* e = &_TaskManagerRoutes[i];
+			if(e->m_nodeId==0) {
+				r = e;
+				break;
+			}
+			if(!e->m_static && e->m_hops>hops
+					&& (r==NULL || e->m_hops>r->m_hops || (e->m_hops==r->m_hops && (long)(e->m_heard-r->m_heard)<0))) r = e;
+		}
+		if(r==NULL) return;
+		if(r->m_nodeId==0) _TaskManagerRouteCount++;
+		r->m_nodeId = nodeId;
+		r->m_static = false;
+	}
+	r->m_nextHop = nextHop;
+	r->m_hops = hops;
+	r->m_heard = ::millis();
+}
+
+/*!	\brief Forget a route
+*/
+static void routeForget(_TaskManagerRoute* r) {
+	r->m_nodeId = 0;
+	_TaskManagerRouteCount--;
+}
+
+/*!	\brief Return the number of m_data bytes a frame to a node can carry.  Internal routine.
+
+	Frames routed through other nodes lose TASKMGR_ROUTE_HEADER_SIZE bytes to the routing header.
+	\param nodeId - the node
+*/
+int TaskManager::radioFrameRoom(tm_nodeId_t nodeId) {
+	if(routeNextHop(nodeId)!=nodeId) return TASKMGR_RADIO_DATA_SIZE-TASKMGR_ROUTE_HEADER_SIZE;
+	return TASKMGR_RADIO_DATA_SIZE;
+}
+
+/*!	\brief Return true if the received frame is a tmrReliable frame carrying a tmrRouted frame to pass on,
+	and there is no room to hold it.  Internal routine.
+	\param len - the length of the frame
+*/
+bool TaskManager::radioRouteCannotHold(int len) {
+	byte* rel = m_rxPacket->m_data;
+	if(_TaskManagerRouteHoldCount<TASKMGR_ROUTE_HOLD || len<(int)(TASKMGR_RADIO_HEADER_SIZE+TASKMGR_RELIABLE_HEADER_SIZE+2)
+			|| (rel[3]&~TASKMGR_RELIABLE_ACK_VALID)!=tmrRouted) return false;
+	byte* hdr = &rel[TASKMGR_RELIABLE_HEADER_SIZE];
+	return (tm_nodeId_t)(hdr[0] | (hdr[1]<<8))!=myNodeId();
+}
+
+/*!	\brief Process a tmrRouted frame being received:  deliver it here or send it on.  Internal routine.
+	\param len - the length of the frame
+*/
+void TaskManager::radioRouteReceive(int len) {
+	byte* hdr = m_rxPacket->m_data;
+	tm_nodeId_t dest = hdr[0] | (hdr[1]<<8);
+	tm_nodeId_t origin = hdr[2] | (hdr[3]<<8);
+	byte ttl = hdr[4];
+	if(len<(int)(TASKMGR_RADIO_HEADER_SIZE+TASKMGR_ROUTE_HEADER_SIZE) || ttl==0 || ttl>TASKMGR_ROUTE_TTL) return;
+	if(m_radioRouteInterval!=0 && origin!=myNodeId()) {
+		// the way back to the origin is the way this came
+		routeLearn(origin, m_rxPacket->m_fromNodeId, TASKMGR_ROUTE_TTL-ttl+1);
+	}
+	if(dest==myNodeId()) {
+		byte cmd = hdr[5];
+		// hop-by-hop frames are never carried inside
+		if(cmd==tmrRouted || cmd==tmrRoute || cmd==tmrReliable || cmd==tmrReliableAck) return;
+		m_rxPacket->m_cmd = cmd;
+		m_rxPacket->m_fromNodeId = origin;
+		len -= TASKMGR_ROUTE_HEADER_SIZE;
+		memmove(hdr, &hdr[TASKMGR_ROUTE_HEADER_SIZE], len-TASKMGR_RADIO_HEADER_SIZE);
+		radioDispatch(len);
+		return;
+	}
+	if(ttl==1) {
+		_TaskManagerRouteDrops++;
+		return;
+	}
+	hdr[4] = ttl-1;
+	m_rxPacket->m_fromNodeId = myNodeId();
+	// with no route, try the node itself.  If the next hop isn't taking frames (its reliable
+	// window is full), hold the frame and try again on later passes.
+	if(_TaskManagerRouteHoldCount==0 && radioSendHop(routeNextHop(dest), (byte*)m_rxPacket, len)) return;
+	if(_TaskManagerRouteHoldCount==TASKMGR_ROUTE_HOLD) {
+		_TaskManagerRouteDrops++;
+		return;
+	}
+	_TaskManagerRouteHeld* h = &_TaskManagerRouteHold[(_TaskManagerRouteHoldHead+_TaskManagerRouteHoldCount)%TASKMGR_ROUTE_HOLD];
+	h->m_len = len;
+	memcpy(h->m_frame, m_rxPacket, len);
+	_TaskManagerRouteHoldCount++;
+}
+
+/*!	\brief Learn routes from a tmrRoute frame in m_rxPacket->  Internal routine.
+	\param len - the length of the frame
+*/
+void TaskManager::radioRouteAdvert(int len) {
+	byte* rec = (byte*)m_rxPacket;
+	if(m_radioRouteInterval==0) return;
+	for(int at=TASKMGR_RADIO_HEADER_SIZE; at+TASKMGR_ROUTE_RECORD_SIZE<=len; at += TASKMGR_ROUTE_RECORD_SIZE) {
+		tm_nodeId_t nodeId = rec[at] | (rec[at+1]<<8);
+		tm_nodeId_t nextHop = rec[at+3] | (rec[at+4]<<8);
+		// a route through this node is no use to it
+		if(nodeId!=myNodeId() && nodeId!=0 && nextHop!=myNodeId() && rec[at+2]<TASKMGR_ROUTE_TTL) {
+			routeLearn(nodeId, m_rxPacket->m_fromNodeId, rec[at+2]+1);
+		}
+	}
+}
+
+/*!	\brief Pass on held frames, and expire learned routes and advertise routes when due.  Internal routine.
+*/
+void TaskManager::radioRouteService() {
+	_TaskManagerRadioPacket advert;
+	// pass on held frames, in order
+	while(_TaskManagerRouteHoldCount!=0) {
+		_TaskManagerRouteHeld* h = &_TaskManagerRouteHold[_TaskManagerRouteHoldHead];
+		byte* hdr = &h->m_frame[TASKMGR_RADIO_HEADER_SIZE];
+		if(!radioSendHop(routeNextHop(hdr[0] | (hdr[1]<<8)), h->m_frame, h->m_len)) break;
+		_TaskManagerRouteHoldHead = (_TaskManagerRouteHoldHead+1)%TASKMGR_ROUTE_HOLD;
+		_TaskManagerRouteHoldCount--;
+	}
+	if(m_radioRouteInterval==0 || ::millis()-m_radioRouteAdvertised<m_radioRouteInterval) return;
+	m_radioRouteAdvertised = ::millis();
+	// a route not heard of for three intervals is gone
+	for(int i=0; i<TASKMGR_ROUTE_SLOTS; i++) {
+		_TaskManagerRoute* r = &_TaskManagerRoutes[i];
+		if(r->m_nodeId!=0 && !r->m_static && ::millis()-r->m_heard>=3UL*m_radioRouteInterval) routeForget(r);
+	}
+	advert.m_cmd = tmrRoute;
+	advert.m_fromNodeId = myNodeId();
+	advert.m_fromTaskId = TASKMGR_RF_MONITOR_TASK;
+	int len = TASKMGR_RADIO_HEADER_SIZE;
+	for(int i=0; i<TASKMGR_ROUTE_SLOTS; i++) {
+		_TaskManagerRoute* r = &_TaskManagerRoutes[i];
+		if(r->m_nodeId==0) continue;
+		byte* rec = ((byte*)&advert)+len;
+		rec[0] = r->m_nodeId&0x0ff;
+		rec[1] = (r->m_nodeId>>8)&0x0ff;
+		rec[2] = r->m_hops;
+		rec[3] = r->m_nextHop&0x0ff;
+		rec[4] = (r->m_nextHop>>8)&0x0ff;
+		len += TASKMGR_ROUTE_RECORD_SIZE;
+	}
+	// an empty advertisement still tells nodes in range about this one
+	radioTransmit(TASKMGR_BROADCAST_NODE, (byte*)&advert, len);
+}
+
+void TaskManager::setRadioRouting(unsigned int advertiseMs) {
+	if(m_radioRouteInterval==0 && advertiseMs!=0) m_radioRouteAdvertised = ::millis()-advertiseMs;	// advertise now
+	m_radioRouteInterval = advertiseMs;
+}
+
+bool TaskManager::addRoute(tm_nodeId_t nodeId, tm_nodeId_t nextHop) {
+	_TaskManagerRoute* r = routeFind(nodeId);
+	for(int i=0; i<TASKMGR_ROUTE_SLOTS && r==NULL; i++) {
+		if(_TaskManagerRoutes[i].m_nodeId==0) r = &_TaskManagerRoutes[i];
+	}
+	// take a learned route's place if the table is full
+	for(int i=0; i<TASKMGR_ROUTE_SLOTS && r==NULL; i++) {
+		if(!_TaskManagerRoutes[i].m_static) r = &_TaskManagerRoutes[i];
+	}
+	if(r==NULL || nodeId==0) return false;
+	if(r->m_nodeId==0) _TaskManagerRouteCount++;
+	r->m_nodeId = nodeId;
+	r->m_nextHop = nextHop;
+	r->m_hops = (nextHop==nodeId) ? 1 : 2;
+	r->m_static = true;
+	r->m_heard = ::millis();
+	return true;
+}
+
+void TaskManager::removeRoute(tm_nodeId_t nodeId) {
+	_TaskManagerRoute* r = routeFind(nodeId);
+	if(r!=NULL) routeForget(r);
+}
+
+bool TaskManager::getRoute(tm_nodeId_t nodeId, tm_nodeId_t& nextHop, byte& hops) {
+	_TaskManagerRoute* r = routeFind(nodeId);
+	if(r==NULL) return false;
+	nextHop = r->m_nextHop;
+	hops = r->m_hops;
+	return true;
+}
+
+unsigned long TaskManager::radioRouteDrops() {
+	return _TaskManagerRouteDrops;
+}
+
+//
+// Status
+//
+// A tmrStatus frame is the usual header alone; the reply is a tmrAck frame with [target task], a
+// TaskManagerNodeStatus, and a TaskManagerTaskStatus for each task that fits.  A tmrTaskStatus
+// frame carries [task]; the reply is a tmrTaskAck frame with [target task] and that task's
+// TaskManagerTaskStatus, or nothing if there is no such task.  Replies come from the receiver task
+// and reach the asking task as messages from TASKMGR_RF_MONITOR_TASK.  A request to this node is
+// held until the receiver task's next pass, so the asking task is waiting for the reply by then.
+//
+
+/*!	\struct _TaskManagerLocalStatus
+	A status request to this node, waiting for the receiver task.
+*/
+struct _TaskManagerLocalStatus {
+	byte m_cmd;					// tmrStatus or tmrTaskStatus; 0 if nothing is waiting
+	tm_taskId_t m_fromTaskId;	// the asking task
+	tm_taskId_t m_taskId;		// for tmrTaskStatus, the task
+};
+
+static _TaskManagerLocalStatus _TaskManagerLocalRequest;
+
+/*!	\brief Fill in the status of a task.  Internal routine.
+*/
+void TaskManager::radioTaskStatus(_TaskManagerTask* tsk, TaskManagerTaskStatus* st) {
+	unsigned int drops = tsk->m_mailbox==NULL ? 0 : tsk->m_mailbox->drops();
+	st->m_taskId = tsk->m_id;
+	st->m_stateFlags = tsk->m_stateFlags;
+	st->m_pending = tsk->m_mailbox==NULL ? 0 : tsk->m_mailbox->size();
+	st->m_mailboxDrops = drops>0xffff ? 0xffff : drops;
+	st->m_overruns = tsk->m_overruns;
+}
+
+/*!	\brief Build a status reply in buf.  Internal routine.
+	\param cmd - tmrStatus or tmrTaskStatus
+	\param taskId - for tmrTaskStatus, the task
+	\param buf - where the reply goes
+	\param room - the size of buf.  Task records that do not fit are left out.
+	\returns the length of the reply
+*/
+int TaskManager::radioStatus(byte cmd, tm_taskId_t taskId, byte* buf, int room) {
+	ring<_TaskManagerTask> tmpTasks;
+	_TaskManagerTask* last = &(m_theTasks.back());
+	int len = 0;
+	if(cmd==tmrTaskStatus) {
+		_TaskManagerTask* tsk = findTaskById(taskId);
+		if(tsk==NULL) return 0;
+		radioTaskStatus(tsk, (TaskManagerTaskStatus*)buf);
+		return sizeof(TaskManagerTaskStatus);
+	}
+	TaskManagerNodeStatus* node = (TaskManagerNodeStatus*)buf;
+	node->m_uptime = runtime();
+	node->m_receiveDrops = radioReceiveDrops();
+	node->m_sendDrops = radioSendDrops();
+	node->m_sendFailures = radioSendFailures();
+	node->m_taskCount = 0;
+	len = sizeof(TaskManagerNodeStatus);
+	// every task on this executor, as many as fit
+	tmpTasks = m_theTasks;
+	while(true) {
+		_TaskManagerTask* tsk = &(tmpTasks.front());
+		node->m_taskCount++;
+		if(len+(int)sizeof(TaskManagerTaskStatus)<=room) {
+			radioTaskStatus(tsk, (TaskManagerTaskStatus*)&buf[len]);
+			len += sizeof(TaskManagerTaskStatus);
+		}
+		if(tsk==last) break;
+		tmpTasks.move_next();
+	}
+	return len;
+}
+
+/*!	\brief Answer a tmrStatus or tmrTaskStatus frame being received.  Internal routine.
+
+	The reply is cut to what one frame to the asking node can carry after its routing and
+	reliability headers, so it is never sent some other way.
+	\param len - the length of the frame
+*/
+void TaskManager::radioStatusReply(int len) {
+	if(m_rxPacket->m_cmd==tmrTaskStatus && len<(int)TASKMGR_RADIO_HEADER_SIZE+1) return;
+	// the reply is built in radioBuf, apart from the request
+	int room = radioFrameRoom(m_rxPacket->m_fromNodeId) - 1 - (m_radioReliable ? TASKMGR_RELIABLE_HEADER_SIZE : 0);
+	int n = radioStatus(m_rxPacket->m_cmd, m_rxPacket->m_data[0], &radioBuf.m_data[1], room);
+	radioBuf.m_cmd = (m_rxPacket->m_cmd==tmrStatus) ? tmrAck : tmrTaskAck;
+	radioBuf.m_fromNodeId = myNodeId();
+	radioBuf.m_fromTaskId = TASKMGR_RF_MONITOR_TASK;
+	radioBuf.m_data[0] = m_rxPacket->m_fromTaskId;
+	radioSender(m_rxPacket->m_fromNodeId, TASKMGR_RADIO_HEADER_SIZE+1+n);
+}
+
+/*!	\brief Ask a node for its status.  Internal routine.
+*/
+bool TaskManager::radioStatusRequest(byte cmd, tm_nodeId_t nodeId, tm_taskId_t taskId) {
+	if(nodeId==0 || nodeId==myNodeId()) {
+		if(_TaskManagerLocalRequest.m_cmd!=0) return false;
+		_TaskManagerLocalRequest.m_fromTaskId = myId();
+		_TaskManagerLocalRequest.m_taskId = taskId;
+		_TaskManagerLocalRequest.m_cmd = cmd;
+		return true;
+	}
+	radioBuf.m_cmd = cmd;
+	radioBuf.m_fromNodeId = myNodeId();
+	radioBuf.m_fromTaskId = myId();
+	radioBuf.m_data[0] = taskId;
+	return radioSender(nodeId, TASKMGR_RADIO_HEADER_SIZE+(cmd==tmrTaskStatus ? 1 : 0));
+}
+
+/*!	\brief Answer a status request to this node.  Internal routine.
+*/
+void TaskManager::radioStatusLocal() {
+	byte reply[TASKMGR_RADIO_DATA_SIZE-1];
+	if(_TaskManagerLocalRequest.m_cmd==0) return;
+	int n = radioStatus(_TaskManagerLocalRequest.m_cmd, _TaskManagerLocalRequest.m_taskId, reply, sizeof(reply));
+	_TaskManagerLocalRequest.m_cmd = 0;
+	internalSendMessage(myNodeId(), TASKMGR_RF_MONITOR_TASK, _TaskManagerLocalRequest.m_fromTaskId, reply, n);
+}
+
+bool TaskManager::requestStatus(tm_nodeId_t nodeId) {
+	return radioStatusRequest(tmrStatus, nodeId, 0);
+}
+
+bool TaskManager::requestTaskStatus(tm_nodeId_t nodeId, tm_taskId_t taskId) {
+	return radioStatusRequest(tmrTaskStatus, nodeId, taskId);
+}
+
+//
+// Groups
+//
+// A tmrGroup frame is one broadcast frame:  the usual header followed by [group][target task]
+// and the message.  Every node in range receives it, and the receiver task drops it unless the
+// node is in the group, so no task is woken for other groups' messages.
+//
+
+static byte _TaskManagerGroups[256/8];	// bit g:  this node is in group g
+
+/*!	\brief Return true if this node is in a group
+*/
+static bool groupMember(byte groupId) {
+	return groupId==TASKMGR_GROUP_ALL || (_TaskManagerGroups[groupId>>3] & (1<<(groupId&7)));
+}
+
+/*!	\brief Send a message to a task on every node in a group.  Internal routine.
+	\param groupId - The group
+	\param taskId - The target task
+	\param buf - The message
+	\param len - The length of the message
+	\param isString - If true, a '\\0' is sent in place of buf[len-1]
+	\returns - true if the frame was queued
+*/
+bool TaskManager::radioSendGroup(byte groupId, tm_taskId_t taskId, const byte* buf, int len, bool isString) {
+	if(len<0 || len>(int)TASKMGR_GROUP_MESSAGE_SIZE) return false;
+	radioBuf.m_cmd = tmrGroup;
+	radioBuf.m_fromNodeId = myNodeId();
+	radioBuf.m_fromTaskId = myId();
+	radioBuf.m_data[0] = groupId;
+	radioBuf.m_data[1] = taskId;
+	memcpy(&radioBuf.m_data[2], buf, len);
+	if(isString && len>0) radioBuf.m_data[2+len-1] = '\0';
+	return radioSender(TASKMGR_BROADCAST_NODE, TASKMGR_RADIO_HEADER_SIZE+2+len);
+}
+
+bool TaskManager::broadcastMessage(byte groupId, tm_taskId_t taskId, char* message) {
+	char buf[TASKMGR_GROUP_MESSAGE_SIZE];
+	int len = strlen(message)+1;
+	// truncate to what one frame (and a task's message buffer) holds, here and on the other nodes
+	if(len>(int)TASKMGR_GROUP_MESSAGE_SIZE) len = TASKMGR_GROUP_MESSAGE_SIZE;
+	if(len>(int)TASKMGR_MESSAGE_SIZE) len = TASKMGR_MESSAGE_SIZE;
+	memcpy(buf, message, len);
+	buf[len-1] = '\0';
+	if(groupMember(groupId)) TaskManager::sendMessage(taskId, (void*)buf, len);
+	return radioSendGroup(groupId, taskId, (byte*)buf, len, true);
+}
+
+bool TaskManager::broadcastMessage(byte groupId, tm_taskId_t taskId, void* buf, int len) {
+	// checked before the local copy, so a message too long for the frame goes nowhere
+	if(len<0 || len>(int)TASKMGR_GROUP_MESSAGE_SIZE || len>(int)TASKMGR_MESSAGE_SIZE) return false;
+	if(groupMember(groupId)) TaskManager::sendMessage(taskId, buf, len);
+	return radioSendGroup(groupId, taskId, (byte*)buf, len, false);
+}
+
+void TaskManager::joinGroup(byte groupId) {
+	_TaskManagerGroups[groupId>>3] |= 1<<(groupId&7);
+}
+
+void TaskManager::leaveGroup(byte groupId) {
+	_TaskManagerGroups[groupId>>3] &= ~(1<<(groupId&7));
+}
+
+bool TaskManager::inGroup(byte groupId) {
+	return groupMember(groupId);
+}
+
+// If we have different radio receivers, they will have different instantiation routines.
+
+/*!	\class _TaskManagerEspNowTransport
+	\brief The ESP-NOW transport.  Node n is the station MAC A6:54:4D:00:(n>>8):(n&0xff).
+*/
+class _TaskManagerEspNowTransport : public TaskManagerTransport {
+public:
+	virtual bool begin(tm_nodeId_t nodeId);
+	virtual Status send(tm_nodeId_t nodeId, const byte* frame, int len);
+	virtual Status addPeer(tm_nodeId_t nodeId);
+	virtual Status delPeer(tm_nodeId_t nodeId);
+private:
+	static Status status(esp_err_t err);
+	static const byte* mac(tm_nodeId_t nodeId);
+};
+
+static _TaskManagerEspNowTransport _TaskManagerEspNow;
+
+/*!	\brief Convert an ESP-NOW error, and save it for TaskManager::lastESPError()
+*/
+TaskManagerTransport::Status _TaskManagerEspNowTransport::status(esp_err_t err) {
+	TaskMgr.m_lastESPError = err;
+	switch(err) {
+		case ESP_OK:					return tmtOk;
+		case ESP_ERR_ESPNOW_FULL:		return tmtFull;
+		case ESP_ERR_ESPNOW_EXIST:		return tmtExists;
+		case ESP_ERR_ESPNOW_NOT_FOUND:	return tmtNotFound;
+		default:						return tmtError;
+	}
+}
+
+/*!	\brief Start ESP-NOW.  WiFi must already be set up (see TaskManager::radioBegin()).
+*/
+bool _TaskManagerEspNowTransport::begin(tm_nodeId_t nodeId) {
+	(void)nodeId;		// radioBegin() has already put the node ID in the station mac
+	if(status(esp_now_init())!=tmtOk) {
+		if(DEBUG) Serial << "<--radioBegin error, esp_now_init() failed\n";
+		return false;
+	}
+
+	delay(10);
+
+	// register callbacks
+	if(status(esp_now_register_recv_cb(msg_recv_cb))!=tmtOk) {
+		Serial << "<--radioBegin error, esp_now_register_recv_cb() failed\n";
+		return false;
+	}
+	#if defined(NEWAPI)
+	if(status(esp_now_register_send_cb(esp_now_send_cb_t(msg_send_cb)))!=tmtOk) {
+	#else
+	if(status(esp_now_register_send_cb(msg_send_cb))!=tmtOk) {
+	#endif
+		Serial << "<--radioBegin error, esp_now_register_send_cb() failed\n";
+		return false;
+	}
+	return true;
+}
+
+/*!	\brief Return the MAC address of a node, or the broadcast address for TASKMGR_BROADCAST_NODE
+*/
+const byte* _TaskManagerEspNowTransport::mac(tm_nodeId_t nodeId) {
+	static const byte broadcastMac[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+	if(nodeId==TASKMGR_BROADCAST_NODE) return broadcastMac;
+	nodeMac[4] = (nodeId>>8)&0x0ff;
+	nodeMac[5] = nodeId&0x0ff;
+	return nodeMac;
+}
+
+TaskManagerTransport::Status _TaskManagerEspNowTransport::send(tm_nodeId_t nodeId, const byte* frame, int len) {
+	return status(esp_now_send(mac(nodeId), frame, len));
+}
+
+TaskManagerTransport::Status _TaskManagerEspNowTransport::addPeer(tm_nodeId_t nodeId) {
+	esp_now_peer_info_t peer;
+	memset(&peer, 0, sizeof(peer));
+	memcpy(peer.peer_addr, mac(nodeId), 6);
+	peer.channel = WIFI_CHANNEL;
+#if defined(NEWAPI)
+	peer.ifidx = WIFI_IF_STA;
+#else
+	peer.ifidx = ESP_IF_WIFI_STA;
+#endif
+	peer.encrypt=false;
+	return status(esp_now_add_peer(&peer));
+}
+
+TaskManagerTransport::Status _TaskManagerEspNowTransport::delPeer(tm_nodeId_t nodeId) {
+	return status(esp_now_del_peer(mac(nodeId)));
+}
+
+bool TaskManager::radioBegin(tm_nodeId_t nodeID, const char* ssid, const char* pw) {
+	// Initialize ESP-NOW and WiFi system
+	if(DEBUG) { Serial << "-->radioBegin  nodeID=" << nodeID <<"\n"; }
+	WiFi.mode(ssid==NULL ? WIFI_STA : WIFI_AP_STA);
+	if(DEBUG) { Serial << "\tradioBegin: past Wifi.mode()\n"; }
+	nodeMac[4] = (nodeID>>8)&0x0ff;
+	nodeMac[5] = nodeID & 0x0ff;
+#if defined(NEWAPI)
+	m_lastESPError = esp_wifi_set_mac(WIFI_IF_STA, nodeMac);
+#else
+	m_lastESPError = esp_wifi_set_mac(ESP_IF_WIFI_STA, nodeMac);
+#endif
+	if(DEBUG) Serial << "\tradioBegin: past esp_wifi_set_mac()\n";
+	if(m_lastESPError!=ESP_OK) {
+		if(DEBUG) Serial << "<--radioBegin error, can't set_mac()\n";
+		return false;
+	}
+	if(ssid==NULL) {
+		// ESP-NOW only
+		if(DEBUG) Serial << "\tradioBegin: esp-now only, about to WiFi.disconnect()\n";
+		WiFi.disconnect();
+		if(DEBUG) Serial << "\tradioBegin esp-now only: past Wifi.disconnect()\n";
+	} else {
+		// ESP-NOW, but project uses WiFi
+		// Get channel
+		int32_t channel;
+		channel = 0;
+	  	if (int32_t n = WiFi.scanNetworks()) {
+		  for (uint8_t i=0; i<n; i++) {
+			if (!strcmp(ssid, WiFi.SSID(i).c_str())) {
+			  channel = WiFi.channel(i);
+			} // end if
+		  } // end for each found network entry
+	  	} // end if there are any network entries
+		// Set our channel
+		esp_wifi_set_promiscuous(true);
+		esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+  		esp_wifi_set_promiscuous(false);
+		if(pw!=NULL) {
+			// we need to configure the WiFi link to the access point
+			WiFi.begin(ssid, pw);
+			for(int i=0; i<10 && WiFi.status()!=WL_CONNECTED; i++) delay(500);
+			if(WiFi.status()!=WL_CONNECTED) {
+				if(DEBUG) Serial << "<--radioBegin error, Wifi.begin(ssid,pw) failed.\n";
+				return false;
+			}
+		} else {
+			WiFi.disconnect();
+		}
+	}
+	/////
+
+	/////
+	return radioBegin(nodeID, _TaskManagerEspNow);
+}
+
+bool TaskManager::radioBegin(tm_nodeId_t nodeID, TaskManagerTransport& transport) {
+	if(!transport.begin(nodeID)) {
+		if(DEBUG) Serial << "<--radioBegin error, transport failed to start\n";
+		return false;
+	}
+	m_transport = &transport;
+
+	// start our handler
+	TaskMgr.add(TASKMGR_RF_MONITOR_TASK, radioReceiverTask);
+	TaskMgr.add(TASKMGR_RF_TX_TASK, radioTxTask);
+
+	// final cleanup
+	m_myNodeId = nodeID;
+	m_radioReceiverRunning = true;
+	if(DEBUG) Serial << "<--radioBegin successful return\n";
+	return true;
+}
+
+/*!	\brief Unregister the least recently used node in the peer cache
+	\returns false if the cache is empty
+*/
+static bool peerEvict(TaskManagerTransport* transport) {
+	_TaskManagerPeerEntry* victim = NULL;
+	for(int i=0; i<TASKMGR_PEER_CACHE_SIZE; i++) {
+		_TaskManagerPeerEntry* e = &_TaskManagerPeers[i];
+		if(e->m_nodeId!=0 && (victim==NULL || e->m_lastUsed<victim->m_lastUsed)) victim = e;
+	}
+	if(victim==NULL) return false;
+	transport->delPeer(victim->m_nodeId);
+	victim->m_nodeId = 0;
+	return true;
+}
+
+/*!	\brief Make sure a node is registered as a peer with the transport.  Internal routine.
+
+	Nodes in the peer cache are already registered.  Others are registered and added to the cache,
+	first unregistering the least recently used node if the cache or the transport's peer table is full.
+	\param nodeId - the node
+	\returns true if the node is registered
+*/
+bool TaskManager::radioPeer(tm_nodeId_t nodeId) {
+	_TaskManagerPeerEntry* slot = NULL;
+	for(int i=0; i<TASKMGR_PEER_CACHE_SIZE; i++) {
+		_TaskManagerPeerEntry* e = &_TaskManagerPeers[i];
+		if(e->m_nodeId==nodeId) {
+			e->m_lastUsed = ++_TaskManagerPeerClock;
+			_TaskManagerPeerHits++;
+			return true;
+		}
+		if(slot==NULL && e->m_nodeId==0) slot = e;
+	}
+	_TaskManagerPeerMisses++;
+	if(slot==NULL) peerEvict(m_transport);
+	TaskManagerTransport::Status status = m_transport->addPeer(nodeId);
+	// peers registered some other way may have filled the transport's table
+	while(status==TaskManagerTransport::tmtFull && peerEvict(m_transport)) status = m_transport->addPeer(nodeId);
+	if(status!=TaskManagerTransport::tmtOk && status!=TaskManagerTransport::tmtExists) return false;
+	for(int i=0; i<TASKMGR_PEER_CACHE_SIZE && (slot==NULL || slot->m_nodeId!=0); i++) slot = &_TaskManagerPeers[i];
+	slot->m_nodeId = nodeId;
+	slot->m_lastUsed = ++_TaskManagerPeerClock;
+	return true;
+}
+
+bool TaskManager::registerPeer(tm_nodeId_t nodeId) {
+	// register the partner nodeID as a peer, and keep it in the peer cache
+	if(m_transport==NULL) return false;
+	return radioPeer(nodeId);
+}
+
+bool TaskManager::unRegisterPeer(tm_nodeId_t nodeId){
+	// unregister the partner nodeID as a peer
+	if(m_transport==NULL) return false;
+	peerCacheForget(nodeId);
+	return m_transport->delPeer(nodeId)==TaskManagerTransport::tmtOk;
+}
+
+unsigned long TaskManager::radioPeerHits() {
+	return _TaskManagerPeerHits;
+}
+
+unsigned long TaskManager::radioPeerMisses() {
+	return _TaskManagerPeerMisses;
+}
+
+const char* TaskManager::lastESPError() {
+	return espErrText(m_lastESPError);
+}
+
+unsigned long TaskManager::radioReceiveDrops() {
+	return _TaskManagerIncomingMessages.drops();
+}
+
+unsigned long TaskManager::radioControlDrops() {
+	return _TaskManagerIncomingMessages.controlDrops();
+}
+
+void TaskManager::setRadioReceiveBudget(byte frames) {
+	m_radioRxBudget = frames;
+	m_radioRxScale = 0;
+	_TaskManagerReceiveStats.m_budget = frames;
+}
+
+void TaskManager::radioReceiveStats(TaskManagerReceiveStats& stats, bool reset) {
+	stats = _TaskManagerReceiveStats;
+	if(reset) {
+		_TaskManagerReceiveStats.m_passes = 0;
+		_TaskManagerReceiveStats.m_frames = 0;
+		_TaskManagerReceiveStats.m_budgetStops = 0;
+		_TaskManagerReceiveStats.m_maxPassUs = 0;
+		_TaskManagerReceiveStats.m_maxDepth = 0;
+	}
+}
+
+/*!	\brief Shorten an idle time to when a timer of period ms started at since comes due
+*/
+static void idleTimer(unsigned long& idle, unsigned long now, unsigned long since, unsigned long period) {
+	unsigned long left = (now-since<period) ? period-(now-since) : 0;
+	if(left<idle) idle = left;
+}
+
+/*!	\brief Return the ms until the radio tasks have something to do.  Internal routine.
+
+	Used by idleTime().
+	\returns 0 if frames are waiting to be processed or sent, otherwise the ms until the next
+	radio timer comes due, or TASKMGR_IDLE_FOREVER if none is running.  A frame held for its rate
+	limit or backoff counts as a timer, due when it may be sent.
+*/
+unsigned long TaskManager::radioIdleTime() {
+	unsigned long now = ::millis();
+	unsigned long idle = TASKMGR_IDLE_FOREVER;
+	_TaskManagerTxFrame* f;
+	if(!_TaskManagerIncomingMessages.isEmpty() || (!_TaskManagerTxQueue.isEmpty() && !_TaskManagerTxHeld)
+			|| !_TaskManagerTxSystemQueue.isEmpty() || !_TaskManagerTxResults.isEmpty()
+			|| _TaskManagerRouteHoldCount!=0 || _TaskManagerLocalRequest.m_cmd!=0) {
+		return 0;
+	}
+	if(_TaskManagerTxHeld && (f=_TaskManagerTxQueue.peek())!=NULL) {
+		unsigned long wait = radioRateWait(f->m_nodeId, f->m_fromTaskId);
+		if(wait<idle) idle = wait;
+	}
+	if(_TaskManagerTxPendingCount!=0) {
+		idleTimer(idle, now, _TaskManagerTxPending[_TaskManagerTxPendingHead].m_sentAt, TASKMGR_RADIO_TX_TIMEOUT);
+	}
+	for(int i=0; i<TASKMGR_RADIO_AGG_SLOTS; i++) {
+		if(_TaskManagerOutgoing[i].m_len!=0) idleTimer(idle, now, _TaskManagerOutgoing[i].m_started, m_radioAggWindow);
+	}
+	for(int i=0; i<TASKMGR_RELIABLE_PEERS; i++) {
+		_TaskManagerReliablePeer* peer = &_TaskManagerReliablePeers[i];
+		if(peer->m_nodeId==0) continue;
+		for(int j=0; j<TASKMGR_RELIABLE_WINDOW; j++) {
+			_TaskManagerReliableFrame* f = &peer->m_unacked[j];
+			if(f->m_len!=0) idleTimer(idle, now, f->m_sentAt, linkResendTimeout(peer->m_nodeId, f->m_tries));
+		}
+		if(peer->m_ackPending) idleTimer(idle, now, peer->m_ackDue-TASKMGR_RELIABLE_ACK_DELAY, TASKMGR_RELIABLE_ACK_DELAY);
+	}
+	for(int i=0; i<TASKMGR_REASSEMBLY_SLOTS; i++) {
+		_TaskManagerReassembly* r = &_TaskManagerReassemblies[i];
+		if(r->m_fromNodeId!=0) idleTimer(idle, now, r->m_started, TASKMGR_REASSEMBLY_TIMEOUT);
+	}
+	for(int i=0; i<TASKMGR_FRAGMENT_SEND_SLOTS; i++) {
+		_TaskManagerFragmentSend* s = &_TaskManagerFragmentSends[i];
+		if(s->m_toNodeId!=0) idleTimer(idle, now, s->m_started, TASKMGR_REASSEMBLY_TIMEOUT);
+	}
+	if(m_radioRouteInterval!=0) idleTimer(idle, now, m_radioRouteAdvertised, m_radioRouteInterval);
+	return idle;
 }
 /*! @} */ // end TaskManagerRadioESP
 #endif // ESP radio
@@ -25,9 +25,16 @@
 // before discarding messages
 /*! \def TASKMGR_MESSAGE_QUEUE_SIZE
 	The number of messages that can be buffered before the radio receiver task is called.
-	Any more than this and messages are discarded.
+	Any more than this and messages are discarded (see TaskManager::radioReceiveDrops()).
+	Must be a power of two.
 */
-#define TASKMGR_MESSAGE_QUEUE_SIZE 50
+#define TASKMGR_MESSAGE_QUEUE_SIZE 64
+
+/*! \def TASKMGR_CONTROL_QUEUE_SIZE
+	The number of control frames (see TaskManager::radioControlDrops()) that can be buffered apart
+	from the messages, before the radio receiver task is called.  Must be a power of two.
+*/
+#define TASKMGR_CONTROL_QUEUE_SIZE 8
 
 /*!	\struct	_TaskManagerRadioPacket
 	A packet of information being sent by radio between two TaskManager nodes
@@ -39,9 +46,317 @@ struct _TaskManagerRadioPacket {
 	byte	m_cmd;							//!< Command information
 	tm_nodeId_t	m_fromNodeId;						// source node
 	tm_taskId_t	m_fromTaskId;						// source task
-	byte	m_data[TASKMGR_MESSAGE_SIZE+1];	//! The data being transmitted.
+	byte	m_data[TASKMGR_RADIO_DATA_SIZE];	//! The data being transmitted.
 } __attribute__((packed));
 
+/*! \def TASKMGR_BROADCAST_NODE
+	The node ID that stands for every node in range.  It is never a real node's ID.
+*/
+#define TASKMGR_BROADCAST_NODE 0xffff
+
+/*! \def TASKMGR_GROUP_ALL
+	The group every node is in (see TaskManager::broadcastMessage()).
+*/
+#define TASKMGR_GROUP_ALL 0
+
+/*! \def TASKMGR_GROUP_MESSAGE_SIZE
+	The longest message TaskManager::broadcastMessage() sends:  one frame, less the group and task IDs.
+*/
+#define TASKMGR_GROUP_MESSAGE_SIZE (TASKMGR_RADIO_DATA_SIZE-2)
+
+/*!	\struct TaskManagerNodeStatus
+	The status of a node, as returned to TaskManager::requestStatus().  The reply message is this,
+	followed by a TaskManagerTaskStatus for each task (as many as fit in one packet).
+*/
+struct TaskManagerNodeStatus {
+	uint32_t m_uptime;			//!< ms since the node started (TaskManager::runtime())
+	uint32_t m_receiveDrops;	//!< TaskManager::radioReceiveDrops()
+	uint32_t m_sendDrops;		//!< TaskManager::radioSendDrops()
+	uint32_t m_sendFailures;	//!< TaskManager::radioSendFailures()
+	byte m_taskCount;			//!< The number of tasks on the node, including system tasks
+} __attribute__((packed));
+
+/*!	\struct TaskManagerTaskStatus
+	The status of a task, as returned to TaskManager::requestTaskStatus() and TaskManager::requestStatus().
+*/
+struct TaskManagerTaskStatus {
+	tm_taskId_t m_taskId;		//!< The task
+	byte m_stateFlags;			//!< State bits:  0x02 waiting for a message, 0x04 waiting for a time, 0x80 suspended
+	byte m_pending;				//!< Messages waiting in the task's mailbox
+	uint16_t m_mailboxDrops;	//!< TaskManager::getMailboxDrops(), saturated to 16 bits
+	uint16_t m_overruns;		//!< TaskManager::getOverruns()
+} __attribute__((packed));
+
+/*!	\struct TaskManagerReceiveStats
+	How the radio receiver task is keeping up, as returned by TaskManager::radioReceiveStats().
+*/
+struct TaskManagerReceiveStats {
+	unsigned long m_passes;			//!< Passes of the radio receiver task
+	unsigned long m_frames;			//!< Frames processed
+	unsigned long m_budgetStops;	//!< Passes that stopped at their budget with frames still waiting
+	unsigned long m_maxPassUs;		//!< The longest time one pass spent processing frames, in us
+	uint16_t m_depth;				//!< Frames waiting at the start of the last pass
+	uint16_t m_maxDepth;			//!< The most frames waiting at the start of a pass
+	uint16_t m_budget;				//!< The frame budget of the next pass; 0 if there is none
+};
+
+/*!	\struct TaskManagerLinkStats
+	The history of sends to one node, as returned by TaskManager::radioLinkStats().
+*/
+struct TaskManagerLinkStats {
+	unsigned long m_sent;			//!< Frames handed to the transport for the node
+	unsigned long m_failed;			//!< Of those, frames the transport did not deliver
+	unsigned long m_retries;		//!< Reliable frames sent again because no ack arrived in time
+	unsigned long m_lost;			//!< Reliable frames given up on
+	uint16_t m_successRatio;		//!< Recent deliveries, in 1/256ths:  256 if every recent send was delivered
+	uint16_t m_rtt;					//!< Smoothed round trip time, in ms; 0 if none has been measured
+	uint16_t m_rttVar;				//!< Smoothed variation of the round trip time, in ms
+	uint16_t m_timeout;				//!< The time a reply from the node is waited for, in ms (see TaskManager::radioLinkTimeout())
+};
+
+#include "TaskManagerTransport.h"
+
+/*! \def TASKMGR_RADIO_HEADER_SIZE
+	The size of the radio packet header (command, source node, source task).  A frame on the air is
+	the header followed by only the m_data bytes in use, so its length is carried by the frame itself.
+*/
+#define TASKMGR_RADIO_HEADER_SIZE (offsetof(_TaskManagerRadioPacket, m_data))
+
+/*!	\struct _TaskManagerRadioFrame
+	A received frame waiting in the message queue, and its length.
+*/
+struct _TaskManagerRadioFrame {
+	_TaskManagerRadioPacket m_packet;
+	byte m_len;
+};
+
+/*!	\class MessageQueue
+	The queue of incoming messages.  Messages are added by the receive callback (in the WiFi task)
+	and removed by the radio receiver task.
+	
+	The queue has two lanes, each a lock-free single-producer/single-consumer ring, so the receive
+	callback never blocks the radio stack.  Control frames go in their own lane, which is always
+	emptied first.  If a lane is full, new messages for it are discarded and counted.
+
+	TaskManager has one, in radioDriverESP.cpp.  The class is declared here so it can be tested
+	on its own (see test/RadioQueueStress).
+*/
+class MessageQueue {
+  private:
+	spscRing<_TaskManagerRadioFrame, TASKMGR_MESSAGE_QUEUE_SIZE> m_frames;
+	spscRing<_TaskManagerRadioFrame, TASKMGR_CONTROL_QUEUE_SIZE> m_control;
+	bool m_frontControl;	// front() returned a control frame
+	static bool isControl(const uint8_t* dat, const byte len);
+  public:
+	MessageQueue(): m_frontControl(false) {}
+	//! \brief Tells whether or not the message queue is empty.
+	bool isEmpty() { return m_control.isEmpty() && m_frames.isEmpty(); }
+	bool add(const uint8_t* dat, const byte len);
+	_TaskManagerRadioFrame* front();
+	//! \brief Free the slot of the frame returned by front()
+	void pop() { if(m_frontControl) m_control.release(); else m_frames.release(); }
+	/*!	\brief Return the size of the message queue.  Return 0 if the queue is empty.
+	*/
+	short size() { return m_control.size()+m_frames.size(); }
+	/*!	\brief Return the number of messages discarded because the queue was full.
+	*/
+	unsigned long drops() { return m_control.drops()+m_frames.drops(); }
+	/*!	\brief Return the number of control frames discarded because their lane was full.
+	*/
+	unsigned long controlDrops() { return m_control.drops(); }
+};
+
+/*! \def TASKMGR_RADIO_TX_QUEUE_SIZE
+	The number of frames that can wait for the radio transmit task.  Any more and they are
+	discarded (see TaskManager::radioSendDrops()).  Must be a power of two.
+*/
+#define TASKMGR_RADIO_TX_QUEUE_SIZE 16
+
+/*! \def TASKMGR_RADIO_TX_SYSTEM_QUEUE_SIZE
+	The number of frames from system tasks (acks, resends, routing, status replies) that can wait
+	for the radio transmit task.  They have a queue of their own, so a frame held for its rate limit
+	(see TaskManager::setRadioRateLimit()) does not hold them up.  A node passing on routed frames
+	sends them all from this queue.  Must be a power of two.
+*/
+#define TASKMGR_RADIO_TX_SYSTEM_QUEUE_SIZE 16
+
+/*! \def TASKMGR_RADIO_TX_INFLIGHT
+	The number of frames handed to the transport that may be waiting for their send results.
+*/
+#define TASKMGR_RADIO_TX_INFLIGHT 2
+
+/*! \def TASKMGR_RADIO_TX_TIMEOUT
+	The ms to wait for a send result before the frame is counted as failed.
+*/
+#define TASKMGR_RADIO_TX_TIMEOUT 100
+
+/*! \def TASKMGR_RADIO_AGG_SLOTS
+	The number of destination nodes that can have messages waiting to share a frame at one time
+	(see TaskManager::setRadioAggregation()).
+*/
+#define TASKMGR_RADIO_AGG_SLOTS 4
+
+/*! \def TASKMGR_RADIO_RECORD_HEADER_SIZE
+	The size of the header on each message in a tmrMulti frame:  target task, source task, and length.
+*/
+#define TASKMGR_RADIO_RECORD_HEADER_SIZE 3
+
+/*! \def TASKMGR_RELIABLE_HEADER_SIZE
+	The bytes a tmrReliable packet adds:  sequence number, ack, ack mask, the original command, the
+	sender's session, and the session the ack is for.
+*/
+#define TASKMGR_RELIABLE_HEADER_SIZE 6
+
+/*! \def TASKMGR_RELIABLE_ACK_VALID
+	Set in the command byte of a tmrReliable packet when its ack fields are valid.
+*/
+#define TASKMGR_RELIABLE_ACK_VALID 0x80
+
+/*! \def TASKMGR_RELIABLE_PEERS
+	The number of nodes that reliable delivery can track at once (see TaskManager::setRadioReliable()).
+*/
+#define TASKMGR_RELIABLE_PEERS 4
+
+/*! \def TASKMGR_RELIABLE_WINDOW
+	The number of reliable packets to one node that can be waiting for an ack.
+*/
+#define TASKMGR_RELIABLE_WINDOW 4
+
+/*! \def TASKMGR_RELIABLE_TIMEOUT
+	The ms to wait for an ack before a reliable packet is sent again, until round trips to the
+	node have been measured (see TaskManager::radioLinkTimeout()).
+*/
+#define TASKMGR_RELIABLE_TIMEOUT 30
+
+/*! \def TASKMGR_RELIABLE_TRIES
+	The number of times a reliable packet is sent before it is given up on.
+*/
+#define TASKMGR_RELIABLE_TRIES 5
+
+/*! \def TASKMGR_RELIABLE_ACK_DELAY
+	The ms a receiver waits for a packet going the other way to carry an ack before sending it on its own.
+*/
+#define TASKMGR_RELIABLE_ACK_DELAY 5
+
+/*! \def TASKMGR_FRAGMENT_HEADER_SIZE
+	The size of the header on each tmrFragment packet:  target task, message number, fragment number,
+	fragment count, and the fragment's offset (2 bytes).
+*/
+#define TASKMGR_FRAGMENT_HEADER_SIZE 6
+
+/*! \def TASKMGR_FRAGMENT_MAX
+	The most fragments a message may be sent in.  It bounds TASKMGR_MESSAGE_SIZE to about 7K.
+*/
+#define TASKMGR_FRAGMENT_MAX 32
+
+/*! \def TASKMGR_REASSEMBLY_SLOTS
+	The number of fragmented messages that can be reassembled at once.  Each has a TASKMGR_MESSAGE_SIZE
+	buffer, allocated when it is first needed.
+*/
+#define TASKMGR_REASSEMBLY_SLOTS 2
+
+/*! \def TASKMGR_FRAGMENT_SEND_SLOTS
+	The number of fragmented messages that can wait for room in the reliable window at once (see
+	TaskManager::setRadioReliable()).  Each has a TASKMGR_MESSAGE_SIZE buffer, allocated when it is first needed.
+*/
+#define TASKMGR_FRAGMENT_SEND_SLOTS 2
+
+/*! \def TASKMGR_REASSEMBLY_TIMEOUT
+	The ms allowed for all the fragments of a message to arrive before it is discarded.
+*/
+#define TASKMGR_REASSEMBLY_TIMEOUT 250
+
+/*! \def TASKMGR_ROUTE_HEADER_SIZE
+	The bytes a tmrRouted packet adds:  destination node, origin node, hops left, and the original command.
+*/
+#define TASKMGR_ROUTE_HEADER_SIZE 6
+
+/*! \def TASKMGR_ROUTE_RECORD_SIZE
+	The size of each route in a tmrRoute packet:  node, hops, and next hop.
+*/
+#define TASKMGR_ROUTE_RECORD_SIZE 5
+
+/*! \def TASKMGR_ROUTE_SLOTS
+	The number of routes a node keeps (see TaskManager::setRadioRouting()).
+*/
+#define TASKMGR_ROUTE_SLOTS 16
+
+/*! \def TASKMGR_ROUTE_TTL
+	The most hops a routed packet may take.
+*/
+#define TASKMGR_ROUTE_TTL 8
+
+/*! \def TASKMGR_ROUTE_HOLD
+	The number of packets being passed on to other nodes that can wait for the next hop to take them.
+	Any more are discarded (see TaskManager::radioRouteDrops()).
+*/
+#define TASKMGR_ROUTE_HOLD 4
+
+/*! \def TASKMGR_RATE_SLOTS
+	The number of destination nodes, and again of sending tasks, whose send rates are tracked at
+	once (see TaskManager::setRadioRateLimit() and TaskManager::setRadioBackoff()).
+*/
+#define TASKMGR_RATE_SLOTS 8
+
+/*! \def TASKMGR_RATE_BURST
+	The frames a node or task may send at once before its rate limit applies, by default.
+*/
+#define TASKMGR_RATE_BURST 4
+
+/*! \def TASKMGR_RADIO_BACKOFF
+	The ms sending to a node is held off after a failed send.  It doubles with each failure in a row.
+*/
+#define TASKMGR_RADIO_BACKOFF 5
+
+/*! \def TASKMGR_LINK_SLOTS
+	The number of nodes whose link statistics are kept at once (see TaskManager::radioLinkStats()).
+	The least recently used is replaced.
+*/
+#define TASKMGR_LINK_SLOTS 8
+
+/*! \def TASKMGR_LINK_TIMEOUT
+	The ms to wait for a reply from a node whose round trip time has not been measured.
+*/
+#define TASKMGR_LINK_TIMEOUT 20
+
+/*! \def TASKMGR_LINK_MIN_TIMEOUT
+	The shortest time, in ms, a reply is waited for however fast the link is.
+*/
+#define TASKMGR_LINK_MIN_TIMEOUT 5
+
+/*! \def TASKMGR_LINK_MAX_TIMEOUT
+	The longest time, in ms, a reply or ack is waited for before a packet is sent again.
+*/
+#define TASKMGR_LINK_MAX_TIMEOUT 500
+
+/*! \def TASKMGR_COMPRESS_HEADER_SIZE
+	The size of the header on each tmrCompressed packet:  target task, flags, and keyframe number.
+*/
+#define TASKMGR_COMPRESS_HEADER_SIZE 3
+
+/*! \def TASKMGR_COMPRESS_DELTA
+	Set in the flags of a tmrCompressed packet when it is coded against its keyframe.
+*/
+#define TASKMGR_COMPRESS_DELTA 0x01
+
+/*! \def TASKMGR_COMPRESS_KEYFRAME
+	Every TASKMGR_COMPRESS_KEYFRAME'th compressed message in a stream is a keyframe, coded on its own
+	(see TaskManager::setRadioCompression()).
+*/
+#define TASKMGR_COMPRESS_KEYFRAME 8
+
+/*! \def TASKMGR_COMPRESS_STREAMS
+	The number of (node, source task, target task) streams whose keyframes are kept, for sending and
+	again for receiving.  Each has a TASKMGR_RADIO_DATA_SIZE buffer, allocated when it is first needed.
+*/
+#define TASKMGR_COMPRESS_STREAMS 4
+
+/*! \def TASKMGR_PEER_CACHE_SIZE
+	The number of nodes kept registered as peers with the transport (see TaskManager::registerPeer()).
+	At most ESP_NOW_MAX_TOTAL_PEER_NUM.
+*/
+#define TASKMGR_PEER_CACHE_SIZE ESP_NOW_MAX_TOTAL_PEER_NUM
+
 // This is where we build MAC data for setting our MAC and pairing setup
 // It has enough constant data that it is easier to just keep one around.
 static byte _TaskManagerMAC[] = { 0xA6, 'T', 'M',  0, 0x00, 0x00 };
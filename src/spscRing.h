@@ -0,0 +1,142 @@
+#ifndef SPSCRING_H_INCLUDED
+#define SPSCRING_H_INCLUDED
+
+/*x \ingroup Ring
+	@{
+*/
+
+//
+// The spscRing class implements a bounded, lock-free, single-producer/single-consumer
+// queue.  One context (a task, a core, or a callback) adds entries and exactly one other
+// context removes them.  Neither side ever blocks or takes a lock.
+//
+// The head and tail are free-running counters.  The capacity must be a power of two, so
+// an index is (counter & (N-1)) and the fill level is (tail-head), which stays correct
+// when the counters wrap.  The counters are accessed with the GCC __atomic builtins, which
+// are available on every supported target (AVR, ESP-32, and host builds).
+
+/*!	\class spscRing
+	\brief A bounded lock-free single-producer/single-consumer queue.
+
+	The producer calls push() (or reserve()/commit()); the consumer calls pop() (or peek()/release()).
+	If the queue is full, push() fails and the drop counter is incremented; nothing is
+	ever overwritten and nothing is printed.
+
+	\tparam T - the element type.  Elements are copied with operator=.
+	\tparam N - the capacity.  Must be a power of two.
+*/
+template<class T, unsigned int N> class spscRing {
+	static_assert(N>=2 && (N&(N-1))==0, "spscRing capacity must be a power of two");
+private:
+	T m_items[N];
+	unsigned int m_head;	// next entry to remove.  Written only by the consumer.
+	unsigned int m_tail;	// next entry to fill.  Written only by the producer.
+	unsigned long m_drops;	// entries rejected because the ring was full.  Written only by the producer.
+public:
+	//! \brief Construct an empty ring
+	spscRing(): m_head(0), m_tail(0), m_drops(0) {}
+
+	//	producer side
+	bool push(const T& val);
+	T* reserve();
+	void commit();
+
+	//	consumer side
+	bool pop(T& val);
+	T* peek();
+	void release();
+
+	//	either side
+	bool isEmpty() const;
+	bool isFull() const;
+	unsigned int size() const;
+	//! \brief Return the capacity of the ring
+	static unsigned int capacity() { return N; }
+	//! \brief Return the number of entries dropped because the ring was full
+	unsigned long drops() const { return __atomic_load_n(&m_drops, __ATOMIC_RELAXED); }
+};
+
+/*!	\brief Add an entry to the ring.  Producer only.
+	\param val - the entry.  It is copied into the ring.
+	\return true if the entry was added, false if the ring was full (the entry is counted as dropped).
+*/
+template<class T, unsigned int N> inline bool spscRing<T,N>::push(const T& val) {
+	T* slot = reserve();
+	if(slot==NULL) return false;
+	*slot = val;
+	commit();
+	return true;
+}
+
+/*!	\brief Reserve the next free slot so the producer can fill it in place.  Producer only.
+
+	The slot is not visible to the consumer until commit() is called.
+	\return A pointer to the slot, or NULL if the ring is full (the entry is counted as dropped).
+*/
+template<class T, unsigned int N> inline T* spscRing<T,N>::reserve() {
+	unsigned int tail = __atomic_load_n(&m_tail, __ATOMIC_RELAXED);
+	if(tail - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) >= N) {
+		__atomic_store_n(&m_drops, m_drops+1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	return &m_items[tail&(N-1)];
+}
+
+/*!	\brief Publish the slot returned by reserve().  Producer only.
+*/
+template<class T, unsigned int N> inline void spscRing<T,N>::commit() {
+	__atomic_store_n(&m_tail, m_tail+1, __ATOMIC_RELEASE);
+}
+
+/*!	\brief Remove the oldest entry from the ring.  Consumer only.
+	\param[out] val - receives a copy of the entry.
+	\return true if an entry was removed, false if the ring was empty.
+*/
+template<class T, unsigned int N> inline bool spscRing<T,N>::pop(T& val) {
+	T* slot = peek();
+	if(slot==NULL) return false;
+	val = *slot;
+	release();
+	return true;
+}
+
+/*!	\brief Look at the oldest entry without removing it.  Consumer only.
+
+	The entry stays valid (and is not overwritten) until release() is called.
+	\return A pointer to the oldest entry, or NULL if the ring is empty.
+*/
+template<class T, unsigned int N> inline T* spscRing<T,N>::peek() {
+	unsigned int head = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+	if(head == __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE)) return NULL;
+	return &m_items[head&(N-1)];
+}
+
+/*!	\brief Remove the entry returned by peek().  Consumer only.
+*/
+template<class T, unsigned int N> inline void spscRing<T,N>::release() {
+	__atomic_store_n(&m_head, m_head+1, __ATOMIC_RELEASE);
+}
+
+/*!	\brief Tell whether the ring is empty.
+*/
+template<class T, unsigned int N> inline bool spscRing<T,N>::isEmpty() const {
+	return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE) == __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE);
+}
+
+/*!	\brief Tell whether the ring is full.
+*/
+template<class T, unsigned int N> inline bool spscRing<T,N>::isFull() const {
+	return size() >= N;
+}
+
+/*!	\brief Return the number of entries in the ring.
+
+	When called from a context that is neither the producer nor the consumer, the value is
+	a snapshot and may be stale by the time it is used.
+*/
+template<class T, unsigned int N> inline unsigned int spscRing<T,N>::size() const {
+	return __atomic_load_n(&m_tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+}
+
+/*x @} */ // end ring
+#endif // SPSCRING_H_INCLUDED
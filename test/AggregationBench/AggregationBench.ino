@@ -0,0 +1,70 @@
+// AggregationBench
+// Outbound radio aggregation benchmark (ESP-32 only).
+//
+// A sender task sends NMESSAGES messages of MSGSIZE bytes to a task on node 2 in one
+// dispatch.  The radio is a counting transport that puts nothing on the air, so the
+// sketch needs no second node.  Once the aggregation window has passed, the number of
+// frames and bytes handed to the transport is printed.  Set AGGWINDOW to 0 to see the
+// same traffic without aggregation.
+
+#include <Arduino.h>
+#include <TaskManager.h>
+
+#define NMESSAGES 20
+#define MSGSIZE   4
+#define AGGWINDOW 20
+
+#define SENDER     10
+#define REPORTTASK 200
+#define TONODE     2
+#define TOTASK     20
+
+// Counts the frames it is given and reports each one sent at once
+class CountingTransport : public TaskManagerTransport {
+public:
+  unsigned long m_frames = 0;
+  unsigned long m_bytes = 0;
+  virtual bool begin(tm_nodeId_t) { return true; }
+  virtual Status send(tm_nodeId_t, const byte*, int len) {
+    m_frames++;
+    m_bytes += len;
+    sent(true);
+    return tmtOk;
+  }
+};
+
+CountingTransport radio;
+
+void sender() {
+  byte msg[MSGSIZE];
+  for(int i=0; i<NMESSAGES; i++) {
+    memset(msg, i, sizeof(msg));
+    TaskMgr.sendMessage(TONODE, TOTASK, msg, sizeof(msg));
+  }
+  TaskMgr.suspend(TaskMgr.myId());
+}
+
+void reportTask() {
+  Serial.print("window ");
+  Serial.print(AGGWINDOW);
+  Serial.print(" ms: ");
+  Serial.print(NMESSAGES);
+  Serial.print(" messages of ");
+  Serial.print(MSGSIZE);
+  Serial.print(" bytes left as ");
+  Serial.print(radio.m_frames);
+  Serial.print(" frames, ");
+  Serial.print(radio.m_bytes);
+  Serial.println(" bytes");
+  TaskMgr.suspend(TaskMgr.myId());
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(500);
+  TaskMgr.radioBegin(1, radio);
+  TaskMgr.setRadioAggregation(AGGWINDOW);
+  TaskMgr.add(SENDER, sender);
+  TaskMgr.addWaitDelay(REPORTTASK, reportTask, AGGWINDOW+100);
+}
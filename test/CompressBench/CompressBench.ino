@@ -0,0 +1,117 @@
+// CompressBench
+// Bytes-on-air and CPU cost of radio message compression (ESP-32 only).
+//
+// A node sending telemetry sends the same struct over and over, with a few fields changing
+// slowly.  This sketch builds such a stream and codes it the way setRadioCompression() does:
+// every TASKMGR_COMPRESS_KEYFRAME'th message is coded on its own with TmCompress(), and the
+// others as a delta against it.  A delta that does not make the packet shorter is not sent; the
+// message goes uncompressed, and so do the next TASKMGR_COMPRESS_KEYFRAME, before a new keyframe.
+// Each coded message is decoded again with TmDecompress() and compared with the original.
+//
+// It prints the frame bytes that would go on the air with and without compression, and the
+// average cost of coding and decoding a message in CPU cycles.  No radio is needed.
+
+#include <Arduino.h>
+#include <TaskManager.h>
+#include <TaskManagerCompress.h>
+
+#define NMESSAGES   10000UL
+#define BENCH       10
+
+// Typical sensor node telemetry
+struct Telemetry {
+  uint32_t m_seq;
+  uint32_t m_uptime;
+  float m_temperature[4];
+  float m_humidity;
+  float m_pressure;
+  int16_t m_accel[3];
+  uint16_t m_battery;
+  byte m_status;
+  char m_location[24];
+  uint32_t m_counters[8];
+} __attribute__((packed));
+
+Telemetry sample;
+byte keyframe[sizeof(Telemetry)];
+byte coded[TASKMGR_RADIO_DATA_SIZE];
+byte decoded[TASKMGR_RADIO_DATA_SIZE];
+
+void update(uint32_t seq) {
+  sample.m_seq = seq;
+  sample.m_uptime = seq*100;
+  for(int i=0; i<4; i++) sample.m_temperature[i] = 21.5f + i + (seq/50)*0.1f;
+  sample.m_humidity = 40.0f + (seq/200)*0.5f;
+  sample.m_pressure = 1013.0f;
+  sample.m_accel[0] = (seq&3)-1;
+  sample.m_accel[1] = 0;
+  sample.m_accel[2] = 1000 + (seq&1);
+  sample.m_battery = 3300 - seq/1000;
+  sample.m_status = 1;
+  if(seq%100==0) sample.m_counters[seq/100%8]++;
+}
+
+void bench() {
+  // the frame header, the target task, and the tmrCompressed header
+  const unsigned long plainOverhead = TASKMGR_RADIO_HEADER_SIZE+1;
+  const unsigned long codedOverhead = TASKMGR_RADIO_HEADER_SIZE+TASKMGR_COMPRESS_HEADER_SIZE;
+  const int room = TASKMGR_RADIO_DATA_SIZE-TASKMGR_COMPRESS_HEADER_SIZE;
+  unsigned long plainBytes = 0, codedBytes = 0, errors = 0;
+  unsigned long encCycles = 0, decCycles = 0, nEncoded = 0, nDecoded = 0;
+  uint32_t start;
+  int n, m;
+  // the stream, as the driver keeps it
+  int keyLen = -1, count = 0, skip = 0;
+  memset(&sample, 0, sizeof(sample));
+  strcpy(sample.m_location, "greenhouse 2, bench 4");
+  for(uint32_t seq=0; seq<NMESSAGES; seq++) {
+    update(seq);
+    plainBytes += plainOverhead+sizeof(sample);
+    if(skip!=0) {
+      skip--;
+      codedBytes += plainOverhead+sizeof(sample);
+      continue;
+    }
+    bool key = keyLen<0 || count>=TASKMGR_COMPRESS_KEYFRAME;
+    // a delta is only sent if it makes the packet shorter
+    int most = key ? room : (int)sizeof(sample)-TASKMGR_COMPRESS_HEADER_SIZE;
+    start = ESP.getCycleCount();
+    n = TmCompress((byte*)&sample, sizeof(sample), key ? NULL : keyframe, key ? 0 : keyLen, coded, most<room ? most : room);
+    encCycles += ESP.getCycleCount()-start;
+    nEncoded++;
+    if(n<0) {
+      if(!key) {
+        keyLen = -1;
+        skip = TASKMGR_COMPRESS_KEYFRAME;
+      }
+      codedBytes += plainOverhead+sizeof(sample);
+      continue;
+    }
+    start = ESP.getCycleCount();
+    m = TmDecompress(coded, n, key ? NULL : keyframe, key ? 0 : keyLen, decoded, sizeof(decoded));
+    decCycles += ESP.getCycleCount()-start;
+    nDecoded++;
+    if(m!=sizeof(sample) || memcmp(decoded, &sample, sizeof(sample))!=0) errors++;
+    if(key) {
+      memcpy(keyframe, &sample, sizeof(sample));
+      keyLen = sizeof(sample);
+      count = 1;
+    } else {
+      count++;
+    }
+    codedBytes += n+codedOverhead;
+  }
+  Serial.printf("%lu messages of %u bytes, keyframe every %d\n", NMESSAGES, (unsigned)sizeof(Telemetry), TASKMGR_COMPRESS_KEYFRAME);
+  Serial.printf("  on air: %lu bytes plain, %lu bytes compressed (%lu%%), %lu messages sent compressed\n",
+    plainBytes, codedBytes, codedBytes*100/plainBytes, nDecoded);
+  Serial.printf("  compress %lu cycles/message, decompress %lu cycles/message\n",
+    nEncoded ? encCycles/nEncoded : 0, nDecoded ? decCycles/nDecoded : 0);
+  Serial.println(errors==0 ? "  PASS" : "  FAIL");
+  TaskMgr.yieldForMessage();	// done; wait forever
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(500);
+  TaskMgr.add(BENCH, bench);
+}
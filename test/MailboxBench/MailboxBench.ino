@@ -0,0 +1,81 @@
+// MailboxBench
+// Mailbox draining benchmark.
+//
+// A producer sends bursts of BURST messages to a consumer with a mailbox of BURST
+// messages, then waits for the consumer to say it has handled the burst.  NTASKS
+// other tasks share the ring, so every dispatch of the consumer costs a trip around
+// it.  The consumer handles up to BATCH messages per dispatch with nextMessage():
+//   BATCH 1 -- one message per dispatch; the rest wait in the mailbox
+//   BATCH 8 -- the whole burst in one dispatch
+// After NMESSAGES messages the rate is printed.  Set BATCH and re-upload to compare.
+
+#include <Arduino.h>
+#include <TaskManager.h>
+
+#define NTASKS    32
+#define BURST     8
+#define BATCH     8
+#define NMESSAGES 20000UL
+
+#define PRODUCER   1
+#define CONSUMER   2
+#define FIRSTOTHER 10
+#define REPORTTASK 200
+
+unsigned long int nMessages = 0;
+unsigned long int t0;
+
+void otherTask() {
+}
+
+void producer() {
+  static int i;
+  TM_BEGIN();
+  for(;;) {
+    for(i=0; i<BURST; i++) TaskMgr.sendMessage(CONSUMER, &i, sizeof(i));
+    TM_YIELDMESSAGE(1);
+  }
+  TM_END();
+}
+
+void consumer() {
+  static int inBurst = 0;
+  int n = 0;
+  do {
+    nMessages++;
+    if(++inBurst==BURST) {
+      inBurst = 0;
+      TaskMgr.sendMessage(PRODUCER, &inBurst, sizeof(inBurst));
+    }
+  } while(++n<BATCH && TaskMgr.nextMessage());
+}
+
+void reportTask() {
+  unsigned long int t1 = micros();
+  static bool reported = false;
+  if(nMessages<NMESSAGES || reported) return;
+  reported = true;
+  Serial.print("batch ");
+  Serial.print(BATCH);
+  Serial.print(": ");
+  Serial.print(nMessages);
+  Serial.print(" messages in ");
+  Serial.print(t1-t0);
+  Serial.print(" us, ");
+  Serial.print((unsigned long)((unsigned long long)nMessages*1000000/(t1-t0)));
+  Serial.print(" messages/s, ");
+  Serial.print((unsigned long)TaskMgr.getMailboxDrops(CONSUMER));
+  Serial.println(" dropped");
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(500);
+  for(int i=0; i<NTASKS; i++) TaskMgr.add(FIRSTOTHER+i, otherTask);
+  TaskMgr.addAutoWaitMessage(CONSUMER, consumer);
+  TaskMgr.setMailbox(CONSUMER, BURST);
+  TaskMgr.add(PRODUCER, producer);
+  TaskMgr.add(REPORTTASK, reportTask);
+  t0 = micros();
+}
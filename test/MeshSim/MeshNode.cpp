@@ -0,0 +1,72 @@
+// MeshNode
+// The node program MeshSim runs on every node, by default.
+//
+// Node 0 (node ID TASKMGR_CLOCK_SYNC_SERVER_NODE) is the clock sync server, and the others
+// resync their clocks with it every "sync" ms.  Every node sends a probe of "size" bytes to a
+// random other node every "period" ms, at a random phase, and reports each probe it receives
+// to MeshSim with the time it took.  Routes are advertised every "advert" ms, and reliable
+// delivery is on if "reliable" is 1.  Each of these can be changed with --set name=value.
+//
+// A node program is an ordinary sketch, with TmSimRadio() for its radio.  Tasks should wait
+// (for a time or a message) rather than poll, or the simulator has to step them every ms.
+
+#include <Arduino.h>
+#include <TaskManager.h>
+#include <TaskManagerClockSync.h>
+#include "TaskManagerSim.h"
+
+#define TRAFFIC   10
+#define SINK      11
+
+struct Probe {
+  uint32_t m_seq;
+  uint64_t m_sentUs;
+  byte m_pad[TASKMGR_RADIO_DATA_SIZE*4];
+} __attribute__((packed));
+
+long period;
+int probeSize;
+
+void traffic() {
+  static Probe probe;
+  static int i;
+  TM_BEGIN();
+  TM_YIELDDELAY(1, TmSimRandom(period)+1);
+  for(;;) {
+    // any node but this one
+    i = TmSimRandom(TmSimNodes()-1);
+    if(TmSimNodeId(i)==TmSimNodeId()) i = TmSimNodes()-1;
+    probe.m_seq++;
+    probe.m_sentUs = TmSimMicros();
+    TmSimSending(probeSize);
+    TaskMgr.sendMessage(TmSimNodeId(i), SINK, &probe, probeSize);
+    TM_YIELDDELAY(2, period);
+  }
+  TM_END();
+}
+
+void sink() {
+  tm_nodeId_t fromNode;
+  tm_taskId_t fromTask;
+  Probe probe;
+  int len = TaskMgr.getMessageLength();
+  if(len<(int)offsetof(Probe, m_pad)) return;
+  TaskMgr.getSource(fromNode, fromTask);
+  memcpy(&probe, TaskMgr.getMessage(), offsetof(Probe, m_pad));
+  TmSimDelivered(fromNode, probe.m_sentUs, len);
+}
+
+void setup() {
+  period = TmSimParam("period", 10000);
+  probeSize = constrain(TmSimParam("size", 32), (long)offsetof(Probe, m_pad), (long)sizeof(Probe));
+  TaskMgr.radioBegin(TmSimNodeId(), TmSimRadio());
+  TaskMgr.setRadioRouting(TmSimParam("advert", 5000));
+  TaskMgr.setRadioReliable(TmSimParam("reliable", 0)!=0);
+  if(TmSimNodeId()==TASKMGR_CLOCK_SYNC_SERVER_NODE) {
+    TaskMgr.addAutoWaitMessage(TASKMGR_CLOCK_SYNC_SERVER_TASK, TmClockSyncServerTask);
+  } else {
+    TaskMgr.addAutoWaitDelay(TASKMGR_CLOCK_SYNC_CLIENT_TASK, TmClockSyncClientTask, TmSimParam("sync", 60000));
+  }
+  if(period>0) TaskMgr.add(TRAFFIC, traffic);
+  TaskMgr.addAutoWaitMessage(SINK, sink);
+}
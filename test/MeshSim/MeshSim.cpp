@@ -0,0 +1,604 @@
+// MeshSim
+// Discrete-event simulator for large TaskManager meshes (Linux).
+//
+// Runs hundreds of TaskManager nodes in one process over a simulated radio, so the behavior of
+// a mesh too big to build (clock sync, routing, reliable delivery, load) can be studied, and
+// hours of it run in seconds.
+//
+// Each node is a separate copy of a node library:  TaskManager, the Arduino shim in
+// TaskManagerSim.cpp, and a node sketch such as MeshNode.cpp, built as a shared library and
+// loaded once per node with dlopen(), so every node has its own TaskMgr and radio state.  The
+// nodes' millis() and micros() read the simulated clock (each with its own offset and drift),
+// so TmMillis() and clock sync work as they do on a board.  Their radio is TmSimRadio(), which
+// hands frames to the simulated medium instead of esp_now_send().
+//
+// Time moves from event to event.  After a node runs, TaskManager::idleTime() says when it
+// next has something to do, and nothing is simulated in between.  Events are frames arriving,
+// the radio reporting on a frame sent, and nodes coming due.
+//
+// The medium:  nodes are placed at random in a square --area m on a side, and hear each other
+// within --range m.  A frame is on the air for (length + --overhead) bytes at --bitrate, one
+// at a time per node, and arrives --latency us (plus up to --jitter us) after it is off the
+// air.  Each receiver loses it with probability --loss.  A unicast frame is reported as
+// failed if the receiver is out of range or lost it; a broadcast frame is always reported as
+// sent.  Collisions are not modelled, but the time each node's channel is busy is reported.
+//
+// Build (from the library root):
+//   FLAGS="-std=gnu++17 -O2 -fPIC -DARDUINO_ARCH_ESP32 -DCONFIG_FREERTOS_UNICORE -Itest/MeshSim/host -Isrc"
+//   LIB="src/TaskManager.cpp src/TaskManagerClockSync.cpp src/TaskManagerCompress.cpp src/TaskManagerOffload.cpp src/radioDriverESP.cpp"
+//   g++ $FLAGS -shared -o meshnode.so test/MeshSim/MeshNode.cpp test/MeshSim/TaskManagerSim.cpp $LIB
+//   g++ -std=gnu++17 -O2 -o meshsim test/MeshSim/MeshSim.cpp -ldl
+// Run:
+//   ./meshsim ./meshnode.so -n 200 -t 3600 --csv mesh.csv
+//
+// Options:
+//   -n, --nodes N        nodes (200)
+//   -t, --time S         simulated seconds (3600)
+//   --area M             side of the square the nodes are in, m (1000)
+//   --range M            radio range, m (150)
+//   --latency US         delay from the end of a frame to its arrival, us (200)
+//   --jitter US          random extra delay, up to this many us (300)
+//   --bitrate BPS        radio bit rate (1000000)
+//   --overhead BYTES     bytes on the air besides the frame itself (50)
+//   --loss P             chance a receiver loses a frame (0.01)
+//   --drift PPM          node clocks run up to this much fast or slow (50)
+//   --offset MS          node clocks start up to this far apart (10000)
+//   --seed N             random seed (1)
+//   --report S           print a report line every S simulated seconds (600)
+//   --csv FILE           also write the report lines to FILE
+//   --set NAME=VALUE     a parameter for the node sketch (see TmSimParam())
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <getopt.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <time.h>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "MeshSimHost.h"
+
+#define MESHSIM_BROADCAST_NODE 0xffff		// TASKMGR_BROADCAST_NODE
+#define MESHSIM_SERVER_NODE 0xfffe			// TASKMGR_CLOCK_SYNC_SERVER_NODE
+#define MESHSIM_MAX_PASSES 1000				// loop() passes per node run
+
+//
+// Configuration
+//
+
+struct Config {
+	int m_nodes = 200;
+	double m_seconds = 3600;
+	double m_area = 1000;
+	double m_range = 150;
+	uint32_t m_latencyUs = 200;
+	uint32_t m_jitterUs = 300;
+	uint32_t m_bitrate = 1000000;
+	int m_overhead = 50;
+	double m_loss = 0.01;
+	int m_driftPpm = 50;
+	int m_offsetMs = 10000;
+	uint32_t m_seed = 1;
+	double m_reportSeconds = 600;
+	const char* m_csv = NULL;
+	std::map<std::string, long> m_params;
+};
+
+//
+// Nodes and events
+//
+
+struct Node {
+	TmSimHost m_host;
+	void* m_lib;
+	TmSimSetupFn m_setup;
+	TmSimRunFn m_run;
+	TmSimReceiveFn m_receive;
+	TmSimSentFn m_sent;
+	TmSimMillisFn m_millis;
+	double m_x, m_y;
+	std::vector<int> m_neighbours;
+	uint32_t m_random;			// xorshift state for TmSimRandom()
+	uint32_t m_wakeGen;			// only the latest wake event counts
+	bool m_dirty;				// run it before time moves on
+	uint64_t m_txFreeUs;		// when its radio is free
+	uint64_t m_heardAirUs;		// time its channel has been busy, counting its own frames
+};
+
+enum EventKind { evWake, evReceive, evSent, evReport };
+
+struct Event {
+	uint64_t m_us;
+	uint64_t m_seq;				// events at the same time happen in the order they were made
+	EventKind m_kind;
+	int m_node;
+	uint32_t m_gen;
+	bool m_ok;
+	std::shared_ptr<std::vector<uint8_t> > m_frame;
+	bool operator<(const Event& e) const {
+		return m_us!=e.m_us ? m_us>e.m_us : m_seq>e.m_seq;
+	}
+};
+
+//
+// Statistics
+//
+
+struct Stats {
+	uint64_t m_frames, m_frameBytes, m_airUs, m_heardUs;
+	uint64_t m_receptions, m_lost, m_unreachable;
+	uint64_t m_appSent, m_appSentBytes, m_appDelivered, m_appDeliveredBytes;
+	std::vector<uint32_t> m_latencies;
+	void clear() { *this = Stats(); }
+	Stats() : m_frames(0), m_frameBytes(0), m_airUs(0), m_heardUs(0), m_receptions(0), m_lost(0), m_unreachable(0),
+		m_appSent(0), m_appSentBytes(0), m_appDelivered(0), m_appDeliveredBytes(0) {}
+	void add(const Stats& s) {
+		m_frames += s.m_frames; m_frameBytes += s.m_frameBytes; m_airUs += s.m_airUs; m_heardUs += s.m_heardUs;
+		m_receptions += s.m_receptions; m_lost += s.m_lost; m_unreachable += s.m_unreachable;
+		m_appSent += s.m_appSent; m_appSentBytes += s.m_appSentBytes;
+		m_appDelivered += s.m_appDelivered; m_appDeliveredBytes += s.m_appDeliveredBytes;
+		m_latencies.insert(m_latencies.end(), s.m_latencies.begin(), s.m_latencies.end());
+	}
+};
+
+// the p'th percentile of a sorted list, in ms
+static double percentile(const std::vector<uint32_t>& sorted, double p) {
+	if(sorted.empty()) return 0;
+	size_t i = (size_t)(p/100*(sorted.size()-1)+0.5);
+	return sorted[i]/1000.0;
+}
+
+//
+// The simulator
+//
+
+class MeshSim {
+public:
+	MeshSim(const Config& config) : m_config(config), m_nowUs(0), m_seq(0), m_rng(config.m_seed), m_csv(NULL) {}
+	bool load(const char* library);
+	void run();
+	void unload();
+
+private:
+	void place();
+	void schedule(uint64_t us, EventKind kind, int node, bool ok=false,
+		std::shared_ptr<std::vector<uint8_t> > frame=std::shared_ptr<std::vector<uint8_t> >());
+	void runNode(int node);
+	void report(bool final);
+	double syncError(double& maxErr);
+	int largestComponent();
+	int indexOf(uint16_t nodeId);
+	double chance() { return std::uniform_real_distribution<double>(0, 1)(m_rng); }
+
+	// host callbacks
+	static bool send(void* sim, int index, uint16_t nodeId, const uint8_t* frame, int len);
+	static void sending(void* sim, int index, int len);
+	static void delivered(void* sim, int index, uint16_t fromNodeId, uint32_t latencyUs, int len);
+	static long param(void* sim, const char* name, long def);
+	static uint32_t random(void* sim, int index);
+
+	Config m_config;
+	uint64_t m_nowUs;
+	uint64_t m_seq;
+	std::mt19937_64 m_rng;
+	std::vector<Node> m_nodes;
+	std::vector<uint16_t> m_nodeIds;
+	std::priority_queue<Event> m_events;
+	std::vector<int> m_dirty;
+	Stats m_interval, m_total;
+	uint64_t m_lastReportUs;
+	FILE* m_csv;
+};
+
+int MeshSim::indexOf(uint16_t nodeId) {
+	if(nodeId==MESHSIM_SERVER_NODE) return 0;
+	return (nodeId>0 && nodeId<m_nodes.size()) ? nodeId : -1;
+}
+
+void MeshSim::schedule(uint64_t us, EventKind kind, int node, bool ok, std::shared_ptr<std::vector<uint8_t> > frame) {
+	Event e;
+	e.m_us = us;
+	e.m_seq = m_seq++;
+	e.m_kind = kind;
+	e.m_node = node;
+	e.m_gen = (kind==evWake) ? ++m_nodes[node].m_wakeGen : 0;
+	e.m_ok = ok;
+	e.m_frame = frame;
+	m_events.push(e);
+}
+
+// Load one copy of the node library per node.  dlopen() hands back the same copy for the same
+// file, so each node gets a file of its own, removed again once it is loaded.
+bool MeshSim::load(const char* library) {
+	char dir[] = "/tmp/meshsimXXXXXX";
+	struct stat st;
+	int in = open(library, O_RDONLY);
+	if(in<0 || fstat(in, &st)<0 || mkdtemp(dir)==NULL) {
+		perror(library);
+		return false;
+	}
+	m_nodes.resize(m_config.m_nodes);
+	m_nodeIds.resize(m_config.m_nodes);
+	for(int i=0; i<m_config.m_nodes; i++) m_nodeIds[i] = (i==0) ? MESHSIM_SERVER_NODE : i;
+	std::uniform_int_distribution<int> drift(-m_config.m_driftPpm, m_config.m_driftPpm);
+	std::uniform_int_distribution<uint64_t> offset(0, (uint64_t)m_config.m_offsetMs*1000);
+	for(int i=0; i<m_config.m_nodes; i++) {
+		Node& node = m_nodes[i];
+		char path[64];
+		off_t at = 0;
+		snprintf(path, sizeof(path), "%s/node%d.so", dir, i);
+		int out = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0700);
+		bool copied = out>=0 && sendfile(out, in, &at, st.st_size)==st.st_size;
+		if(out>=0) close(out);
+		node.m_lib = copied ? dlopen(path, RTLD_NOW|RTLD_LOCAL) : NULL;
+		unlink(path);
+		if(node.m_lib==NULL) {
+			fprintf(stderr, "node %d: %s\n", i, copied ? dlerror() : "cannot copy the node library");
+			close(in);
+			rmdir(dir);
+			return false;
+		}
+		TmSimAttachFn attach = (TmSimAttachFn)dlsym(node.m_lib, "TmSimAttach");
+		node.m_setup = (TmSimSetupFn)dlsym(node.m_lib, "TmSimSetup");
+		node.m_run = (TmSimRunFn)dlsym(node.m_lib, "TmSimRun");
+		node.m_receive = (TmSimReceiveFn)dlsym(node.m_lib, "TmSimReceive");
+		node.m_sent = (TmSimSentFn)dlsym(node.m_lib, "TmSimSent");
+		node.m_millis = (TmSimMillisFn)dlsym(node.m_lib, "TmSimMillis");
+		if(!attach || !node.m_setup || !node.m_run || !node.m_receive || !node.m_sent || !node.m_millis) {
+			fprintf(stderr, "%s: not a MeshSim node library (build it with TaskManagerSim.cpp)\n", library);
+			close(in);
+			rmdir(dir);
+			return false;
+		}
+		node.m_host.m_nowUs = &m_nowUs;
+		node.m_host.m_sim = this;
+		node.m_host.m_index = i;
+		node.m_host.m_nodes = m_config.m_nodes;
+		node.m_host.m_nodeId = m_nodeIds[i];
+		node.m_host.m_nodeIds = &m_nodeIds[0];
+		node.m_host.m_clockOffsetUs = offset(m_rng);
+		node.m_host.m_clockDriftPpm = drift(m_rng);
+		node.m_host.m_send = send;
+		node.m_host.m_sending = sending;
+		node.m_host.m_delivered = delivered;
+		node.m_host.m_param = param;
+		node.m_host.m_random = random;
+		node.m_random = (m_config.m_seed*2654435761u)^(i+1)*40503u;
+		if(node.m_random==0) node.m_random = 1;
+		node.m_wakeGen = 0;
+		node.m_dirty = false;
+		node.m_txFreeUs = node.m_heardAirUs = 0;
+		attach(&node.m_host);
+	}
+	close(in);
+	rmdir(dir);
+	place();
+	return true;
+}
+
+void MeshSim::unload() {
+	for(size_t i=0; i<m_nodes.size(); i++) {
+		if(m_nodes[i].m_lib!=NULL) dlclose(m_nodes[i].m_lib);
+	}
+	m_nodes.clear();
+}
+
+// Node 0 (the clock sync server) in the middle, the rest at random
+void MeshSim::place() {
+	std::uniform_real_distribution<double> where(0, m_config.m_area);
+	for(size_t i=0; i<m_nodes.size(); i++) {
+		m_nodes[i].m_x = (i==0) ? m_config.m_area/2 : where(m_rng);
+		m_nodes[i].m_y = (i==0) ? m_config.m_area/2 : where(m_rng);
+	}
+	for(size_t i=0; i<m_nodes.size(); i++) {
+		for(size_t j=0; j<m_nodes.size(); j++) {
+			double dx = m_nodes[i].m_x-m_nodes[j].m_x, dy = m_nodes[i].m_y-m_nodes[j].m_y;
+			if(i!=j && dx*dx+dy*dy<=m_config.m_range*m_config.m_range) m_nodes[i].m_neighbours.push_back(j);
+		}
+	}
+}
+
+// the number of nodes in the biggest group that can reach each other, over any number of hops
+int MeshSim::largestComponent() {
+	std::vector<int> group(m_nodes.size(), -1);
+	int best = 0;
+	for(size_t i=0; i<m_nodes.size(); i++) {
+		if(group[i]>=0) continue;
+		std::vector<int> todo(1, i);
+		int size = 0;
+		group[i] = i;
+		while(!todo.empty()) {
+			int n = todo.back();
+			todo.pop_back();
+			size++;
+			for(int j : m_nodes[n].m_neighbours) {
+				if(group[j]<0) { group[j] = i; todo.push_back(j); }
+			}
+		}
+		best = std::max(best, size);
+	}
+	return best;
+}
+
+//
+// Host callbacks
+//
+
+// Put a frame on the air:  after the node's earlier frames, then for its air time
+bool MeshSim::send(void* sim, int index, uint16_t nodeId, const uint8_t* frame, int len) {
+	MeshSim* me = (MeshSim*)sim;
+	Node& node = me->m_nodes[index];
+	const Config& c = me->m_config;
+	uint64_t air = std::max<uint64_t>(1, (uint64_t)(len+c.m_overhead)*8*1000000/c.m_bitrate);
+	uint64_t start = std::max(me->m_nowUs, node.m_txFreeUs);
+	uint64_t end = start+air;
+	std::shared_ptr<std::vector<uint8_t> > copy(new std::vector<uint8_t>(frame, frame+len));
+	bool ok = (nodeId==MESHSIM_BROADCAST_NODE);
+	int to = me->indexOf(nodeId);
+	node.m_txFreeUs = end;
+	node.m_heardAirUs += air;
+	me->m_interval.m_frames++;
+	me->m_interval.m_frameBytes += len;
+	me->m_interval.m_airUs += air;
+	me->m_interval.m_heardUs += air*(1+node.m_neighbours.size());
+	for(int j : node.m_neighbours) {
+		me->m_nodes[j].m_heardAirUs += air;
+		if(nodeId!=MESHSIM_BROADCAST_NODE && j!=to) continue;
+		if(me->chance()<c.m_loss) {
+			me->m_interval.m_lost++;
+			continue;
+		}
+		uint64_t jitter = c.m_jitterUs ? me->m_rng()%(c.m_jitterUs+1) : 0;
+		me->schedule(end+c.m_latencyUs+jitter, evReceive, j, false, copy);
+		me->m_interval.m_receptions++;
+		ok = true;
+	}
+	if(nodeId!=MESHSIM_BROADCAST_NODE && !ok && std::find(node.m_neighbours.begin(), node.m_neighbours.end(), to)==node.m_neighbours.end()) {
+		me->m_interval.m_unreachable++;
+	}
+	me->schedule(end, evSent, index, ok);
+	return true;
+}
+
+void MeshSim::sending(void* sim, int index, int len) {
+	MeshSim* me = (MeshSim*)sim;
+	(void)index;
+	me->m_interval.m_appSent++;
+	me->m_interval.m_appSentBytes += len;
+}
+
+void MeshSim::delivered(void* sim, int index, uint16_t fromNodeId, uint32_t latencyUs, int len) {
+	MeshSim* me = (MeshSim*)sim;
+	(void)index;
+	(void)fromNodeId;
+	me->m_interval.m_appDelivered++;
+	me->m_interval.m_appDeliveredBytes += len;
+	me->m_interval.m_latencies.push_back(latencyUs);
+}
+
+long MeshSim::param(void* sim, const char* name, long def) {
+	MeshSim* me = (MeshSim*)sim;
+	std::map<std::string, long>::const_iterator p = me->m_config.m_params.find(name);
+	return p==me->m_config.m_params.end() ? def : p->second;
+}
+
+uint32_t MeshSim::random(void* sim, int index) {
+	uint32_t& x = ((MeshSim*)sim)->m_nodes[index].m_random;
+	x ^= x<<13;
+	x ^= x>>17;
+	x ^= x<<5;
+	return x;
+}
+
+//
+// Running
+//
+
+void MeshSim::runNode(int node) {
+	uint64_t wake = m_nodes[node].m_run(MESHSIM_MAX_PASSES);
+	if(wake!=TMSIM_NEVER) {
+		schedule(wake, evWake, node);
+	} else {
+		m_nodes[node].m_wakeGen++;		// forget any earlier wake
+	}
+}
+
+// The clock error of the clients against the server's clock:  the mean, and the worst in maxErr, in ms
+double MeshSim::syncError(double& maxErr) {
+	long server = m_nodes[0].m_millis(false);
+	double sum = 0;
+	maxErr = 0;
+	for(size_t i=1; i<m_nodes.size(); i++) {
+		double err = fabs((double)(long)(m_nodes[i].m_millis(true)-server));
+		sum += err;
+		maxErr = std::max(maxErr, err);
+	}
+	return m_nodes.size()>1 ? sum/(m_nodes.size()-1) : 0;
+}
+
+void MeshSim::report(bool final) {
+	Stats& s = final ? m_total : m_interval;
+	double seconds = (m_nowUs-(final ? 0 : m_lastReportUs))/1e6;
+	double maxErr, meanErr = syncError(maxErr);
+	std::sort(s.m_latencies.begin(), s.m_latencies.end());
+	if(!final) {
+		double busy = seconds>0 ? s.m_heardUs/(seconds*1e6)/m_nodes.size()*100 : 0;
+		double avg = 0;
+		for(uint32_t l : s.m_latencies) avg += l;
+		avg = s.m_latencies.empty() ? 0 : avg/s.m_latencies.size()/1000;
+		printf("%9.0f s: %8llu frames, channel busy %5.2f%%, app %6llu sent %6llu delivered, latency %.1f ms avg %.1f ms p95, clock error %.1f ms avg %.0f ms max\n",
+			m_nowUs/1e6, (unsigned long long)s.m_frames, busy,
+			(unsigned long long)s.m_appSent, (unsigned long long)s.m_appDelivered, avg, percentile(s.m_latencies, 95), meanErr, maxErr);
+		if(m_csv) {
+			fprintf(m_csv, "%.0f,%llu,%llu,%.3f,%llu,%llu,%llu,%llu,%.3f,%.3f,%.3f,%.3f,%.3f\n", m_nowUs/1e6,
+				(unsigned long long)s.m_frames, (unsigned long long)s.m_frameBytes, busy, (unsigned long long)s.m_lost,
+				(unsigned long long)s.m_unreachable, (unsigned long long)s.m_appSent, (unsigned long long)s.m_appDelivered,
+				avg, percentile(s.m_latencies, 50), percentile(s.m_latencies, 95), meanErr, maxErr);
+		}
+		m_total.add(s);
+		m_interval.clear();
+		m_lastReportUs = m_nowUs;
+		return;
+	}
+	double maxUtil = 0, sumUtil = 0, avg = 0;
+	size_t neighbours = 0;
+	for(size_t i=0; i<m_nodes.size(); i++) {
+		double util = seconds>0 ? m_nodes[i].m_heardAirUs/(seconds*1e6) : 0;
+		maxUtil = std::max(maxUtil, util);
+		sumUtil += util;
+		neighbours += m_nodes[i].m_neighbours.size();
+	}
+	for(uint32_t l : s.m_latencies) avg += l;
+	avg = s.m_latencies.empty() ? 0 : avg/s.m_latencies.size()/1000;
+	printf("\nMesh:        %zu nodes, %.1f neighbours each, %d in the largest connected group\n",
+		m_nodes.size(), m_nodes.empty() ? 0.0 : (double)neighbours/m_nodes.size(), largestComponent());
+	printf("Radio:       %llu frames, %llu bytes, %llu receptions, %llu lost, %llu unicasts out of range\n",
+		(unsigned long long)s.m_frames, (unsigned long long)s.m_frameBytes, (unsigned long long)s.m_receptions,
+		(unsigned long long)s.m_lost, (unsigned long long)s.m_unreachable);
+	printf("Channel:     busy %.2f%% of the time on average, %.2f%% at the busiest node\n",
+		m_nodes.empty() ? 0.0 : sumUtil/m_nodes.size()*100, maxUtil*100);
+	printf("Messages:    %llu sent, %llu delivered (%.1f%%), %.1f messages/s, %.0f bytes/s\n",
+		(unsigned long long)s.m_appSent, (unsigned long long)s.m_appDelivered,
+		s.m_appSent ? s.m_appDelivered*100.0/s.m_appSent : 0.0,
+		seconds>0 ? s.m_appDelivered/seconds : 0, seconds>0 ? s.m_appDeliveredBytes/seconds : 0);
+	printf("Latency:     %.1f ms avg, %.1f ms p50, %.1f ms p95, %.1f ms p99, %.1f ms max\n",
+		avg, percentile(s.m_latencies, 50), percentile(s.m_latencies, 95), percentile(s.m_latencies, 99),
+		percentile(s.m_latencies, 100));
+	printf("Clock sync:  %.1f ms avg error, %.0f ms max error\n", meanErr, maxErr);
+}
+
+void MeshSim::run() {
+	uint64_t endUs = (uint64_t)(m_config.m_seconds*1e6);
+	uint64_t reportUs = (uint64_t)(m_config.m_reportSeconds*1e6);
+	struct timespec started, ended;
+	clock_gettime(CLOCK_MONOTONIC, &started);
+	if(m_config.m_csv) {
+		m_csv = fopen(m_config.m_csv, "w");
+		if(m_csv==NULL) perror(m_config.m_csv);
+		else fprintf(m_csv, "time_s,frames,frame_bytes,channel_busy_pct,lost,unreachable,app_sent,app_delivered,latency_avg_ms,latency_p50_ms,latency_p95_ms,clock_err_avg_ms,clock_err_max_ms\n");
+	}
+	m_lastReportUs = 0;
+	for(size_t i=0; i<m_nodes.size(); i++) {
+		m_nodes[i].m_setup();
+		runNode(i);
+	}
+	if(reportUs>0) {
+		for(uint64_t t=reportUs; t<=endUs; t+=reportUs) schedule(t, evReport, 0);
+	}
+	while(!m_events.empty() && m_events.top().m_us<=endUs) {
+		// everything that happens at this time, then the nodes it woke
+		m_nowUs = m_events.top().m_us;
+		while(!m_events.empty() && m_events.top().m_us==m_nowUs) {
+			Event e = m_events.top();
+			Node& node = m_nodes[e.m_node];
+			m_events.pop();
+			switch(e.m_kind) {
+				case evWake:
+					if(e.m_gen!=node.m_wakeGen) continue;
+					break;
+				case evReceive:
+					node.m_receive(&(*e.m_frame)[0], e.m_frame->size());
+					break;
+				case evSent:
+					node.m_sent(e.m_ok);
+					break;
+				case evReport:
+					report(false);
+					continue;
+			}
+			if(!node.m_dirty) {
+				node.m_dirty = true;
+				m_dirty.push_back(e.m_node);
+			}
+		}
+		for(int n : m_dirty) {
+			m_nodes[n].m_dirty = false;
+			runNode(n);
+		}
+		m_dirty.clear();
+	}
+	m_nowUs = endUs;
+	clock_gettime(CLOCK_MONOTONIC, &ended);
+	if(m_nowUs>m_lastReportUs && reportUs>0) report(false);
+	m_total.add(m_interval);
+	report(true);
+	double wall = (ended.tv_sec-started.tv_sec)+(ended.tv_nsec-started.tv_nsec)/1e9;
+	printf("Run:         %.0f s simulated in %.1f s, %.0fx real time\n", m_nowUs/1e6, wall, wall>0 ? m_nowUs/1e6/wall : 0);
+	if(m_csv) fclose(m_csv);
+}
+
+//
+// main
+//
+
+static void usage(const char* me) {
+	fprintf(stderr, "usage: %s NODELIB.so [-n nodes] [-t seconds] [--area m] [--range m] [--latency us] [--jitter us]\n"
+		"\t[--bitrate bps] [--overhead bytes] [--loss p] [--drift ppm] [--offset ms] [--seed n]\n"
+		"\t[--report seconds] [--csv file] [--set name=value]...\n", me);
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	static const struct option options[] = {
+		{ "nodes", required_argument, NULL, 'n' },
+		{ "time", required_argument, NULL, 't' },
+		{ "area", required_argument, NULL, 'A' },
+		{ "range", required_argument, NULL, 'R' },
+		{ "latency", required_argument, NULL, 'L' },
+		{ "jitter", required_argument, NULL, 'J' },
+		{ "bitrate", required_argument, NULL, 'B' },
+		{ "overhead", required_argument, NULL, 'O' },
+		{ "loss", required_argument, NULL, 'l' },
+		{ "drift", required_argument, NULL, 'D' },
+		{ "offset", required_argument, NULL, 'F' },
+		{ "seed", required_argument, NULL, 's' },
+		{ "report", required_argument, NULL, 'r' },
+		{ "csv", required_argument, NULL, 'c' },
+		{ "set", required_argument, NULL, 'S' },
+		{ NULL, 0, NULL, 0 }
+	};
+	Config config;
+	int opt;
+	while((opt=getopt_long(argc, argv, "n:t:s:", options, NULL))!=-1) {
+		switch(opt) {
+			case 'n': config.m_nodes = atoi(optarg); break;
+			case 't': config.m_seconds = atof(optarg); break;
+			case 'A': config.m_area = atof(optarg); break;
+			case 'R': config.m_range = atof(optarg); break;
+			case 'L': config.m_latencyUs = atol(optarg); break;
+			case 'J': config.m_jitterUs = atol(optarg); break;
+			case 'B': config.m_bitrate = atol(optarg); break;
+			case 'O': config.m_overhead = atoi(optarg); break;
+			case 'l': config.m_loss = atof(optarg); break;
+			case 'D': config.m_driftPpm = atoi(optarg); break;
+			case 'F': config.m_offsetMs = atoi(optarg); break;
+			case 's': config.m_seed = atol(optarg); break;
+			case 'r': config.m_reportSeconds = atof(optarg); break;
+			case 'c': config.m_csv = optarg; break;
+			case 'S': {
+				const char* eq = strchr(optarg, '=');
+				if(eq==NULL) usage(argv[0]);
+				config.m_params[std::string(optarg, eq-optarg)] = atol(eq+1);
+				break;
+			}
+			default: usage(argv[0]);
+		}
+	}
+	if(optind!=argc-1 || config.m_nodes<1 || config.m_nodes>=MESHSIM_SERVER_NODE || config.m_bitrate==0) usage(argv[0]);
+	MeshSim sim(config);
+	if(!sim.load(argv[optind])) return 1;
+	sim.run();
+	sim.unload();
+	return 0;
+}
@@ -0,0 +1,48 @@
+// MeshSimHost.h
+//
+//  What MeshSim and each simulated node share.  Every node is its own copy of the node library
+//  (TaskManager, the Arduino shim in TaskManagerSim.cpp and the sketch), loaded with dlopen(),
+//  so nodes share nothing but this struct and the entry points below.
+
+#if !defined(__MESHSIMHOST_H__)
+#define __MESHSIMHOST_H__
+
+#include <stdint.h>
+
+/*!	\def TMSIM_NEVER
+	Returned by TmSimRun() when the node has nothing to do until a frame arrives.
+*/
+#define TMSIM_NEVER 0xFFFFFFFFFFFFFFFFULL
+
+/*!	\brief A node's view of the simulator, filled in by MeshSim and passed to TmSimAttach()
+*/
+struct TmSimHost {
+	const uint64_t* m_nowUs;	//!<	The simulated time, in us
+	void* m_sim;				//!<	Passed back on every call below
+	int m_index;				//!<	The node's index, 0..m_nodes-1
+	int m_nodes;				//!<	The number of nodes
+	uint16_t m_nodeId;			//!<	The node's TaskManager node ID
+	const uint16_t* m_nodeIds;	//!<	The node IDs of all the nodes, by index
+	uint64_t m_clockOffsetUs;	//!<	The node's clock at simulated time 0
+	int32_t m_clockDriftPpm;	//!<	How fast the node's clock runs, in parts per million
+	//!	Put a frame on the air.  Returns false if the radio would not take it.
+	bool (*m_send)(void* sim, int index, uint16_t nodeId, const uint8_t* frame, int len);
+	//!	Count an application message as sent, for the throughput figures
+	void (*m_sending)(void* sim, int index, int len);
+	//!	Count an application message as delivered, latencyUs after it was sent
+	void (*m_delivered)(void* sim, int index, uint16_t fromNodeId, uint32_t latencyUs, int len);
+	//!	Look up a --set name=value option
+	long (*m_param)(void* sim, const char* name, long def);
+	//!	A random number from the simulator's seeded generator
+	uint32_t (*m_random)(void* sim, int index);
+};
+
+// Entry points of a node library, found with dlsym()
+typedef void (*TmSimAttachFn)(const TmSimHost* host);
+typedef void (*TmSimSetupFn)();
+typedef uint64_t (*TmSimRunFn)(int maxPasses);
+typedef void (*TmSimReceiveFn)(const uint8_t* frame, int len);
+typedef void (*TmSimSentFn)(bool ok);
+typedef unsigned long (*TmSimMillisFn)(bool net);
+
+#endif // __MESHSIMHOST_H__
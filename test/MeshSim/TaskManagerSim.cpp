@@ -0,0 +1,313 @@
+//
+// TaskManagerSim implementation
+//
+//  The node side of MeshSim:  the Arduino core functions TaskManager uses, run from the
+//  simulator's clock, the simulated radio, and the entry points MeshSim calls.  It is built
+//  into each node library with TaskManager and the node sketch (see MeshSim.cpp).
+//
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <chrono>
+#include <system_error>
+#include <thread>
+#include <TaskManagerSub.h>
+#include <TaskManagerClockSync.h>
+#include <WiFi.h>
+#include "MeshSimHost.h"
+#include "TaskManagerSim.h"
+
+static const TmSimHost* _TmSimHost = NULL;
+
+//
+// Clock
+//
+// The node's clock starts at m_clockOffsetUs and runs m_clockDriftPpm fast (or slow) against
+// the simulated time.  Nothing moves it on but MeshSim, so delay() does not wait.  A program that
+// never calls TmSimAttach() (see host/HostMain.cpp) runs on the host's monotonic clock instead.
+//
+
+// the host's clock, in us
+static uint64_t hostMicros() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+// the node's clock, in us
+static uint64_t localMicros() {
+	if(_TmSimHost==NULL) return hostMicros();
+	uint64_t t = *_TmSimHost->m_nowUs;
+	return _TmSimHost->m_clockOffsetUs + t*(1000000+_TmSimHost->m_clockDriftPpm)/1000000;
+}
+
+// the simulated time at which the node's clock reaches localUs
+static uint64_t simMicros(uint64_t localUs) {
+	uint64_t rate = 1000000+_TmSimHost->m_clockDriftPpm;
+	if(localUs<=_TmSimHost->m_clockOffsetUs) return 0;
+	return ((localUs-_TmSimHost->m_clockOffsetUs)*1000000+rate-1)/rate;
+}
+
+unsigned long micros() { return localMicros(); }
+unsigned long millis() { return localMicros()/1000; }
+void delay(unsigned long ms) {
+	if(_TmSimHost==NULL) std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+void delayMicroseconds(unsigned int us) {
+	if(_TmSimHost==NULL) std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+// from the simulator's seeded generator, so runs with the same --seed are the same
+uint32_t esp_random() { return _TmSimHost->m_random(_TmSimHost->m_sim, _TmSimHost->m_index); }
+
+//
+// Serial
+//
+// Each line a node prints starts with its node ID (outside MeshSim, there is no node ID).
+//
+
+HardwareSerial Serial;
+
+static size_t serialWrite(const char* s) {
+	static bool lineStart = true;
+	size_t n = 0;
+	for(; *s!='\0'; s++, n++) {
+		if(lineStart && _TmSimHost!=NULL) printf("%5u| ", _TmSimHost->m_nodeId);
+		putchar(*s);
+		lineStart = (*s=='\n');
+	}
+	return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+	char buf[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	return serialWrite(buf);
+}
+
+size_t Print::print(const char* s) { return serialWrite(s); }
+size_t Print::print(char c) { return printf("%c", c); }
+size_t Print::print(long n, int base) { return printf(base==HEX ? "%lx" : "%ld", n); }
+size_t Print::print(unsigned long n, int base) { return printf(base==HEX ? "%lx" : "%lu", n); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+size_t Print::println(const char* s) { return print(s)+print("\n"); }
+size_t Print::println(long n, int base) { return print(n, base)+print("\n"); }
+size_t Print::println(unsigned long n, int base) { return print(n, base)+print("\n"); }
+size_t Print::println(int n, int base) { return print(n, base)+print("\n"); }
+
+//
+// ESP-NOW and WiFi
+//
+// Not simulated.  radioBegin(nodeId, TmSimRadio()) is the only way onto the air.
+//
+
+WiFiClass WiFi;
+
+esp_err_t esp_now_init() { return ESP_ERR_ESPNOW_NOT_INIT; }
+esp_err_t esp_now_send(const uint8_t*, const uint8_t*, size_t) { return ESP_ERR_ESPNOW_NOT_INIT; }
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t*) { return ESP_ERR_ESPNOW_NOT_INIT; }
+esp_err_t esp_now_del_peer(const uint8_t*) { return ESP_ERR_ESPNOW_NOT_INIT; }
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t) { return ESP_ERR_ESPNOW_NOT_INIT; }
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t) { return ESP_ERR_ESPNOW_NOT_INIT; }
+esp_err_t esp_wifi_set_mac(wifi_interface_t, const uint8_t*) { return ESP_FAIL; }
+esp_err_t esp_wifi_set_promiscuous(bool) { return ESP_FAIL; }
+esp_err_t esp_wifi_set_channel(int, int) { return ESP_FAIL; }
+
+#if !defined(CONFIG_FREERTOS_UNICORE)
+//
+// FreeRTOS
+//
+// Each FreeRTOS task is a std::thread, so a host program can run a second executor with
+// beginCore(), and offload workers with beginOffload().  Cores are only labels:  xPortGetCoreID()
+// returns the core a thread was created for, and 1 (where the Arduino loop() runs on ESP-32) on
+// the main thread.  A tick is 1 ms.  Semaphores are POSIX semaphores, so a task waiting on one can
+// be deleted (sem_wait() is a cancellation point).
+//
+
+/*!	\brief A FreeRTOS task, run as a std::thread
+*/
+struct TmHostTask {
+	std::thread m_thread;
+};
+
+static thread_local BaseType_t _TmHostCore = 1;
+static thread_local TmHostTask* _TmHostSelf = NULL;		// NULL on the main thread
+
+BaseType_t xPortGetCoreID() {
+	return _TmHostCore;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackSize, void* arg,
+		UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+	(void)name;
+	(void)stackSize;
+	(void)priority;
+	TmHostTask* task = new TmHostTask;
+	try {
+		task->m_thread = std::thread([fn, arg, core, task]() { _TmHostCore = core; _TmHostSelf = task; fn(arg); });
+	} catch(const std::system_error&) {
+		delete task;
+		return pdFAIL;
+	}
+	if(handle!=NULL) *handle = task;
+	return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+	if(task==NULL || task==_TmHostSelf) {
+		// a task deleting itself
+		task = _TmHostSelf;
+		task->m_thread.detach();
+		delete task;
+		pthread_exit(NULL);
+	}
+	pthread_cancel(task->m_thread.native_handle());
+	task->m_thread.join();
+	delete task;
+}
+
+void vTaskDelay(TickType_t ticks) {
+	std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+/*!	\brief A FreeRTOS counting semaphore
+*/
+struct TmHostSemaphore {
+	sem_t m_sem;
+};
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+	(void)maxCount;		// TaskManager never gives more than it takes
+	TmHostSemaphore* sem = new TmHostSemaphore;
+	if(sem_init(&sem->m_sem, 0, initialCount)!=0) {
+		delete sem;
+		return NULL;
+	}
+	return sem;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+	return sem_post(&sem->m_sem)==0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+	int ret;
+	if(ticks==portMAX_DELAY) {
+		while((ret=sem_wait(&sem->m_sem))!=0 && errno==EINTR) ;
+	} else {
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec += ticks/1000;
+		until.tv_nsec += (long)(ticks%1000)*1000000;
+		if(until.tv_nsec>=1000000000) { until.tv_sec++; until.tv_nsec -= 1000000000; }
+		while((ret=sem_timedwait(&sem->m_sem, &until))!=0 && errno==EINTR) ;
+	}
+	return ret==0 ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+	sem_destroy(&sem->m_sem);
+	delete sem;
+}
+#endif // !CONFIG_FREERTOS_UNICORE
+
+//
+// Radio
+//
+// Frames go to MeshSim, which delivers them to the nodes in range after the air time and
+// latency, and reports back on each one with TmSimSent().
+//
+
+/*!	\brief The simulated radio
+*/
+class TmSimTransport : public TaskManagerTransport {
+public:
+	virtual bool begin(tm_nodeId_t) { return _TmSimHost!=NULL; }
+	virtual Status send(tm_nodeId_t nodeId, const byte* frame, int len) {
+		return _TmSimHost->m_send(_TmSimHost->m_sim, _TmSimHost->m_index, nodeId, frame, len) ? tmtOk : tmtError;
+	}
+	static void deliver(const byte* frame, int len) { received(frame, len); }
+	static void done(bool ok) { sent(ok); }
+};
+
+static TmSimTransport _TmSimRadio;
+
+TaskManagerTransport& TmSimRadio() { return _TmSimRadio; }
+tm_nodeId_t TmSimNodeId() { return _TmSimHost->m_nodeId; }
+tm_nodeId_t TmSimNodeId(int i) { return _TmSimHost->m_nodeIds[i]; }
+int TmSimNodes() { return _TmSimHost->m_nodes; }
+uint64_t TmSimMicros() { return *_TmSimHost->m_nowUs; }
+
+long TmSimParam(const char* name, long def) {
+	return _TmSimHost->m_param(_TmSimHost->m_sim, name, def);
+}
+
+uint32_t TmSimRandom(uint32_t n) {
+	return n==0 ? 0 : _TmSimHost->m_random(_TmSimHost->m_sim, _TmSimHost->m_index)%n;
+}
+
+void TmSimSending(int len) {
+	_TmSimHost->m_sending(_TmSimHost->m_sim, _TmSimHost->m_index, len);
+}
+
+void TmSimDelivered(tm_nodeId_t fromNodeId, uint64_t sentUs, int len) {
+	_TmSimHost->m_delivered(_TmSimHost->m_sim, _TmSimHost->m_index, fromNodeId, TmSimMicros()-sentUs, len);
+}
+
+//
+// Entry points
+//
+// MeshSim calls TmSimAttach() and TmSimSetup() once, then TmSimRun() whenever the node is due
+// or a frame has been handed to it.
+//
+
+extern "C" {
+
+void TmSimAttach(const TmSimHost* host) {
+	_TmSimHost = host;
+}
+
+void TmSimSetup() {
+	setup();
+}
+
+/*!	\brief Run the node until it has nothing to do
+	\param maxPasses -- the most loop() passes to make
+	\returns the simulated time at which to run it again, or TMSIM_NEVER if it waits for a frame
+*/
+uint64_t TmSimRun(int maxPasses) {
+	for(int i=0; i<maxPasses; i++) {
+		unsigned long idle = TaskMgr.idleTime();
+		if(idle==TASKMGR_IDLE_FOREVER) return TMSIM_NEVER;
+		if(idle!=0) {
+			// idleTime() counts from TmMillis(), which runs at the same rate as millis()
+			uint64_t wake = simMicros(((uint64_t)millis()+idle)*1000);
+			return wake>TmSimMicros() ? wake : TmSimMicros()+1;
+		}
+		loop();
+	}
+	// a task that never waits; let the others have a turn
+	return TmSimMicros()+1000;
+}
+
+void TmSimReceive(const uint8_t* frame, int len) {
+	TmSimTransport::deliver(frame, len);
+}
+
+void TmSimSent(bool ok) {
+	TmSimTransport::done(ok);
+}
+
+unsigned long TmSimMillis(bool net) {
+	return net ? TmMillis() : millis();
+}
+
+} // extern "C"
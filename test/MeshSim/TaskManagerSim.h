@@ -0,0 +1,52 @@
+// TaskManagerSim.h
+//
+//  What a node sketch running under MeshSim can use besides TaskManager itself.
+
+#if !defined(__TASKMANAGERSIM_H__)
+#define __TASKMANAGERSIM_H__
+
+#include <TaskManagerCore.h>
+
+/*!	\brief Return the simulated radio, to pass to TaskManager::radioBegin(nodeId, transport)
+*/
+TaskManagerTransport& TmSimRadio();
+
+/*!	\brief Return the node ID MeshSim gave this node.  The first node is TASKMGR_CLOCK_SYNC_SERVER_NODE.
+*/
+tm_nodeId_t TmSimNodeId();
+
+/*!	\brief Return the node ID of the i'th node, i from 0 to TmSimNodes()-1
+*/
+tm_nodeId_t TmSimNodeId(int i);
+
+/*!	\brief Return the number of nodes in the simulation
+*/
+int TmSimNodes();
+
+/*!	\brief Return the simulated time in us.  It is the same on every node, so it can time messages.
+*/
+uint64_t TmSimMicros();
+
+/*!	\brief Return the value of a --set name=value option
+	\param name -- the name
+	\param def -- the value if the option was not given
+*/
+long TmSimParam(const char* name, long def);
+
+/*!	\brief Return a random number from 0 to n-1.  Runs with the same --seed are the same.
+*/
+uint32_t TmSimRandom(uint32_t n);
+
+/*!	\brief Count an application message as sent, for MeshSim's throughput figures
+	\param len -- its length
+*/
+void TmSimSending(int len);
+
+/*!	\brief Count an application message as delivered, for MeshSim's throughput and latency figures
+	\param fromNodeId -- the node that sent it
+	\param sentUs -- TmSimMicros() when it was sent
+	\param len -- its length
+*/
+void TmSimDelivered(tm_nodeId_t fromNodeId, uint64_t sentUs, int len);
+
+#endif // __TASKMANAGERSIM_H__
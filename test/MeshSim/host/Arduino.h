@@ -0,0 +1,101 @@
+// Arduino.h for MeshSim
+//
+//  Just enough of the Arduino core for TaskManager nodes to run on Linux inside MeshSim.
+//  millis() and micros() read the node's clock, which MeshSim runs from simulated time;
+//  delay() does not wait, since simulated time only moves between events.  A program that
+//  is not run by MeshSim (see HostMain.cpp) gets the host's clock instead, and delay() waits.
+
+#if !defined(__MESHSIM_ARDUINO_H__)
+#define __MESHSIM_ARDUINO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+void setup();
+void loop();
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+uint32_t esp_random();
+
+#define HEX 16
+#define DEC 10
+#define F(x) (x)
+#define constrain(amt, low, high) ((amt)<(low) ? (low) : ((amt)>(high) ? (high) : (amt)))
+
+class Print {
+public:
+	size_t print(const char* s);
+	size_t print(char c);
+	size_t print(long n, int base=DEC);
+	size_t print(unsigned long n, int base=DEC);
+	size_t print(int n, int base=DEC);
+	size_t print(unsigned int n, int base=DEC);
+	size_t println(const char* s="");
+	size_t println(long n, int base=DEC);
+	size_t println(unsigned long n, int base=DEC);
+	size_t println(int n, int base=DEC);
+	size_t printf(const char* format, ...);
+};
+
+class Printable {
+public:
+	virtual ~Printable() {}
+	virtual size_t printTo(Print& p) const = 0;
+};
+
+class HardwareSerial : public Print {
+public:
+	void begin(long) {}
+	int available() { return 0; }
+	int read() { return -1; }
+};
+extern HardwareSerial Serial;
+
+class String {
+public:
+	String(const char* s="") : m_s(s) {}
+	const char* c_str() const { return m_s; }
+private:
+	const char* m_s;
+};
+
+// FreeRTOS, as far as TaskManager uses it.  With CONFIG_FREERTOS_UNICORE (as in MeshSim) there is
+// one executor and this is all it needs.  Without it, FreeRTOS tasks are std::threads (see
+// TaskManagerSim.cpp), so a host program can run a second executor.
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef unsigned int TickType_t;
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#if defined(CONFIG_FREERTOS_UNICORE)
+inline BaseType_t xPortGetCoreID() { return 0; }
+#else
+#include <sched.h>
+#define portMAX_DELAY 0xffffffffU
+#define taskYIELD() sched_yield()
+typedef void (*TaskFunction_t)(void*);
+typedef struct TmHostTask* TaskHandle_t;
+typedef struct TmHostSemaphore* SemaphoreHandle_t;
+BaseType_t xPortGetCoreID();
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackSize, void* arg,
+	UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+#endif
+
+#endif // __MESHSIM_ARDUINO_H__
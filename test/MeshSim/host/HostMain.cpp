@@ -0,0 +1,26 @@
+// HostMain.cpp
+//
+//  Runs an ordinary sketch on Linux:  setup(), then loop() until the given number of seconds has
+//  passed (or forever).  The sketch is built with the MeshSim shims but is not run by MeshSim, so
+//  millis() and micros() read the host's clock and delay() waits.  Leave out
+//  -DCONFIG_FREERTOS_UNICORE and beginCore() runs a second executor on a std::thread.
+//
+// Build (from the library root), for example for MultiCoreBench:
+//   FLAGS="-std=gnu++17 -O2 -DARDUINO_ARCH_ESP32 -Itest/MeshSim/host -Isrc"
+//   LIB="src/TaskManager.cpp src/TaskManagerClockSync.cpp src/TaskManagerCompress.cpp src/TaskManagerOffload.cpp src/radioDriverESP.cpp"
+//   HOST="test/MeshSim/host/HostMain.cpp test/MeshSim/TaskManagerSim.cpp"
+//   g++ $FLAGS -o multicorebench -x c++ test/MultiCoreBench/MultiCoreBench.ino -x none $HOST $LIB -lpthread
+// Run:
+//   ./multicorebench 10
+
+#include <Arduino.h>
+
+int main(int argc, char** argv) {
+	unsigned long runMs = argc>1 ? (unsigned long)(atof(argv[1])*1000) : 0;
+	unsigned long start = millis();
+	setup();
+	while(runMs==0 || millis()-start<runMs) loop();
+	// other executors' threads are still running, so skip the static destructors
+	fflush(stdout);
+	_Exit(0);
+}
@@ -0,0 +1,22 @@
+// Streaming.h for MeshSim
+//
+//  The "Serial << x" operators TaskManager uses for its messages.
+
+#if !defined(__MESHSIM_STREAMING_H__)
+#define __MESHSIM_STREAMING_H__
+
+#include "Arduino.h"
+
+template<class T> inline Print& operator<<(Print& p, T arg) { p.print(arg); return p; }
+
+struct _BASED {
+	long m_val;
+	int m_base;
+	_BASED(long val, int base) : m_val(val), m_base(base) {}
+};
+inline Print& operator<<(Print& p, const _BASED& arg) { p.print(arg.m_val, arg.m_base); return p; }
+#define _HEX(x) _BASED(x, HEX)
+#define _DEC(x) _BASED(x, DEC)
+#define endl "\n"
+
+#endif // __MESHSIM_STREAMING_H__
@@ -0,0 +1,27 @@
+// WiFi.h for MeshSim
+//
+//  See esp_now.h.  There is no WiFi in the simulator.
+
+#if !defined(__MESHSIM_WIFI_H__)
+#define __MESHSIM_WIFI_H__
+
+#include "esp_wifi.h"
+
+#define WIFI_STA 1
+#define WIFI_AP_STA 3
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class WiFiClass {
+public:
+	void mode(int) {}
+	void disconnect() {}
+	int scanNetworks() { return 0; }
+	String SSID(int) { return String(); }
+	int channel(int) { return 1; }
+	void begin(const char*, const char*) {}
+	int status() { return WL_DISCONNECTED; }
+};
+extern WiFiClass WiFi;
+
+#endif // __MESHSIM_WIFI_H__
@@ -0,0 +1,4 @@
+// arduino.h for MeshSim
+//
+//  Some TaskManager sources include <arduino.h>; Linux file names are case sensitive.
+#include "Arduino.h"
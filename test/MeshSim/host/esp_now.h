@@ -0,0 +1,52 @@
+// esp_now.h for MeshSim
+//
+//  The ESP-NOW declarations TaskManager's default transport is built with.  There is no
+//  ESP-NOW in the simulator:  every call fails, and nodes use TmSimRadio() instead.
+
+#if !defined(__MESHSIM_ESP_NOW_H__)
+#define __MESHSIM_ESP_NOW_H__
+
+#include "Arduino.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_ESPNOW_BASE 0x3000
+#define ESP_ERR_ESPNOW_NOT_INIT (ESP_ERR_ESPNOW_BASE+1)
+#define ESP_ERR_ESPNOW_ARG (ESP_ERR_ESPNOW_BASE+2)
+#define ESP_ERR_ESPNOW_NO_MEM (ESP_ERR_ESPNOW_BASE+3)
+#define ESP_ERR_ESPNOW_FULL (ESP_ERR_ESPNOW_BASE+4)
+#define ESP_ERR_ESPNOW_NOT_FOUND (ESP_ERR_ESPNOW_BASE+5)
+#define ESP_ERR_ESPNOW_INTERNAL (ESP_ERR_ESPNOW_BASE+6)
+#define ESP_ERR_ESPNOW_EXIST (ESP_ERR_ESPNOW_BASE+7)
+#define ESP_ERR_ESPNOW_IF (ESP_ERR_ESPNOW_BASE+8)
+#define ESP_NOW_MAX_TOTAL_PEER_NUM 20
+#define ESP_NOW_MAX_DATA_LEN 250
+#define ESP_NOW_ETH_ALEN 6
+
+typedef enum { ESP_NOW_SEND_SUCCESS=0, ESP_NOW_SEND_FAIL } esp_now_send_status_t;
+typedef enum { WIFI_IF_STA=0, WIFI_IF_AP } wifi_interface_t;
+typedef struct {
+	uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+	uint8_t lmk[16];
+	uint8_t channel;
+	wifi_interface_t ifidx;
+	bool encrypt;
+	void* priv;
+} esp_now_peer_info_t;
+typedef struct {
+	uint8_t* src_addr;
+	uint8_t* des_addr;
+	void* rx_ctrl;
+} esp_now_recv_info_t;
+typedef void (*esp_now_recv_cb_t)(const esp_now_recv_info_t* info, const uint8_t* data, int len);
+typedef void (*esp_now_send_cb_t)(const uint8_t* mac, esp_now_send_status_t status);
+
+esp_err_t esp_now_init();
+esp_err_t esp_now_send(const uint8_t* mac, const uint8_t* data, size_t len);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer);
+esp_err_t esp_now_del_peer(const uint8_t* mac);
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+
+#endif // __MESHSIM_ESP_NOW_H__
@@ -0,0 +1,16 @@
+// esp_wifi.h for MeshSim
+//
+//  See esp_now.h.
+
+#if !defined(__MESHSIM_ESP_WIFI_H__)
+#define __MESHSIM_ESP_WIFI_H__
+
+#include "esp_now.h"
+
+#define WIFI_SECOND_CHAN_NONE 0
+
+esp_err_t esp_wifi_set_mac(wifi_interface_t ifx, const uint8_t* mac);
+esp_err_t esp_wifi_set_promiscuous(bool en);
+esp_err_t esp_wifi_set_channel(int primary, int second);
+
+#endif // __MESHSIM_ESP_WIFI_H__
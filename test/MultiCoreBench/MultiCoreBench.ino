@@ -0,0 +1,86 @@
+// MultiCoreBench
+// Message throughput with one executor vs. one executor per core (ESP-32, or a Linux host).
+//
+// NPAIRS producer/consumer pairs exchange messages in a ping-pong:  the producer sends
+// a sequence number, the consumer does WORK iterations of busy work on it and replies.
+// With SPLIT false, every task runs on TaskMgr (one core).  With SPLIT true, the
+// consumers run on a second executor pinned to core 0, so every message crosses cores
+// through the lock-free executor queues.
+//
+// Every REPORTMS ms the sketch prints the number of round trips per second.  Compare
+// the two settings of SPLIT; with enough WORK the split setting should approach twice
+// the throughput.
+//
+// It also runs on Linux, with the second executor on a std::thread; see
+// test/MeshSim/host/HostMain.cpp.  Add -DSPLIT=false or -DWORK=n to the build to compare.
+
+#include <Arduino.h>
+#include <TaskManager.h>
+
+#if !defined(SPLIT)
+#define SPLIT   true
+#endif
+#define NPAIRS  8
+#if !defined(WORK)
+#define WORK    2000
+#endif
+#define REPORTMS 2000
+
+#define PRODUCERBASE 10
+#define CONSUMERBASE 50
+#define REPORTTASK   200
+
+TaskManager TaskMgrCore0;   // second executor
+
+struct PairInfo {
+  uint32_t tmrNext;
+  tm_taskId_t producerId;
+  tm_taskId_t consumerId;
+  uint32_t seq;
+};
+PairInfo pairs[NPAIRS];
+volatile unsigned long roundTrips = 0;
+
+// Consumer:  crunch on the value and send it back.
+void consumerTask(void* ctx) {
+  PairInfo* p = (PairInfo*)ctx;
+  TaskManager* tm = TaskManager::current();
+  uint32_t v;
+  memcpy(&v, tm->getMessage(), sizeof(v));
+  for(int i=0; i<WORK; i++) v = v*1103515245 + 12345;
+  tm->sendMessage(p->producerId, &v, sizeof(v));
+}
+
+// Producer:  send the next value, then wait for the reply.
+void producerTask(void* ctx) {
+  PairInfo* p = (PairInfo*)ctx;
+  p->seq++;
+  TaskMgr.sendMessage(p->consumerId, &p->seq, sizeof(p->seq));
+  roundTrips++;
+}
+
+void reportTask() {
+  static unsigned long lastCount = 0;
+  unsigned long n = roundTrips;
+  Serial.print(SPLIT ? "split: " : "single: ");
+  Serial.print((n-lastCount)*1000UL/REPORTMS);
+  Serial.print(" round trips/s, cross-core drops ");
+  Serial.println(TaskMgr.crossDrops()+TaskMgrCore0.crossDrops());
+  lastCount = n;
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(500);
+  for(int i=0; i<NPAIRS; i++) {
+    pairs[i].producerId = PRODUCERBASE+i;
+    pairs[i].consumerId = CONSUMERBASE+i;
+    pairs[i].seq = 0;
+    // the producer starts running, then waits for each reply
+    TaskMgr.addAutoWaitMessage(pairs[i].producerId, producerTask, &pairs[i], 0, false);
+    if(SPLIT) TaskMgrCore0.addAutoWaitMessage(pairs[i].consumerId, consumerTask, &pairs[i]);
+    else TaskMgr.addAutoWaitMessage(pairs[i].consumerId, consumerTask, &pairs[i]);
+  }
+  TaskMgr.addAutoWaitDelay(REPORTTASK, reportTask, REPORTMS, true);
+  if(SPLIT) TaskMgrCore0.beginCore(0);
+}
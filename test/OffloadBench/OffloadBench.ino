@@ -0,0 +1,127 @@
+// OffloadBench
+// Job throughput and task latency with and without the offload pool (ESP-32, or a Linux host).
+//
+// A feeder task keeps NJOBS jobs in flight.  Each job runs WORK rounds of a CRC-32 over a
+// BUFSIZE buffer; when it finishes, the completion task checks the result and offloads the
+// job again.  Meanwhile a ticker task asks to run every TICKMS ms and records how late it is.
+//
+// With OFFLOAD true, beginOffload() starts NWORKERS workers on core 0 and the jobs run there,
+// so the ticker stays on time.  With OFFLOAD false, offload() runs each job in place and the
+// ticker waits behind it.  Every REPORTMS ms the sketch prints the jobs finished per second
+// and the ticker's average and worst lateness.
+//
+// It also runs on Linux, with the workers on std::threads; see test/MeshSim/host/HostMain.cpp.
+// Add -DOFFLOAD=false, -DNWORKERS=n or -DWORK=n to the build to compare.
+
+#include <Arduino.h>
+#include <TaskManager.h>
+
+#if !defined(OFFLOAD)
+#define OFFLOAD   true
+#endif
+#if !defined(NWORKERS)
+#define NWORKERS  2
+#endif
+#if !defined(WORK)
+#define WORK      20
+#endif
+#define NJOBS     4
+#define BUFSIZE   1024
+#define TICKMS    2
+#define REPORTMS  2000
+
+#define FEEDER    10
+#define DONE      11
+#define TICKER    12
+#define REPORT    13
+
+struct Job {
+  byte m_buf[BUFSIZE];
+  uint32_t m_crc;
+  uint32_t m_expect;
+  bool m_waiting;		// not in flight:  offload() refused it
+};
+Job jobs[NJOBS];
+
+unsigned long finished = 0;
+unsigned long errors = 0;
+unsigned long ticks = 0;
+unsigned long lateTotal = 0;
+unsigned long lateMax = 0;
+unsigned long nextTickUs;
+
+uint32_t crc32(const byte* buf, int len, uint32_t crc) {
+  crc = ~crc;
+  for(int i=0; i<len; i++) {
+    crc ^= buf[i];
+    for(int b=0; b<8; b++) crc = (crc>>1) ^ (0xEDB88320UL & (0-(crc&1)));
+  }
+  return ~crc;
+}
+
+// The job:  runs on a worker, so it must not call TaskManager
+void crcJob(void* arg) {
+  Job* job = (Job*)arg;
+  uint32_t crc = 0;
+  for(int r=0; r<WORK; r++) crc = crc32(job->m_buf, BUFSIZE, crc);
+  job->m_crc = crc;
+}
+
+void submit(Job* job) {
+  job->m_waiting = !TaskMgr.offload(crcJob, job, DONE);
+}
+
+// Completion task:  each message is a job's pointer.  The jobs are offloaded again after the
+// mailbox has been read, since a job run in place sends its completion straight back.
+void done() {
+  Job* ready[NJOBS];
+  int n = 0;
+  do {
+    Job* job;
+    memcpy(&job, TaskMgr.getMessage(), sizeof(job));
+    if(job->m_crc!=job->m_expect) errors++;
+    finished++;
+    if(n<NJOBS) ready[n++] = job;
+  } while(TaskMgr.nextMessage());
+  for(int i=0; i<n; i++) submit(ready[i]);
+}
+
+// Start the jobs, and again any that could not be queued
+void feeder() {
+  for(int i=0; i<NJOBS; i++) if(jobs[i].m_waiting) submit(&jobs[i]);
+}
+
+void ticker() {
+  unsigned long now = micros();
+  unsigned long late = now-nextTickUs;
+  ticks++;
+  lateTotal += late;
+  if(late>lateMax) lateMax = late;
+  nextTickUs = now+TICKMS*1000UL;
+  TaskMgr.yieldDelay(TICKMS);
+}
+
+void report() {
+  Serial.printf("%s, %d workers:  %lu jobs/s, tick late %lu us avg, %lu us max, %lu errors\n",
+    OFFLOAD ? "offload" : "in place", OFFLOAD ? NWORKERS : 0, finished*1000/REPORTMS,
+    ticks ? lateTotal/ticks : 0, lateMax, errors);
+  finished = ticks = lateTotal = lateMax = 0;
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(500);
+  for(int i=0; i<NJOBS; i++) {
+    for(int j=0; j<BUFSIZE; j++) jobs[i].m_buf[j] = (byte)(i*31+j);
+    crcJob(&jobs[i]);
+    jobs[i].m_expect = jobs[i].m_crc;
+    jobs[i].m_waiting = true;		// the feeder starts them
+  }
+  if(OFFLOAD && !TaskMgr.beginOffload(NWORKERS, 0)) Serial.println("beginOffload() failed; jobs run in place");
+  TaskMgr.addAutoWaitMessage(DONE, done);
+  TaskMgr.setMailbox(DONE, NJOBS);
+  TaskMgr.addAutoWaitDelay(FEEDER, feeder, 100);
+  TaskMgr.add(TICKER, ticker);
+  TaskMgr.addAutoWaitDelay(REPORT, report, REPORTMS);
+  nextTickUs = micros();
+}
@@ -0,0 +1,157 @@
+// RadioQueueStress
+// Stress test for the lock-free ESP-NOW receive queue (ESP-32, or Linux with the MeshSim shims).
+//
+// The radio receive queue is a MessageQueue, filled by the receive callback in the WiFi task
+// and emptied by the radio receiver task.  This sketch runs its own MessageQueue with a
+// producer FreeRTOS task on core 0 standing in for the WiFi task, and a TaskManager task on
+// core 1 standing in for the radio receiver task.  Every eighth frame is a control frame, so
+// both lanes of the queue are used; the rest are messages.  Frames vary in length.
+//
+// Phase 1 (paced):  the producer never lets a lane hold more frames than it has room for.
+// Every frame must arrive, in order within its lane, with its payload intact, and nothing may
+// be dropped.
+// Phase 2 (flood):  the producer adds frames as fast as it can.  Frames may be dropped, but
+// every frame that arrives must still be in order within its lane and intact, and
+// received+dropped must equal sent, for each lane.
+//
+// Each phase prints the frames per second and the time per frame, which on the flood phase
+// is mostly the cost of add() and front()/pop().
+//
+// On Linux the producer is a std::thread (see test/MeshSim/host/Arduino.h).  Build (from the
+// library root):
+//   FLAGS="-std=gnu++17 -O2 -DARDUINO_ARCH_ESP32 -Itest/MeshSim/host -Isrc"
+//   LIB="src/TaskManager.cpp src/TaskManagerClockSync.cpp src/TaskManagerCompress.cpp src/TaskManagerOffload.cpp src/radioDriverESP.cpp"
+//   HOST="test/MeshSim/host/HostMain.cpp test/MeshSim/TaskManagerSim.cpp"
+//   g++ $FLAGS -o radioqueuestress -x c++ test/RadioQueueStress/RadioQueueStress.ino -x none $HOST $LIB -lpthread
+// Run:
+//   ./radioqueuestress 30
+
+#include <Arduino.h>
+#include <TaskManager.h>
+
+#define NFRAMES     200000UL
+#define CONSUMER    10
+#define TARGET      11		// the task the messages are addressed to; never added
+
+// The RadioCmd values the queue sorts on (TaskManager::RadioCmd is private)
+#define CMD_STATUS  1		// tmrStatus, a control frame
+#define CMD_MESSAGE 5		// tmrMessage
+
+// the payload:  target task, sequence number, then bytes derived from the sequence number
+#define SEQ_OFFSET  1
+#define FILL_OFFSET (SEQ_OFFSET+sizeof(uint32_t))
+
+MessageQueue queue;
+
+volatile bool flood = false;
+volatile bool producerDone = false;
+volatile unsigned long sent[2];			// by lane:  [0] messages, [1] control
+volatile unsigned long received[2];
+unsigned long errors = 0;
+uint32_t last[2];
+unsigned long phaseStart;
+int phase = 1;
+
+bool isControlSeq(uint32_t seq) { return (seq&7)==7; }
+
+// the frame for sequence number seq, and its length
+int fill(byte* buf, uint32_t seq) {
+  _TaskManagerRadioPacket* p = (_TaskManagerRadioPacket*)buf;
+  int n = FILL_OFFSET + seq%(TASKMGR_RADIO_DATA_SIZE-FILL_OFFSET+1);
+  p->m_cmd = isControlSeq(seq) ? CMD_STATUS : CMD_MESSAGE;
+  p->m_fromNodeId = seq&0xffff;
+  p->m_fromTaskId = seq%TASKMGR_SYSTEM_TASK_BASE;
+  p->m_data[0] = TARGET;
+  memcpy(p->m_data+SEQ_OFFSET, &seq, sizeof(seq));
+  for(int i=FILL_OFFSET; i<n; i++) p->m_data[i] = (byte)(seq+i);
+  return TASKMGR_RADIO_HEADER_SIZE+n;
+}
+
+// Tell whether a frame taken from the queue is the one fill() made
+bool intact(const _TaskManagerRadioFrame* f, uint32_t seq) {
+  byte buf[sizeof(_TaskManagerRadioPacket)];
+  int len = fill(buf, seq);
+  return f->m_len==len && memcmp(&f->m_packet, buf, len)==0;
+}
+
+// the next sequence number after seq in the same lane
+uint32_t nextInLane(uint32_t seq) {
+  bool control = isControlSeq(seq);
+  do seq++; while(isControlSeq(seq)!=control);
+  return seq;
+}
+
+// Stands in for msg_recv_cb() in the WiFi task
+void producer(void*) {
+  byte buf[sizeof(_TaskManagerRadioPacket)];
+  for(uint32_t seq=0; seq<NFRAMES; seq++) {
+    int lane = isControlSeq(seq);
+    unsigned long room = lane ? TASKMGR_CONTROL_QUEUE_SIZE : TASKMGR_MESSAGE_QUEUE_SIZE;
+    if(!flood) while(sent[lane]-received[lane]>=room) vTaskDelay(1);
+    int len = fill(buf, seq);
+    queue.add(buf, len);
+    sent[lane]++;
+  }
+  producerDone = true;
+  vTaskDelete(NULL);
+}
+
+void startPhase() {
+  for(int lane=0; lane<2; lane++) {
+    sent[lane] = received[lane] = 0;
+    last[lane] = 0xffffffffUL;		// nothing received yet
+  }
+  errors = 0;
+  producerDone = false;
+  phaseStart = micros();
+  xTaskCreatePinnedToCore(producer, "producer", 4096, NULL, 1, NULL, 0);
+}
+
+// Stands in for tmRadioReceiverTask()
+void consumer() {
+  _TaskManagerRadioFrame* f;
+  while((f=queue.front())!=NULL) {
+    uint32_t seq;
+    memcpy(&seq, f->m_packet.m_data+SEQ_OFFSET, sizeof(seq));
+    int lane = isControlSeq(seq);
+    if(last[lane]==0xffffffffUL) {
+      if(!flood && seq!=(lane ? 7UL : 0UL)) errors++;
+    } else if((!flood && seq!=nextInLane(last[lane])) || (flood && seq<=last[lane])) {
+      errors++;
+    }
+    if(!intact(f, seq)) errors++;
+    last[lane] = seq;
+    queue.pop();
+    received[lane]++;
+  }
+  if(producerDone && queue.isEmpty()) {
+    unsigned long us = micros()-phaseStart;
+    unsigned long allSent = sent[0]+sent[1];
+    unsigned long allReceived = received[0]+received[1];
+    unsigned long controlDrops = queue.controlDrops();
+    unsigned long messageDrops = queue.drops()-controlDrops;
+    bool pass;
+    Serial.printf("phase %d (%s): sent %lu received %lu dropped %lu (%lu control) errors %lu\n", phase, flood ? "flood" : "paced",
+      allSent, allReceived, messageDrops+controlDrops, controlDrops, errors);
+    Serial.printf("  %.0f frames/s received, %.0f ns/frame sent\n", allReceived*1e6/us, us*1000.0/allSent);
+    if(!flood) pass = allReceived==allSent && queue.drops()==0;
+    else pass = received[0]+messageDrops==sent[0] && received[1]+controlDrops==sent[1];
+    Serial.println(pass && errors==0 ? "  PASS" : "  FAIL");
+    if(flood) {
+      TaskMgr.yieldForMessage();	// done; wait forever
+    }
+    // start the flood phase.  The drop counts carry on from the paced phase, which had none.
+    flood = true;
+    phase = 2;
+    startPhase();
+  }
+}
+
+void setup() {
+  Serial.begin(115200);
+  delay(500);
+  Serial.printf("receive queue stress: %lu frames of up to %d bytes, capacity %d + %d control\n", NFRAMES,
+    (int)sizeof(_TaskManagerRadioPacket), TASKMGR_MESSAGE_QUEUE_SIZE, TASKMGR_CONTROL_QUEUE_SIZE);
+  TaskMgr.add(CONSUMER, consumer);
+  startPhase();
+}
@@ -0,0 +1,88 @@
+// TaskSwapBench
+// Task-switch microbenchmark.  This is an evolution of TaskSwapTimer.
+//
+// TaskSwapTimer measured micros() between two tasks once.  This sketch runs the
+// measurement at scale:  NTASKS tasks of one kind are added, the scheduler is run
+// for NPASSES full passes over the task ring, and the average time per task switch
+// is printed.  The kinds are:
+//   plain  -- the task simply returns
+//   macro  -- the task yields with TMR_YIELD and is added with addReturnYield()
+//             (recorded and returned, no setjmp or longjmp)
+//   macrojmp -- the same task added with add(), so each dispatch still arms setjmp
+//   legacy -- the task yields with a bare TaskMgr.yield() (setjmp/longjmp dispatch)
+//
+// The macro tasks share one procedure but each has its own state block, passed as
+// its context, so every task really alternates between its two halves.
+//
+// Each kind is run in its own pass of the sketch; set BENCHKIND and re-upload.
+// The numbers include the round-robin scan and the null task.
+
+#include <Arduino.h>
+#include <TaskManager.h>
+
+#define NTASKS  64
+#define NPASSES 1000
+
+#define KIND_PLAIN  0
+#define KIND_MACRO  1
+#define KIND_LEGACY 2
+#define KIND_MACROJMP 3
+#define BENCHKIND KIND_MACRO
+
+#define REPORTTASK 200
+
+unsigned long int nSwitches = 0;
+unsigned long int t0;
+
+void plainTask() {
+  nSwitches++;
+}
+
+struct MacroState {
+  uint32_t tmrNext;
+};
+MacroState macroState[NTASKS];
+
+void macroTask(void*) {
+  TMR_BEGIN_CONTEXT(MacroState);
+  nSwitches++;
+  TMR_YIELD(1);
+  nSwitches++;
+  TMR_END();
+}
+
+void legacyTask() {
+  nSwitches++;
+  TaskMgr.yield();
+}
+
+void reportTask() {
+  unsigned long int t1 = micros();
+  static bool reported = false;
+  if(nSwitches<(unsigned long)NTASKS*NPASSES || reported) return;
+  reported = true;
+  Serial.print("kind ");
+  Serial.print(BENCHKIND==KIND_PLAIN ? "plain" : BENCHKIND==KIND_MACRO ? "macro"
+    : BENCHKIND==KIND_MACROJMP ? "macrojmp" : "legacy");
+  Serial.print(": ");
+  Serial.print(nSwitches);
+  Serial.print(" switches in ");
+  Serial.print(t1-t0);
+  Serial.print(" us, ");
+  Serial.print((float)(t1-t0)/nSwitches);
+  Serial.println(" us/switch");
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(500);
+  for(int i=0; i<NTASKS; i++) {
+    if(BENCHKIND==KIND_PLAIN) TaskMgr.add(i, plainTask);
+    else if(BENCHKIND==KIND_MACRO) TaskMgr.addReturnYield(i, macroTask, &macroState[i]);
+    else if(BENCHKIND==KIND_MACROJMP) TaskMgr.add(i, macroTask, &macroState[i]);
+    else TaskMgr.add(i, legacyTask);
+  }
+  TaskMgr.add(REPORTTASK, reportTask);
+  t0 = micros();
+}
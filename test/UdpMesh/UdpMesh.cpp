@@ -0,0 +1,265 @@
+// UdpMesh
+// Runs TaskManager nodes as Linux processes that talk over TaskManagerUdpTransport, and
+// measures message throughput and round-trip latency.
+//
+// MeshSim simulates the radio.  UdpMesh uses a real one, of a sort:  every node is a forked
+// copy of this program with its own TaskMgr, and its frames are UDP datagrams on 127.0.0.1
+// (node ID i on port TASKMGR_UDP_BASE_PORT+i).  The Arduino shim is MeshSim's
+// (test/MeshSim/TaskManagerSim.cpp), run from the host's monotonic clock instead of simulated
+// time, so all nodes share one microsecond clock and a node sketch can use the TmSim*() calls.
+//
+// Node 1 sends probes of "size" bytes to the other nodes in turn, keeping up to "window" of them
+// unanswered.  Every other node echoes each probe back.  If nothing comes back for "timeout" ms,
+// the unanswered probes are counted as lost and node 1 starts again.  Reliable delivery is on if
+// "reliable" is 1.  Each of these can be changed with --set name=value.  Probes longer than one
+// frame need a bigger TASKMGR_MESSAGE_SIZE (for example -DTASKMGR_MESSAGE_SIZE=1000 in FLAGS).
+//
+// Build (from the library root):
+//   FLAGS="-std=gnu++17 -O2 -DARDUINO_ARCH_ESP32 -DCONFIG_FREERTOS_UNICORE -Itest/MeshSim/host -Itest/MeshSim -Isrc"
+//   LIB="src/TaskManager.cpp src/TaskManagerClockSync.cpp src/TaskManagerCompress.cpp src/TaskManagerOffload.cpp src/radioDriverESP.cpp src/TaskManagerUdpTransport.cpp"
+//   g++ $FLAGS -o udpmesh test/UdpMesh/UdpMesh.cpp test/MeshSim/TaskManagerSim.cpp $LIB
+// Run:
+//   ./udpmesh -n 4 -t 10 --set size=200 --set window=8
+//
+// Options:
+//   -n, --nodes N        nodes, 2 or more (2)
+//   -t, --time S         seconds node 1 sends for (10)
+//   --set NAME=VALUE     a parameter for the node sketch (see TmSimParam())
+
+#include <Arduino.h>
+#include <TaskManager.h>
+#include <TaskManagerTransport.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "MeshSimHost.h"
+#include "TaskManagerSim.h"
+
+#define CLIENT    10
+#define ECHO      11
+
+// host entry points, from TaskManagerSim.cpp
+extern "C" void TmSimAttach(const TmSimHost* host);
+extern "C" void TmSimSetup();
+
+//
+// The node sketch
+//
+
+struct Probe {
+  uint32_t m_seq;
+  uint64_t m_sentUs;
+  byte m_pad[TASKMGR_MESSAGE_SIZE];
+} __attribute__((packed));
+
+static TaskManagerUdpTransport* udp;
+static int probeSize;
+static int window;
+static unsigned long runMs;
+static unsigned long startMs;
+static int outstanding;
+static int nextNode;
+static uint32_t seq;
+static unsigned long long nSent, nReplies, nLost;
+static std::vector<uint32_t> rtts;
+
+// the p'th percentile of a sorted list, in us
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+  if(sorted.empty()) return 0;
+  return sorted[(size_t)(p/100*(sorted.size()-1)+0.5)];
+}
+
+static void report() {
+  double secs = (millis()-startMs)/1000.0;
+  double avg = 0;
+  std::sort(rtts.begin(), rtts.end());
+  for(uint32_t r : rtts) avg += r;
+  if(!rtts.empty()) avg /= rtts.size();
+  printf("Nodes:       %d, probe %d bytes, window %d, %.1f s\n", TmSimNodes(), probeSize, window, secs);
+  printf("Probes:      %llu sent, %llu echoed, %llu lost\n", nSent, nReplies, nLost);
+  printf("Throughput:  %.0f round trips/s, %.3f MB/s each way\n", nReplies/secs, nReplies*(double)probeSize/secs/1e6);
+  printf("Round trip:  %.0f us avg, %u us p50, %u us p95, %u us p99, %u us max\n",
+    avg, percentile(rtts, 50), percentile(rtts, 95), percentile(rtts, 99), percentile(rtts, 100));
+  fflush(stdout);
+}
+
+// fill the window, sending to the other nodes in turn
+static void sendProbes() {
+  static Probe probe;
+  while(outstanding<window) {
+    nextNode = nextNode%(TmSimNodes()-1)+1;
+    probe.m_seq = ++seq;
+    probe.m_sentUs = TmSimMicros();
+    if(!TaskMgr.sendMessage(TmSimNodeId(nextNode), ECHO, &probe, probeSize)) break;  // try again on the next echo
+    outstanding++;
+    nSent++;
+  }
+}
+
+void client() {
+  Probe probe;
+  if(startMs==0) startMs = millis();
+  if(TaskMgr.timedOut()) {
+    nLost += outstanding;
+    outstanding = 0;
+  } else {
+    do {
+      if(TaskMgr.getMessageLength()<(int)offsetof(Probe, m_pad)) continue;
+      memcpy(&probe, TaskMgr.getMessage(), offsetof(Probe, m_pad));
+      rtts.push_back(TmSimMicros()-probe.m_sentUs);
+      nReplies++;
+      if(outstanding>0) outstanding--;	// a late echo of a probe already counted as lost
+    } while(TaskMgr.nextMessage());
+  }
+  if(millis()-startMs>=runMs) {
+    report();
+    exit(0);
+  }
+  sendProbes();
+}
+
+void echo() {
+  tm_nodeId_t fromNode;
+  tm_taskId_t fromTask;
+  do {
+    TaskMgr.getSource(fromNode, fromTask);
+    TaskMgr.sendMessage(fromNode, fromTask, (void*)TaskMgr.getMessage(), TaskMgr.getMessageLength());
+  } while(TaskMgr.nextMessage());
+}
+
+void setup() {
+  probeSize = constrain(TmSimParam("size", 32), (long)offsetof(Probe, m_pad), (long)TASKMGR_MESSAGE_SIZE);
+  window = constrain(TmSimParam("window", 1), 1L, 255L);
+  runMs = TmSimParam("time", 10000);
+  udp = new TaskManagerUdpTransport(TmSimParam("port", TASKMGR_UDP_BASE_PORT), 0x7f000001UL, TmSimNodes());
+  if(!TaskMgr.radioBegin(TmSimNodeId(), *udp)) {
+    fprintf(stderr, "node %u: cannot open UDP port %ld\n", TmSimNodeId(), TmSimParam("port", TASKMGR_UDP_BASE_PORT)+TmSimNodeId());
+    exit(1);
+  }
+  TaskMgr.setRadioReliable(TmSimParam("reliable", 0)!=0);
+  if(TmSimNodeId()==TmSimNodeId(0)) {
+    // the first timeout starts it off
+    TaskMgr.addAutoWaitMessage(CLIENT, client, TmSimParam("timeout", 200));
+    TaskMgr.setMailbox(CLIENT, window);
+  } else {
+    TaskMgr.addAutoWaitMessage(ECHO, echo);
+    TaskMgr.setMailbox(ECHO, 255);
+  }
+}
+
+//
+// The runner
+//
+
+static std::map<std::string, long> params;
+static std::vector<uint16_t> nodeIds;
+static uint64_t nowUs;
+static uint32_t randomState;
+
+static uint64_t monotonicUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+static bool hostSend(void*, int, uint16_t, const uint8_t*, int) { return false; }	// TmSimRadio() is not used
+static void hostSending(void*, int, int) {}
+static void hostDelivered(void*, int, uint16_t, uint32_t, int) {}
+
+static long hostParam(void*, const char* name, long def) {
+  std::map<std::string, long>::const_iterator it = params.find(name);
+  return it==params.end() ? def : it->second;
+}
+
+static uint32_t hostRandom(void*, int) {
+  randomState ^= randomState<<13;
+  randomState ^= randomState>>17;
+  randomState ^= randomState<<5;
+  return randomState;
+}
+
+// Run node index in this process until it exits or is killed
+static void runNode(int index) {
+  static TmSimHost host;
+  host.m_nowUs = &nowUs;
+  host.m_sim = NULL;
+  host.m_index = index;
+  host.m_nodes = nodeIds.size();
+  host.m_nodeId = nodeIds[index];
+  host.m_nodeIds = &nodeIds[0];
+  host.m_clockOffsetUs = 0;
+  host.m_clockDriftPpm = 0;
+  host.m_send = hostSend;
+  host.m_sending = hostSending;
+  host.m_delivered = hostDelivered;
+  host.m_param = hostParam;
+  host.m_random = hostRandom;
+  randomState = 2463534242UL+index;
+  nowUs = monotonicUs();
+  TmSimAttach(&host);
+  TmSimSetup();
+  for(;;) {
+    nowUs = monotonicUs();
+    loop();
+    unsigned long idle = TaskMgr.idleTime();
+    if(idle!=0) {
+      // sleep until a task is due or a datagram arrives; idleTime() does not foresee datagrams
+      struct pollfd pfd = { udp->fd(), POLLIN, 0 };
+      poll(&pfd, 1, idle==TASKMGR_IDLE_FOREVER || idle>10 ? 10 : (int)idle);
+    }
+  }
+}
+
+static void usage(const char* me) {
+  fprintf(stderr, "usage: %s [-n nodes] [-t seconds] [--set name=value]...\n", me);
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  static const struct option options[] = {
+    { "nodes", required_argument, NULL, 'n' },
+    { "time", required_argument, NULL, 't' },
+    { "set", required_argument, NULL, 'S' },
+    { NULL, 0, NULL, 0 }
+  };
+  int nodes = 2;
+  double seconds = 10;
+  int opt;
+  while((opt=getopt_long(argc, argv, "n:t:", options, NULL))!=-1) {
+    switch(opt) {
+      case 'n': nodes = atoi(optarg); break;
+      case 't': seconds = atof(optarg); break;
+      case 'S': {
+        const char* eq = strchr(optarg, '=');
+        if(eq==NULL) usage(argv[0]);
+        params[std::string(optarg, eq-optarg)] = atol(eq+1);
+        break;
+      }
+      default: usage(argv[0]);
+    }
+  }
+  if(optind!=argc || nodes<2 || nodes>TASKMGR_UDP_MAX_NODE) usage(argv[0]);
+  params["time"] = (long)(seconds*1000);
+  for(int i=0; i<nodes; i++) nodeIds.push_back(i+1);
+
+  // the echo nodes first, so they are listening when node 1 starts
+  std::vector<pid_t> pids(nodes);
+  fflush(stdout);
+  for(int i=nodes-1; i>=0; i--) {
+    pids[i] = fork();
+    if(pids[i]<0) { perror("fork"); return 1; }
+    if(pids[i]==0) runNode(i);
+  }
+  int status;
+  waitpid(pids[0], &status, 0);
+  for(int i=1; i<nodes; i++) kill(pids[i], SIGTERM);
+  for(int i=1; i<nodes; i++) waitpid(pids[i], NULL, 0);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}